@@ -1,4 +1,5 @@
 #include "bulk_processor.h"
+#include "communication/http_client.h"
 #include "communication/shazam.h"
 #include "../include/vibra.h"
 
@@ -9,23 +10,78 @@
 #include <chrono>
 #include <iomanip>
 #include <random>
-#include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
 #include <cstring>
 #include <climits>
-#include <curl/curl.h>
+#include <limits>
 
 // Static instance for signal handler
 BulkProcessor* BulkProcessor::current_instance_ = nullptr;
 
+// Files found by the scan and not yet picked up by a fingerprinting thread
+constexpr size_t SCAN_QUEUE_CAPACITY = 4096;
+// Auto mode checks the recognition queue this often
+constexpr int WORKER_SCALING_INTERVAL_MS = 1000;
+// Directories listed at once
+constexpr int DIRECTORY_SCAN_THREADS = 8;
+// Fingerprints waiting for the network stage; a few KB each
+constexpr size_t RECOGNITION_QUEUE_CAPACITY = 64;
+// Transient failures (timeouts, dropped connections, 5xx) sent again per file, waiting
+// RETRY_BASE_SECONDS, then twice as long each time up to RETRY_MAX_SECONDS
+constexpr int MAX_TRANSIENT_RETRIES = 3;
+constexpr double RETRY_BASE_SECONDS = 2.0;
+constexpr double RETRY_MAX_SECONDS = 60.0;
+// Share of their landmarks two files have in common at least to count as the same audio.
+// Copies, re-encodes and level changes of a recording share 0.5 to 1 of them, unrelated ones
+// about 0.01; a remix or another take sharing part of the audio must not get its result.
+constexpr double DUPLICATE_MIN_SIMILARITY = 0.5;
+// How old the exit IP recorded with results may get by default
+constexpr int EXIT_IP_REFRESH_SECONDS = 300;
+// Ceiling for the adaptive request rate, in requests per second
+constexpr double MAX_REQUEST_RATE = 20.0;
+// Back-offs in a row, without a success in between, before giving up
+constexpr int MAX_RATE_LIMIT_RETRIES = 3;
+
+// Files kept next to the output: results.json logs to results.jsonl, indexes to results.index
+static std::string SidecarPath(const std::string& output_json_path, const std::string& extension) {
+    const std::string json_extension = ".json";
+    if (output_json_path.size() > json_extension.size() &&
+        output_json_path.compare(output_json_path.size() - json_extension.size(),
+                                 json_extension.size(), json_extension) == 0) {
+        return output_json_path.substr(0, output_json_path.size() - json_extension.size()) +
+               extension;
+    }
+    return output_json_path + extension;
+}
+
+// One fingerprinting thread per core
+static int DefaultFingerprintWorkers() {
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 0 ? static_cast<int>(cores) : 1;
+}
+
 BulkProcessor::BulkProcessor(const std::string& directory_path, const std::string& output_json_path,
                              int num_threads, bool resume, int delay_seconds)
     : output_json_path_(output_json_path),
+      results_log_path_(SidecarPath(output_json_path, ".jsonl")),
+      resume_index_path_(SidecarPath(output_json_path, ".index")),
       num_threads_(num_threads),
+      fingerprint_workers_(DefaultFingerprintWorkers()),
       resume_enabled_(resume),
       delay_seconds_(delay_seconds),
+      file_order_(FileOrder::DISCOVERY),
+      dedupe_enabled_(true),
+      output_fd_(-1),
       proxy_rotation_timeout_(60),
-      next_file_index_(0) {
+      exit_ip_(EXIT_IP_REFRESH_SECONDS),
+      duplicates_(DUPLICATE_MIN_SIMILARITY),
+      scan_queue_(SCAN_QUEUE_CAPACITY),
+      recognition_queue_(RECOGNITION_QUEUE_CAPACITY),
+      completion_queue_(std::numeric_limits<size_t>::max()) {
 
     // Convert directory path to absolute path
     char resolved_path[PATH_MAX];
@@ -48,6 +104,12 @@ BulkProcessor::BulkProcessor(const std::string& directory_path, const std::strin
     std::signal(SIGTERM, SignalHandler);
 }
 
+BulkProcessor::~BulkProcessor() {
+    if (output_fd_ >= 0) {
+        close(output_fd_);
+    }
+}
+
 void BulkProcessor::SignalHandler(int) {
     if (current_instance_) {
         std::cout << "\n\n" << std::string(60, '=') << std::endl;
@@ -56,6 +118,8 @@ void BulkProcessor::SignalHandler(int) {
 
         // Signal threads to stop
         current_instance_->processing_complete_ = true;
+        // and kill any ffmpeg they are waiting on
+        vibra_cancel_decoding();
 
         // Give threads a moment to finish current operations
         std::this_thread::sleep_for(std::chrono::milliseconds(500));
@@ -84,52 +148,60 @@ void BulkProcessor::SetSupportedFormats(const std::vector<std::string>& formats)
     supported_formats_ = formats;
 }
 
-void ScanDirectoryRecursive(const std::string& path, std::vector<std::string>& files,
-                            const std::vector<std::string>& supported_formats) {
-    DIR* dir = opendir(path.c_str());
-    if (!dir) {
-        return;
+// Decoding time goes with duration, which a file's size tells once its format's typical
+// bitrate is known; good enough to put the long files first without opening any of them
+static double EstimatedSeconds(const ScannedFile& file) {
+    std::string extension = file.path.substr(file.path.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    double bytes_per_second = 32000.0;  // mp3, m4a, aac, ogg at 256 kbit/s
+    if (extension == "wav") {
+        bytes_per_second = 176400.0;  // 16-bit stereo at 44.1 kHz
+    } else if (extension == "flac") {
+        bytes_per_second = 100000.0;
     }
+    return file.identity.size / bytes_per_second;
+}
 
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != nullptr) {
-        // Skip . and ..
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
-
-        std::string full_path = path + "/" + entry->d_name;
-
-        struct stat statbuf;
-        if (stat(full_path.c_str(), &statbuf) == 0) {
-            if (S_ISDIR(statbuf.st_mode)) {
-                // Recurse into subdirectory
-                ScanDirectoryRecursive(full_path, files, supported_formats);
-            } else if (S_ISREG(statbuf.st_mode)) {
-                // Check if supported format
-                std::string filename = entry->d_name;
-                size_t dot_pos = filename.find_last_of('.');
-                if (dot_pos != std::string::npos) {
-                    std::string ext = filename.substr(dot_pos);
-                    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-
-                    if (std::find(supported_formats.begin(), supported_formats.end(), ext) !=
-                        supported_formats.end()) {
-                        files.push_back(full_path);
-                    }
-                }
+void BulkProcessor::ScanDirectory() {
+    bool streaming = file_order_ == FileOrder::DISCOVERY;
+    std::vector<ScannedFile> found; // ordered ones only
+    std::mutex found_mutex;
+
+    DirectoryScanner scanner(
+        DIRECTORY_SCAN_THREADS,
+        [this](const char* name) { return IsSupportedFormat(name); },
+        [&](const std::string& path, const struct stat& st) {
+            ScannedFile file;
+            file.path = path;
+            file.identity = IdentityOf(st);
+            stats_.total_files++;
+            if (streaming) {
+                // false once processing stopped
+                return scan_queue_.Push(file);
             }
+            std::lock_guard<std::mutex> lock(found_mutex);
+            found.push_back(file);
+            return !processing_complete_.load();
+        });
+    scanner.Scan(directory_path_);
+
+    if (file_order_ == FileOrder::PATH) {
+        std::sort(found.begin(), found.end(), [](const ScannedFile& a, const ScannedFile& b) {
+            return a.path < b.path;
+        });
+    } else if (file_order_ == FileOrder::LONGEST_FIRST) {
+        // the long files get going while there are still short ones to fill in around them
+        std::stable_sort(found.begin(), found.end(), [](const ScannedFile& a, const ScannedFile& b) {
+            return EstimatedSeconds(a) > EstimatedSeconds(b);
+        });
+    }
+    for (const ScannedFile& file : found) {
+        if (!scan_queue_.Push(file)) {
+            break;
         }
     }
-
-    closedir(dir);
-}
-
-std::vector<std::string> BulkProcessor::ScanDirectory() {
-    std::vector<std::string> files;
-    ScanDirectoryRecursive(directory_path_, files, supported_formats_);
-    std::sort(files.begin(), files.end());
-    return files;
+    scan_complete_ = true;
+    scan_queue_.Close();
 }
 
 bool BulkProcessor::IsSupportedFormat(const std::string& file_path) {
@@ -144,88 +216,291 @@ bool BulkProcessor::IsSupportedFormat(const std::string& file_path) {
     return std::find(supported_formats_.begin(), supported_formats_.end(), ext) != supported_formats_.end();
 }
 
-void BulkProcessor::LoadCache() {
-    std::ifstream cache_file(output_json_path_);
-    if (!cache_file.is_open()) {
-        return; // No cache file exists yet
+// Follows how deep a JSON text nests objects, one character at a time. Braces inside strings
+// (titles, file names, error messages) don't count.
+struct JsonNesting {
+    int depth = 0;
+    bool in_string = false;
+    bool escaped = false;
+
+    // +1 if c opens an object, -1 if it closes one, 0 otherwise
+    int Feed(char c) {
+        if (in_string) {
+            if (escaped) {
+                escaped = false;
+            } else if (c == '\\') {
+                escaped = true;
+            } else if (c == '"') {
+                in_string = false;
+            }
+            return 0;
+        }
+        if (c == '"') {
+            in_string = true;
+        } else if (c == '{') {
+            depth++;
+            return 1;
+        } else if (c == '}') {
+            depth--;
+            return -1;
+        }
+        return 0;
+    }
+};
+
+// A string as a JSON string literal's contents
+static std::string JsonEscape(const std::string& value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+            escaped += code;
+        } else {
+            escaped += c;
+        }
     }
+    return escaped;
+}
 
-    std::stringstream buffer;
-    buffer << cache_file.rdbuf();
-    std::string json_content = buffer.str();
-    cache_file.close();
+// The string whose opening quote is at block[start]; *end is set past its closing quote, npos if
+// there is none
+static std::string ReadJsonString(const std::string& block, size_t start, size_t* end) {
+    std::string value;
+    if (start == std::string::npos) {
+        *end = std::string::npos;
+        return value;
+    }
+    size_t i = start + 1;
+    for (; i < block.size() && block[i] != '"'; i++) {
+        if (block[i] != '\\' || i + 1 == block.size()) {
+            value += block[i];
+            continue;
+        }
+        char c = block[++i];
+        if (c == 'u' && i + 4 < block.size()) {  // JsonEscape only writes control characters so
+            value += static_cast<char>(strtol(block.substr(i + 1, 4).c_str(), nullptr, 16));
+            i += 4;
+        } else if (c == 'n') {
+            value += '\n';
+        } else if (c == 't') {
+            value += '\t';
+        } else if (c == 'r') {
+            value += '\r';
+        } else {
+            value += c;
+        }
+    }
+    *end = i < block.size() ? i + 1 : std::string::npos;
+    return value;
+}
 
-    // Simple JSON parsing for our cache format
-    // Format: {"results": [{"file": "path", "success": true, "ip": "...", "response": {...}}, ...]}
-    size_t pos = 0;
-    while ((pos = json_content.find("\"file\":", pos)) != std::string::npos) {
-        // Extract file path
-        size_t file_start = json_content.find("\"", pos + 7) + 1;
-        size_t file_end = json_content.find("\"", file_start);
-        std::string file_path = json_content.substr(file_start, file_end - file_start);
+// Parses one result object, as written to the output JSON or the results log
+static BulkResult ParseResult(const std::string& result_block) {
+    BulkResult result;
+    result.success = false;
 
-        // Find the end of this result object (next "}" at same level)
-        size_t result_start = json_content.rfind("{", pos);
-        size_t result_end = result_start + 1;
-        int brace_count = 1;
-        while (brace_count > 0 && result_end < json_content.length()) {
-            if (json_content[result_end] == '{') brace_count++;
-            else if (json_content[result_end] == '}') brace_count--;
-            result_end++;
-        }
+    // Extract file path
+    size_t file_pos = result_block.find("\"file\":");
+    if (file_pos != std::string::npos) {
+        size_t file_end;
+        result.file_path = ReadJsonString(result_block, result_block.find("\"", file_pos + 7), &file_end);
+    }
 
-        // Extract result block for parsing
-        std::string result_block = json_content.substr(result_start, result_end - result_start);
+    // Parse success field
+    size_t success_pos = result_block.find("\"success\":");
+    if (success_pos != std::string::npos) {
+        result.success = result_block.find("true", success_pos) < result_block.find("false", success_pos);
+    }
 
-        BulkResult result;
-        result.file_path = file_path;
+    // Parse identity field (results log only)
+    size_t identity_pos = result_block.find("\"identity\": [");
+    if (identity_pos != std::string::npos) {
+        const char* next = result_block.c_str() + identity_pos + 13;
+        char* end = nullptr;
+        result.identity.device = strtoull(next, &end, 10);
+        result.identity.inode = strtoull(end + 1, &end, 10);
+        result.identity.size = strtoull(end + 1, &end, 10);
+        result.identity.mtime_ns = strtoll(end + 1, &end, 10);
+    }
 
-        // Parse success field
-        size_t success_pos = result_block.find("\"success\":");
-        if (success_pos != std::string::npos) {
-            result.success = result_block.find("true", success_pos) < result_block.find("false", success_pos);
+    // Parse IP field (optional)
+    size_t ip_pos = result_block.find("\"ip\":");
+    if (ip_pos != std::string::npos) {
+        size_t ip_end;
+        std::string ip = ReadJsonString(result_block, result_block.find("\"", ip_pos + 5), &ip_end);
+        if (ip_end != std::string::npos) {
+            result.ip_address = ip;
         }
+    }
 
-        // Parse IP field (optional)
-        size_t ip_pos = result_block.find("\"ip\":");
-        if (ip_pos != std::string::npos) {
-            size_t ip_start = result_block.find("\"", ip_pos + 5) + 1;
-            size_t ip_end = result_block.find("\"", ip_start);
-            if (ip_end != std::string::npos) {
-                result.ip_address = result_block.substr(ip_start, ip_end - ip_start);
+    // Parse duplicate field (optional)
+    size_t duplicate_pos = result_block.find("\"duplicate_of\":");
+    if (duplicate_pos != std::string::npos) {
+        size_t duplicate_end;
+        std::string duplicate_of =
+            ReadJsonString(result_block, result_block.find("\"", duplicate_pos + 15), &duplicate_end);
+        if (duplicate_end != std::string::npos) {
+            result.duplicate_of = duplicate_of;
+        }
+    }
+
+    // Parse response field (for successful results)
+    size_t response_pos = result_block.find("\"response\":");
+    if (response_pos != std::string::npos) {
+        size_t resp_obj_start = result_block.find("{", response_pos);
+        if (resp_obj_start != std::string::npos) {
+            JsonNesting nesting;
+            nesting.Feed('{');
+            size_t resp_obj_end = resp_obj_start + 1;
+
+            while (nesting.depth > 0 && resp_obj_end < result_block.length()) {
+                nesting.Feed(result_block[resp_obj_end]);
+                resp_obj_end++;
             }
+
+            result.json_response = result_block.substr(resp_obj_start, resp_obj_end - resp_obj_start);
         }
+    }
 
-        // Parse response field (for successful results)
-        size_t response_pos = result_block.find("\"response\":");
-        if (response_pos != std::string::npos) {
-            size_t resp_obj_start = result_block.find("{", response_pos);
-            if (resp_obj_start != std::string::npos) {
-                int resp_brace_count = 1;
-                size_t resp_obj_end = resp_obj_start + 1;
+    // Parse error field (for failed results)
+    size_t error_pos = result_block.find("\"error\":");
+    if (error_pos != std::string::npos) {
+        size_t error_end;
+        std::string error = ReadJsonString(result_block, result_block.find("\"", error_pos + 8), &error_end);
+        if (error_end != std::string::npos) {
+            result.error_message = error;
+        }
+    }
 
-                while (resp_brace_count > 0 && resp_obj_end < result_block.length()) {
-                    if (result_block[resp_obj_end] == '{') resp_brace_count++;
-                    else if (result_block[resp_obj_end] == '}') resp_brace_count--;
-                    resp_obj_end++;
-                }
+    return result;
+}
+
+// One line of the results log
+static std::string FormatResultLine(const BulkResult& result) {
+    std::string line = "{\"file\": \"" + JsonEscape(result.file_path) + "\", \"success\": ";
+    line += result.success ? "true" : "false";
+    if (result.identity.known()) {
+        line += ", \"identity\": [" + std::to_string(result.identity.device) + ", " +
+                std::to_string(result.identity.inode) + ", " + std::to_string(result.identity.size) +
+                ", " + std::to_string(result.identity.mtime_ns) + "]";
+    }
+    if (!result.ip_address.empty()) {
+        line += ", \"ip\": \"" + JsonEscape(result.ip_address) + "\"";
+    }
+    if (!result.duplicate_of.empty()) {
+        line += ", \"duplicate_of\": \"" + JsonEscape(result.duplicate_of) + "\"";
+    }
+    if (result.success) {
+        line += ", \"response\": ";
+        // newlines can only be whitespace in valid JSON, the record has to stay on one line
+        size_t response_start = line.size();
+        line += result.json_response;
+        std::replace(line.begin() + response_start, line.end(), '\n', ' ');
+        std::replace(line.begin() + response_start, line.end(), '\r', ' ');
+    } else {
+        line += ", \"error\": \"" + JsonEscape(result.error_message) + "\"";
+    }
+    line += "}\n";
+    return line;
+}
+
+static StoredResult StoredOf(const BulkResult& result, ResultSource source, std::uint64_t offset,
+                             size_t length) {
+    StoredResult stored;
+    stored.source = source;
+    stored.offset = offset;
+    stored.length = static_cast<std::uint32_t>(length);
+    stored.identity = result.identity;
+    stored.success = result.success;
+    return stored;
+}
 
-                result.json_response = result_block.substr(resp_obj_start, resp_obj_end - resp_obj_start);
+void BulkProcessor::LoadCache() {
+    // Kept open, results are read from it again when needed
+    output_fd_ = open(output_json_path_.c_str(), O_RDONLY | O_CLOEXEC);
+    bool loaded_output = output_fd_ >= 0;
+    if (loaded_output) {
+        // Simple JSON parsing for our cache format
+        // Format: {"results": [{"file": "path", "success": true, "ip": "...", "response": {...}}, ...]}
+        // Each result object is read on its own, so the whole file is never in memory
+        char buffer[65536];
+        std::string block;
+        std::uint64_t offset = 0;
+        std::uint64_t block_start = 0;
+        JsonNesting nesting;
+        ssize_t got;
+        while ((got = read(output_fd_, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t i = 0; i < got; i++, offset++) {
+                char c = buffer[i];
+                int step = nesting.Feed(c);
+                // result objects sit one level into the outer one
+                if (step > 0 && nesting.depth == 2) {
+                    block_start = offset;
+                    block.clear();
+                }
+                if (nesting.depth >= 2 || (step < 0 && nesting.depth == 1)) {
+                    block += c;
+                }
+                if (step < 0 && nesting.depth == 1) {
+                    BulkResult result = ParseResult(block);
+                    if (!result.file_path.empty()) {  // not the stats
+                        results_cache_[result.file_path] =
+                            StoredOf(result, ResultSource::OUTPUT, block_start, block.size());
+                    }
+                }
             }
         }
+    }
 
-        // Parse error field (for failed results)
-        size_t error_pos = result_block.find("\"error\":");
-        if (error_pos != std::string::npos) {
-            size_t error_start = result_block.find("\"", error_pos + 8) + 1;
-            size_t error_end = result_block.find("\"", error_start);
-            if (error_end != std::string::npos) {
-                result.error_message = result_block.substr(error_start, error_end - error_start);
-            }
+    // Results logged after the output was last compacted, i.e. by a run that didn't finish;
+    // later lines win
+    std::ifstream log_file(results_log_path_);
+    std::string line;
+    std::uint64_t line_start = 0;
+    int replayed = 0;
+    while (std::getline(log_file, line)) {
+        std::uint64_t line_offset = line_start;
+        line_start += line.size() + 1;
+        // a crash can leave the last line cut short
+        JsonNesting nesting;
+        for (char c : line) {
+            nesting.Feed(c);
+        }
+        if (line.empty() || line.back() != '}' || nesting.depth != 0 || nesting.in_string) {
+            continue;
+        }
+        BulkResult result = ParseResult(line);
+        if (!result.file_path.empty()) {
+            results_cache_[result.file_path] =
+                StoredOf(result, ResultSource::LOG, line_offset, line.size());
+            replayed++;
         }
+    }
 
-        results_cache_[file_path] = result;
-        pos = result_end;
+    if (results_cache_.empty()) {
+        return; // No cache file exists yet
+    }
+
+    bool have_index = resume_index_.Open(resume_index_path_);
+    if (!have_index) {
+        // Output of a vibra without the index: trust that the files are as they were
+        for (auto& pair : results_cache_) {
+            struct stat statbuf;
+            if (!pair.second.identity.known() && stat(pair.first.c_str(), &statbuf) == 0) {
+                pair.second.identity = IdentityOf(statbuf);
+            }
+        }
+    }
+    if (!have_index || replayed > 0) {
+        // bring the index up to date, so it answers for every cached result
+        if (SaveResumeIndex(results_cache_)) {
+            resume_index_.Open(resume_index_path_);
+        }
     }
 
     // Restore stats from cached results
@@ -242,55 +517,86 @@ void BulkProcessor::LoadCache() {
 
     stats_.successful = cached_successful;
     stats_.failed = cached_failed;
-    stats_.skipped = results_cache_.size();
 
-    std::cout << "Loaded " << results_cache_.size() << " cached results from " << output_json_path_ << std::endl;
+    std::cout << "Loaded " << results_cache_.size() << " cached results from ";
+    if (loaded_output) {
+        std::cout << output_json_path_ << (replayed > 0 ? " and " : "");
+    }
+    std::cout << (replayed > 0 ? results_log_path_ : "") << std::endl;
     std::cout << "Restored stats: OK:" << cached_successful << " FAIL:" << cached_failed << std::endl;
 }
 
+void BulkProcessor::OpenResultsLog() {
+    // a fresh run starts a fresh log, a resumed one keeps what LoadCache has read
+    if (!results_log_.Open(results_log_path_, !resume_enabled_)) {
+        std::cerr << "Failed to open results log " << results_log_path_ << ": " << strerror(errno)
+                  << " - results are only saved at the end" << std::endl;
+        return;
+    }
+    // a line cut short by a crash would swallow the first one appended after it
+    std::string last;
+    if (results_log_.size() > 0 && results_log_.Read(results_log_.size() - 1, 1, &last) &&
+        last != "\n") {
+        results_log_.Append("\n");
+    }
+}
+
 void BulkProcessor::SaveCache() {
-    // Create a copy of results to avoid holding lock during file I/O
-    std::map<std::string, BulkResult> results_copy;
-    int total, processed, successful, failed, skipped;
+    // Copy where the results are to avoid holding the lock during file I/O
+    std::map<std::string, StoredResult> results_copy;
+    std::uint64_t logged;
+    int total, processed, successful, failed, skipped, duplicates;
 
     {
         std::lock_guard<std::mutex> lock(cache_mutex_);
         results_copy = results_cache_;
+        logged = results_log_.size();
         total = stats_.total_files.load();
         processed = stats_.processed.load();
         successful = stats_.successful.load();
         failed = stats_.failed.load();
         skipped = stats_.skipped.load();
+        duplicates = stats_.duplicates.load();
     } // Lock released here
 
-    std::ofstream out_file(output_json_path_);
+    // Written aside and renamed over the output, so a crash never leaves it half-written
+    std::string temp_path = output_json_path_ + ".tmp";
+    std::ofstream out_file(temp_path);
     if (!out_file.is_open()) {
-        std::cerr << "Failed to open output file: " << output_json_path_ << std::endl;
+        std::cerr << "Failed to open output file: " << temp_path << std::endl;
         return;
     }
-
     out_file << "{\n  \"results\": [\n";
 
+    // Streamed from the log and the previous output, one result in memory at a time
     bool first = true;
+    int unreadable = 0;
     for (const auto& pair : results_copy) {
+        BulkResult result;
+        if (!ReadResult(pair.second, &result)) {
+            unreadable++;
+            continue;
+        }
         if (!first) {
             out_file << ",\n";
         }
         first = false;
 
-        const BulkResult& result = pair.second;
         out_file << "    {\n";
-        out_file << "      \"file\": \"" << result.file_path << "\",\n";
+        out_file << "      \"file\": \"" << JsonEscape(result.file_path) << "\",\n";
         out_file << "      \"success\": " << (result.success ? "true" : "false") << ",\n";
 
         if (!result.ip_address.empty()) {
-            out_file << "      \"ip\": \"" << result.ip_address << "\",\n";
+            out_file << "      \"ip\": \"" << JsonEscape(result.ip_address) << "\",\n";
+        }
+        if (!result.duplicate_of.empty()) {
+            out_file << "      \"duplicate_of\": \"" << JsonEscape(result.duplicate_of) << "\",\n";
         }
 
         if (result.success) {
             out_file << "      \"response\": " << result.json_response << "\n";
         } else {
-            out_file << "      \"error\": \"" << result.error_message << "\"\n";
+            out_file << "      \"error\": \"" << JsonEscape(result.error_message) << "\"\n";
         }
 
         out_file << "    }";
@@ -302,21 +608,126 @@ void BulkProcessor::SaveCache() {
     out_file << "    \"processed\": " << processed << ",\n";
     out_file << "    \"successful\": " << successful << ",\n";
     out_file << "    \"failed\": " << failed << ",\n";
-    out_file << "    \"skipped\": " << skipped << "\n";
+    out_file << "    \"skipped\": " << skipped << ",\n";
+    out_file << "    \"duplicates\": " << duplicates << "\n";
     out_file << "  }\n";
     out_file << "}\n";
 
     out_file.close();
+    if (out_file.fail() || rename(temp_path.c_str(), output_json_path_.c_str()) != 0) {
+        std::cerr << "Failed to write output file: " << output_json_path_ << std::endl;
+        return;
+    }
+    if (unreadable > 0) {
+        std::cerr << "Failed to read back " << unreadable << " result(s), they are kept in "
+                  << results_log_path_ << " for --resume" << std::endl;
+    }
+    if (!SaveResumeIndex(results_copy)) {
+        std::cerr << "Failed to write resume index: " << resume_index_path_ << std::endl;
+        return;
+    }
+    // Everything logged up to the copy is in the output now, after which the log is redundant
+    // unless more came in since
+    bool log_complete = results_log_.Close();
+    if (log_complete && unreadable == 0 && results_log_.size() == logged) {
+        unlink(results_log_path_.c_str());
+    }
 }
 
-bool BulkProcessor::IsAlreadyProcessed(const std::string& file_path) {
-    std::lock_guard<std::mutex> lock(cache_mutex_);
-    return results_cache_.find(file_path) != results_cache_.end();
+bool BulkProcessor::SaveResumeIndex(const std::map<std::string, StoredResult>& results) {
+    std::vector<ResumeIndex::Record> records;
+    records.reserve(results.size());
+    for (const auto& pair : results) {
+        ResumeIndex::Record record;
+        record.path = pair.first;
+        record.identity = pair.second.identity;
+        record.success = pair.second.success;
+        if (!record.identity.known()) {
+            // loaded from the output, the previous index knows it
+            const ResumeIndex::Entry* entry = resume_index_.FindByPath(record.path);
+            if (entry) {
+                record.identity = entry->identity;
+            }
+        }
+        records.push_back(record);
+    }
+    return ResumeIndex::Write(resume_index_path_, records);
+}
+
+bool BulkProcessor::IsAlreadyProcessed(const ScannedFile& file) {
+    // The index doesn't change during a run, so this needs no lock
+    const ResumeIndex::Entry* entry = resume_index_.FindByPath(file.path);
+    if (entry) {
+        if (entry->identity.SameContentAs(file.identity)) {
+            if (entry->identity != file.identity) {
+                // remounted: the index takes the new numbers, so moves are found by them
+                std::lock_guard<std::mutex> lock(cache_mutex_);
+                auto found = results_cache_.find(file.path);
+                if (found != results_cache_.end()) {
+                    found->second.identity = file.identity;
+                }
+            }
+            return true;
+        }
+        // Modified since: it gets processed again, and its old result no longer counts
+        if (entry->success) {
+            stats_.successful--;
+        } else {
+            stats_.failed--;
+        }
+        return false;
+    }
+
+    entry = resume_index_.FindByIdentity(file.identity);
+    if (!entry) {
+        return false;
+    }
+    // Moved or renamed since, or another link to a processed file: its result still holds
+    std::string previous_path = resume_index_.PathOf(*entry);
+    BulkResult result;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        auto found = results_cache_.find(previous_path);
+        if (found == results_cache_.end() || !ReadResult(found->second, &result)) {
+            return false;
+        }
+        if (access(previous_path.c_str(), F_OK) == 0) {
+            // both paths keep a result
+            if (result.success) {
+                stats_.successful++;
+            } else {
+                stats_.failed++;
+            }
+        } else {
+            results_cache_.erase(found);
+        }
+    }
+    result.file_path = file.path;
+    result.identity = file.identity;
+    AddToCache(result);
+    return true;
 }
 
 void BulkProcessor::AddToCache(const BulkResult& result) {
+    std::string line = FormatResultLine(result);
     std::lock_guard<std::mutex> lock(cache_mutex_);
-    results_cache_[result.file_path] = result;
+    std::uint64_t offset = results_log_.Append(line);
+    results_cache_[result.file_path] = StoredOf(result, ResultSource::LOG, offset, line.size());
+}
+
+bool BulkProcessor::ReadResult(const StoredResult& stored, BulkResult* result) {
+    std::string block;
+    bool read = stored.source == ResultSource::LOG
+                    ? results_log_.Read(stored.offset, stored.length, &block)
+                    : output_fd_ >= 0 && ReadAt(output_fd_, stored.offset, stored.length, &block);
+    if (!read) {
+        return false;
+    }
+    *result = ParseResult(block);
+    if (!result->identity.known()) {
+        result->identity = stored.identity;  // not in the output JSON
+    }
+    return true;
 }
 
 bool IsValidJSON(const std::string& response) {
@@ -344,207 +755,469 @@ bool IsValidJSON(const std::string& response) {
     return true;
 }
 
-void BulkProcessor::ProcessFile(const std::string& file_path) {
+// A well-formed answer from Shazam that found nothing, as opposed to an error or a page from
+// something in between (captcha, proxy error)
+static bool IsNoMatchResponse(long status_code, const std::string& response) {
+    if (status_code < 200 || status_code >= 300) {
+        return false;
+    }
+    size_t first_char = response.find_first_not_of(" \t\r\n");
+    if (first_char == std::string::npos || response[first_char] != '{') {
+        return false;
+    }
+    return response.find("\"matches\"") != std::string::npos &&
+           response.find("<html") == std::string::npos &&
+           response.find("<!DOCTYPE") == std::string::npos &&
+           response.find("<!doctype") == std::string::npos;
+}
+
+Fingerprint* BulkProcessor::FingerprintFile(VibraContext* context, const ScannedFile& file) {
+    const std::string& file_path = file.path;
     BulkResult result;
     result.file_path = file_path;
-    Fingerprint* fingerprint = nullptr;
+    result.identity = file.identity;
+    result.success = false;
 
+    Fingerprint* fingerprint = nullptr;
     try {
-        // Check if we're in rate limit cooldown
-        {
-            std::lock_guard<std::mutex> rate_lock(rate_limit_mutex_);
-            if (rate_limited_.load()) {
-                auto now = std::chrono::steady_clock::now();
-                if (now < rate_limit_until_) {
-                    // Still in cooldown, skip this file for now
-                    result.success = false;
-                    result.error_message = "Skipped due to rate limiting";
-                    stats_.failed++;
-                    AddToCache(result);
-                    stats_.processed++;
-                    return;
-                }
-                // Cooldown expired, clear rate limit flag
-                rate_limited_ = false;
-            }
+        fingerprint = vibra_context_get_fingerprint_from_music_file(context, file_path.c_str());
+        if (!fingerprint) {
+            result.error_message = "Failed to generate fingerprint";
+        } else if (!Shazam::IsWorthQuerying(fingerprint)) {
+            // silent or near-empty clip, not worth a rate-limited request
+            vibra_free_fingerprint(fingerprint);
+            fingerprint = nullptr;
+            result.error_message = "Audio is silent or has too few peaks";
         }
+    } catch (const std::exception& e) {
+        result.error_message = e.what();
+    }
 
-        // Serialize recognition calls to avoid threading issues in vibra library
-        std::lock_guard<std::mutex> recog_lock(recognition_mutex_);
+    if (!fingerprint) {
+        stats_.failed++;
+        AddToCache(result);
+        stats_.processed++;
+    }
+    return fingerprint;
+}
 
-        // Generate fingerprint
-        fingerprint = vibra_get_fingerprint_from_music_file(file_path.c_str());
+bool BulkProcessor::SubmitRecognition(const PendingRecognition& pending) {
+    if (!AcquireRequestSlot()) {
+        vibra_free_fingerprint(pending.fingerprint);
+        return false;
+    }
 
-        if (!fingerprint) {
-            result.success = false;
-            result.error_message = "Failed to generate fingerprint";
-            stats_.failed++;
-        } else {
-            // Recognize with Shazam (use proxy if configured)
-            std::string proxy = GetCurrentProxy();
-            std::string response = Shazam::Recognize(fingerprint, proxy);
+    std::shared_ptr<InFlightRecognition> recognition = std::make_shared<InFlightRecognition>();
+    recognition->file_path = pending.file_path;
+    recognition->identity = pending.identity;
+    recognition->fingerprint = pending.fingerprint;
+    recognition->attempts = pending.attempts;
+    recognition->duplicate_group = pending.duplicate_group;
+    recognition->proxy = GetCurrentProxy();
+    recognition->proxy_generation = proxy_generation_.load();
+
+    // Known without a request of its own, refreshed in the background now and then
+    std::string ip = exit_ip_.Current(recognition->proxy);
+    recognition->ip_address = ip.empty() ? "unknown" : ip;
+
+    // Recognize with Shazam (use proxy if configured). The callback runs on the event loop
+    // thread, the result is handled off it.
+    Shazam::SubmitRecognition(recognition->fingerprint, recognition->proxy,
+                              [this, recognition](HttpResponse& response) {
+                                  if (!response.ok()) {
+                                      recognition->transport_error =
+                                          curl_easy_strerror(response.result);
+                                  }
+                                  recognition->response = std::move(response.body);
+                                  recognition->status_code = response.status_code;
+                                  recognition->retry_after_seconds = response.retry_after_seconds;
+                                  completion_queue_.Push(recognition);
+                              });
+    return true;
+}
 
-            // Fetch current IP address
-            result.ip_address = FetchCurrentIP();
+void BulkProcessor::FinishRecognition(InFlightRecognition& recognition) {
+    BulkResult result;
+    result.file_path = recognition.file_path;
+    result.identity = recognition.identity;
+    Fingerprint* fingerprint = recognition.fingerprint;
+    bool shareable = false; // the result holds for duplicates of the file
 
-            // Validate response
-            if (IsValidJSON(response)) {
-                result.success = true;
-                result.json_response = response;
-                stats_.successful++;
+    try {
+        const std::string& response = recognition.response;
+        result.ip_address = recognition.ip_address;
+
+        // Validate response
+        if (IsValidJSON(response)) {
+            result.success = true;
+            result.json_response = response;
+            stats_.successful++;
+            shareable = true;
+
+            // Reset rate limit counter on success
+            rate_limit_retry_count_ = 0;
+            rate_limiter_->OnSuccess();
+        } else if (recognition.status_code == 429 ||
+                   response.find("429") != std::string::npos ||
+                   response.find("Too Many Requests") != std::string::npos) {
+            // If proxy rotation is configured, try rotating to a new proxy
+            if (!proxy_config_.rotation_url.empty()) {
+                // requests sent before the last rotation were throttled on the old IP
+                if (recognition.proxy_generation == proxy_generation_.load()) {
+                    {
+                        std::lock_guard<std::mutex> console_lock(console_mutex_);
+                        std::cout << "\n[!] RATE LIMITED (429) - Rotating to new proxy..." << std::endl;
+                    }
+
+                    // Rotate proxy will test and wait for working proxy with configured timeout
+                    RotateProxy(proxy_rotation_timeout_);
+                }
 
-                // Reset rate limit counter on success
-                rate_limit_retry_count_ = 0;
+                // Check if rotation succeeded
+                if (processing_complete_.load()) {
+                    result.success = false;
+                    result.error_message = "Failed to rotate to working proxy";
+                    stats_.failed++;
+                } else {
+                    // Successfully rotated, retry the same file with new proxy IP
+                    RequeueRecognition(recognition);
+                    return;
+                }
             } else {
-                // Check if it's a rate limit error
-                if (response.find("429") != std::string::npos ||
-                    response.find("Too Many Requests") != std::string::npos) {
-
-                    // If proxy rotation is configured, try rotating to a new proxy
-                    if (!proxy_config_.rotation_url.empty()) {
-                        {
-                            std::lock_guard<std::mutex> console_lock(console_mutex_);
-                            std::cout << "\n[!] RATE LIMITED (429) - Rotating to new proxy..." << std::endl;
-                        }
-
-                        // Rotate proxy will test and wait for working proxy with configured timeout
-                        RotateProxy(proxy_rotation_timeout_);
-
-                        // Check if rotation succeeded
-                        if (processing_complete_.load()) {
-                            result.success = false;
-                            result.error_message = "Failed to rotate to working proxy";
-                            stats_.failed++;
-                        } else {
-                            // Successfully rotated, retry the same file with new proxy IP
-                            std::lock_guard<std::mutex> console_lock(console_mutex_);
-                            std::cout << "Retrying file with rotated proxy..." << std::endl;
-
-                            // Retry recognition with new proxy
-                            proxy = GetCurrentProxy();
-                            response = Shazam::Recognize(fingerprint, proxy);
-                            result.ip_address = FetchCurrentIP();
-
-                            // Validate retry response
-                            if (IsValidJSON(response)) {
-                                result.success = true;
-                                result.json_response = response;
-                                stats_.successful++;
-                                rate_limit_retry_count_ = 0;
-                            } else {
-                                // Still failed after rotation
-                                result.success = false;
-                                result.error_message = "Failed after proxy rotation";
-                                stats_.failed++;
-                            }
-                        }
+                // No proxy rotation - slow down and pause for as long as the server asks
+                int backoff_seconds[] = {30, 60, 120};  // Progressive delays without Retry-After
+                int retry_count = rate_limit_retry_count_.load();
+                double pause_seconds = recognition.retry_after_seconds > 0
+                                           ? recognition.retry_after_seconds
+                                           : backoff_seconds[std::min(retry_count, 2)];
+
+                // requests in flight together get throttled together, only the first backs off
+                if (rate_limiter_->OnThrottled(pause_seconds)) {
+                    retry_count = rate_limit_retry_count_.fetch_add(1);
+                    std::lock_guard<std::mutex> console_lock(console_mutex_);
+                    if (retry_count < MAX_RATE_LIMIT_RETRIES) {
+                        std::cout << "\n[!] RATE LIMITED - Pausing all requests for "
+                                  << pause_seconds << " seconds, then " << std::setprecision(2)
+                                  << rate_limiter_->rate() << " req/s (attempt "
+                                  << (retry_count + 1) << "/" << MAX_RATE_LIMIT_RETRIES << ")..."
+                                  << std::endl;
                     } else {
-                        // No proxy rotation - use standard backoff
-                        std::lock_guard<std::mutex> rate_lock(rate_limit_mutex_);
-
-                        int retry_count = rate_limit_retry_count_.fetch_add(1);
-                        int backoff_seconds[] = {30, 60, 120};  // Progressive delays
-
-                        if (retry_count < 3) {
-                            int wait_time = backoff_seconds[retry_count];
-                            rate_limited_ = true;
-                            rate_limit_until_ = std::chrono::steady_clock::now() +
-                                               std::chrono::seconds(wait_time);
-
-                            {
-                                std::lock_guard<std::mutex> console_lock(console_mutex_);
-                                std::cout << "\n[!] RATE LIMITED - Pausing all threads for "
-                                         << wait_time << " seconds (attempt " << (retry_count + 1)
-                                         << "/3)..." << std::endl;
-                            }
-
-                            result.success = false;
-                            result.error_message = "Rate limited - will retry";
-                            stats_.failed++;
-                        } else {
-                            // Max retries exceeded
-                            {
-                                std::lock_guard<std::mutex> console_lock(console_mutex_);
-                                std::cout << "\n[X] MAX RATE LIMIT RETRIES EXCEEDED - Stopping processing"
-                                         << std::endl;
-                            }
-                            processing_complete_ = true;  // Signal threads to stop
-                            result.success = false;
-                            result.error_message = "Rate limit exceeded - max retries reached";
-                            stats_.failed++;
-                        }
+                        // Max retries exceeded
+                        std::cout << "\n[X] MAX RATE LIMIT RETRIES EXCEEDED - Stopping processing"
+                                  << std::endl;
+                        StopProcessing();  // Signal threads to stop
                     }
-                } else {
+                }
+
+                if (processing_complete_.load()) {
                     result.success = false;
-                    result.error_message = "Invalid response from Shazam";
+                    result.error_message = "Rate limit exceeded - max retries reached";
                     stats_.failed++;
+                } else {
+                    // try again once the pause is over
+                    RequeueRecognition(recognition);
+                    return;
                 }
             }
-        }
-
-        // Free fingerprint while still holding lock
-        if (fingerprint) {
-            vibra_free_fingerprint(fingerprint);
-            fingerprint = nullptr;
+        } else if (!recognition.transport_error.empty() || recognition.status_code >= 500 ||
+                   recognition.status_code == 408) {
+            // timeouts, dropped connections and server errors tend to clear up by themselves
+            if (ScheduleRetry(recognition)) {
+                return;
+            }
+            std::string reason = !recognition.transport_error.empty()
+                                     ? recognition.transport_error
+                                     : "HTTP " + std::to_string(recognition.status_code);
+            result.success = false;
+            result.error_message = "Request failed after " +
+                                   std::to_string(recognition.attempts + 1) + " attempt(s): " +
+                                   reason;
+            stats_.failed++;
+        } else {
+            result.success = false;
+            result.error_message = "Invalid response from Shazam";
+            stats_.failed++;
+            // no match, which the same audio won't find either; anything else may not hit it
+            shareable = IsNoMatchResponse(recognition.status_code, response);
         }
     } catch (const std::exception& e) {
-        if (fingerprint) {
-            vibra_free_fingerprint(fingerprint);
-            fingerprint = nullptr;
-        }
         result.success = false;
         result.error_message = e.what();
         stats_.failed++;
     }
+    vibra_free_fingerprint(fingerprint);
 
     AddToCache(result);
     stats_.processed++;
+    if (recognition.duplicate_group >= 0) {
+        ResolveDuplicates(recognition.duplicate_group, result, shareable);
+    }
+}
+
+bool BulkProcessor::NeedsRequest(PendingRecognition& pending) {
+    size_t count = 0;
+    const unsigned int* landmarks = vibra_get_landmarks_from_fingerprint(pending.fingerprint, &count);
+    bool founded = false;
+    int group = duplicates_.Assign(landmarks, count, &founded);
+    if (group < 0) {
+        return true;  // too short to tell
+    }
 
-    // Apply delay after processing (helps avoid rate limiting)
-    if (delay_seconds_ > 0) {
-        std::this_thread::sleep_for(std::chrono::seconds(delay_seconds_));
+    std::string representative;
+    {
+        std::lock_guard<std::mutex> lock(duplicates_mutex_);
+        DuplicateGroup& duplicates = duplicate_groups_[group];
+        if (founded) {
+            duplicates.representative = pending.file_path;
+            pending.duplicate_group = group;
+            return true;
+        }
+        if (!duplicates.resolved) {
+            duplicates.waiting.push_back(pending);
+            return false;
+        }
+        if (!duplicates.shareable) {
+            return true;
+        }
+        representative = duplicates.representative;
     }
+    return !CopyDuplicateResult(pending, representative);
 }
 
-void BulkProcessor::WorkerThread() {
-    while (!processing_complete_.load()) {
-        // Check if we're in rate limit cooldown
-        if (rate_limited_.load()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
-            continue;
+void BulkProcessor::ResolveDuplicates(int group, const BulkResult& result, bool shareable) {
+    std::vector<PendingRecognition> waiting;
+    {
+        std::lock_guard<std::mutex> lock(duplicates_mutex_);
+        DuplicateGroup& duplicates = duplicate_groups_[group];
+        duplicates.resolved = true;
+        duplicates.shareable = shareable;
+        waiting.swap(duplicates.waiting);
+    }
+    for (const PendingRecognition& pending : waiting) {
+        if (!shareable || !CopyDuplicateResult(pending, result.file_path)) {
+            // e.g. the representative failed on a transient error, which needn't hit them
+            recognition_queue_.Requeue(pending);
         }
+    }
+}
 
-        std::string file_path;
+bool BulkProcessor::CopyDuplicateResult(const PendingRecognition& pending,
+                                        const std::string& representative) {
+    StoredResult stored;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        auto found = results_cache_.find(representative);
+        if (found == results_cache_.end()) {
+            return false;
+        }
+        stored = found->second;
+    }
+    // the log doesn't change where it was written, no need to hold the lock
+    BulkResult result;
+    if (!ReadResult(stored, &result)) {
+        return false;
+    }
+    result.file_path = pending.file_path;
+    result.identity = pending.identity;
+    result.duplicate_of = representative;
+    vibra_free_fingerprint(pending.fingerprint);
 
+    if (result.success) {
+        stats_.successful++;
+    } else {
+        stats_.failed++;
+    }
+    stats_.duplicates++;
+    AddToCache(result);
+    stats_.processed++;
+    return true;
+}
+
+void BulkProcessor::RequeueRecognition(const InFlightRecognition& recognition) {
+    PendingRecognition pending;
+    pending.file_path = recognition.file_path;
+    pending.identity = recognition.identity;
+    pending.fingerprint = recognition.fingerprint;
+    pending.duplicate_group = recognition.duplicate_group;
+    recognition_queue_.Requeue(pending);
+    stats_.requeued++;
+}
+
+bool BulkProcessor::ScheduleRetry(const InFlightRecognition& recognition) {
+    if (recognition.attempts >= MAX_TRANSIENT_RETRIES || processing_complete_.load()) {
+        return false;
+    }
+
+    // Exponential backoff, with jitter so files that failed together don't come back together
+    static thread_local std::mt19937 gen(std::random_device{}());
+    std::uniform_real_distribution<double> jitter(0.5, 1.0);
+    double backoff_seconds = std::min(RETRY_MAX_SECONDS,
+                                      RETRY_BASE_SECONDS * (1 << recognition.attempts)) *
+                             jitter(gen);
+
+    PendingRecognition pending;
+    pending.file_path = recognition.file_path;
+    pending.identity = recognition.identity;
+    pending.fingerprint = recognition.fingerprint;
+    pending.attempts = recognition.attempts + 1;
+    pending.duplicate_group = recognition.duplicate_group;
+    retry_queue_.Push(pending, std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                   std::chrono::duration<double>(backoff_seconds)));
+    stats_.retried++;
+    return true;
+}
+
+void BulkProcessor::FingerprintWorker(int index) {
+    // Each worker keeps its own decoder and FFT state for all of its files
+    VibraContext* context = vibra_create_context();
+
+    ScannedFile file;
+    for (;;) {
         {
-            std::lock_guard<std::mutex> lock(queue_mutex_);
-            if (next_file_index_ >= files_to_process_.size()) {
-                break; // No more files to process
+            // parked until auto mode needs this worker; once the scan has run dry it never will
+            std::unique_lock<std::mutex> lock(workers_mutex_);
+            while (index >= active_workers_ && !processing_complete_.load() &&
+                   !(scan_complete_.load() && scan_queue_.size() == 0)) {
+                workers_changed_.wait_for(lock, std::chrono::milliseconds(500));
+            }
+            if (index >= active_workers_) {
+                break;
             }
-            file_path = files_to_process_[next_file_index_++];
+        }
+        if (processing_complete_.load() || !scan_queue_.Pop(&file)) {
+            break;
         }
 
         // Check if already processed (for resume functionality)
-        if (resume_enabled_ && IsAlreadyProcessed(file_path)) {
+        if (resume_enabled_ && IsAlreadyProcessed(file)) {
             stats_.skipped++;
             stats_.processed++;
             continue;
         }
 
-        ProcessFile(file_path);
+        PendingRecognition pending;
+        pending.file_path = file.path;
+        pending.identity = file.identity;
+        pending.fingerprint = FingerprintFile(context, file);
+        if (!pending.fingerprint || (dedupe_enabled_ && !NeedsRequest(pending))) {
+            continue;
+        }
+        if (!recognition_queue_.Push(pending)) {
+            // the network stage was stopped
+            vibra_free_fingerprint(pending.fingerprint);
+            break;
+        }
     }
+
+    vibra_free_context(context);
 }
 
-void BulkProcessor::AutoSaveThread() {
-    int last_processed = 0;
+void BulkProcessor::SubmissionWorker() {
+    for (;;) {
+        PendingRecognition pending;
+        while (recognition_queue_.Pop(&pending)) {
+            if (!SubmitRecognition(pending)) {
+                break;
+            }
+        }
+
+        // Let the requests still in flight finish; throttled ones come back into the queue
+        {
+            std::unique_lock<std::mutex> lock(slots_mutex_);
+            slots_changed_.wait(lock, [this] { return in_flight_ == 0; });
+        }
+        // a retry coming due enters recognition_queue_ before it leaves retry_queue_, so
+        // checking in this order can't miss it on the way
+        bool retries_waiting = retry_queue_.size() > 0;
+        if (processing_complete_.load() || (!retries_waiting && recognition_queue_.size() == 0)) {
+            break;
+        }
+        if (recognition_queue_.size() == 0) {
+            // only retries are left, give the next one time to come due
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+
+    retry_queue_.Close();
+    for (PendingRecognition& pending : retry_queue_.Drain()) {
+        vibra_free_fingerprint(pending.fingerprint);
+    }
+    for (PendingRecognition& pending : recognition_queue_.Drain()) {
+        vibra_free_fingerprint(pending.fingerprint);
+    }
+    completion_queue_.Close();
+}
+
+void BulkProcessor::CompletionWorker() {
+    std::shared_ptr<InFlightRecognition> recognition;
+    while (completion_queue_.Pop(&recognition)) {
+        FinishRecognition(*recognition);
+        ReleaseRequestSlot();
+    }
+}
+
+void BulkProcessor::ScaleFingerprintWorkers(int max_workers) {
+    const size_t backlog = RECOGNITION_QUEUE_CAPACITY * 3 / 4;
     while (!processing_complete_.load()) {
-        std::this_thread::sleep_for(std::chrono::seconds(5));
+        std::this_thread::sleep_for(std::chrono::milliseconds(WORKER_SCALING_INTERVAL_MS));
+
+        size_t fingerprinted = recognition_queue_.size();
+        bool files_waiting = scan_queue_.size() > 0;
+        std::lock_guard<std::mutex> lock(workers_mutex_);
+        if (fingerprinted == 0 && files_waiting && active_workers_ < max_workers) {
+            // requests could go out but there is nothing to send: fingerprinting is too slow
+            active_workers_++;
+        } else if (fingerprinted >= backlog && active_workers_ > 1) {
+            // the network stage can't keep up, a core is better left to the others
+            active_workers_--;
+        } else {
+            continue;
+        }
+        workers_changed_.notify_all();
+    }
+}
+
+void BulkProcessor::RetryWorker() {
+    while (retry_queue_.MoveDue(recognition_queue_)) {
+    }
+}
 
-        int current_processed = stats_.processed.load();
-        if (current_processed > last_processed) {
-            SaveCache();
-            last_processed = current_processed;
+bool BulkProcessor::AcquireRequestSlot() {
+    {
+        std::unique_lock<std::mutex> lock(slots_mutex_);
+        // the window shrinks on throttling, wait_for also polls processing_complete_
+        while (in_flight_ >= static_cast<int>(std::min<size_t>(num_threads_,
+                                                               rate_limiter_->concurrency()))) {
+            if (processing_complete_.load()) {
+                return false;
+            }
+            slots_changed_.wait_for(lock, std::chrono::milliseconds(500));
         }
+        in_flight_++;
+    }
+
+    if (!rate_limiter_->Acquire(processing_complete_)) {
+        ReleaseRequestSlot();
+        return false;
+    }
+    return true;
+}
+
+void BulkProcessor::ReleaseRequestSlot() {
+    {
+        std::lock_guard<std::mutex> lock(slots_mutex_);
+        in_flight_--;
+    }
+    slots_changed_.notify_all();
+}
+
+void BulkProcessor::StopProcessing() {
+    processing_complete_ = true;
+    scan_queue_.Close();
+    retry_queue_.Close();
+    recognition_queue_.Close();
+    for (PendingRecognition& pending : recognition_queue_.Drain()) {
+        vibra_free_fingerprint(pending.fingerprint);
     }
 }
 
@@ -562,16 +1235,19 @@ void BulkProcessor::DisplayProgress() {
 
             std::cout << "\r[";
             int bar_width = 40;
-            int pos = bar_width * processed / total;
+            int pos = total > 0 ? bar_width * processed / total : 0;
             for (int i = 0; i < bar_width; ++i) {
                 if (i < pos) std::cout << "=";
                 else if (i == pos) std::cout << ">";
                 else std::cout << " ";
             }
             std::cout << "] " << std::fixed << std::setprecision(1) << percentage << "% ";
-            std::cout << "(" << processed << "/" << total << ") ";
+            // the total is a lower bound until the scan is done
+            std::cout << "(" << processed << "/" << total << (scan_complete_.load() ? "" : "+")
+                      << ") ";
             std::cout << "OK:" << successful << " FAIL:" << failed;
             if (skipped > 0) std::cout << " SKIP:" << skipped;
+            std::cout << " " << std::setprecision(2) << rate_limiter_->rate() << " req/s";
             std::cout << std::flush;
         }
 
@@ -590,6 +1266,21 @@ void BulkProcessor::PrintFinalReport() {
     if (stats_.skipped.load() > 0) {
         std::cout << "Skipped (cached):  " << stats_.skipped.load() << std::endl;
     }
+    if (stats_.requeued.load() > 0) {
+        std::cout << "Retried (429):     " << stats_.requeued.load() << std::endl;
+    }
+    if (stats_.retried.load() > 0) {
+        std::cout << "Retried (errors):  " << stats_.retried.load() << std::endl;
+    }
+    int duplicates = stats_.duplicates.load();
+    if (duplicates > 0) {
+        // each one a request saved, out of about one per file processed this run
+        int processed = stats_.processed.load() - stats_.skipped.load();
+        std::cout << "Duplicates:        " << duplicates << " (" << std::fixed
+                  << std::setprecision(1)
+                  << (processed > 0 ? duplicates * 100.0 / processed : 0.0)
+                  << "% of requests saved)" << std::endl;
+    }
     std::cout << "Results saved to:  " << output_json_path_ << std::endl;
     std::cout << std::string(60, '=') << std::endl;
 }
@@ -598,44 +1289,95 @@ void BulkProcessor::Process() {
     auto start_time = std::chrono::steady_clock::now();
 
     std::cout << "Scanning directory: " << directory_path_ << std::endl;
-    files_to_process_ = ScanDirectory();
-    stats_.total_files = files_to_process_.size();
-
-    if (files_to_process_.empty()) {
-        std::cout << "No supported audio files found in directory." << std::endl;
-        return;
+    if (file_order_ == FileOrder::PATH) {
+        std::cout << "Sorting by path - processing starts once the scan is done" << std::endl;
+    } else if (file_order_ == FileOrder::LONGEST_FIRST) {
+        std::cout << "Longest files first - processing starts once the scan is done" << std::endl;
     }
-
-    std::cout << "Found " << files_to_process_.size() << " audio files" << std::endl;
-    std::cout << "Processing with " << num_threads_ << " thread(s)..." << std::endl;
+    // Auto mode starts small and grows up to one worker per core
+    bool auto_workers = fingerprint_workers_ <= 0;
+    int max_workers = auto_workers ? DefaultFingerprintWorkers() : fingerprint_workers_;
+    active_workers_ = auto_workers ? std::min(max_workers, 2) : max_workers;
+
+    std::cout << "Processing with ";
+    if (auto_workers) {
+        std::cout << "up to " << max_workers << " fingerprinting thread(s) (auto)";
+    } else {
+        std::cout << max_workers << " fingerprinting thread(s)";
+    }
+    std::cout << " and up to " << num_threads_ << " concurrent request(s)..." << std::endl;
     if (resume_enabled_) {
         std::cout << "Resume mode enabled - skipping already processed files" << std::endl;
     }
+    if (dedupe_enabled_) {
+        std::cout << "Duplicate detection enabled - the same audio is recognized once" << std::endl;
+    }
     std::cout << std::endl;
 
-    // Start worker threads
-    std::vector<std::thread> workers;
-    for (int i = 0; i < num_threads_; ++i) {
-        workers.emplace_back(&BulkProcessor::WorkerThread, this);
+    // --delay sets the starting pace, the limiter takes it from there
+    double initial_rate = delay_seconds_ > 0 ? static_cast<double>(num_threads_) / delay_seconds_
+                                             : MAX_REQUEST_RATE;
+    rate_limiter_.reset(new AdaptiveRateLimiter(initial_rate, MAX_REQUEST_RATE, num_threads_));
+
+    OpenResultsLog();
+
+    // Results record the exit IP, known from the proxy test or looked up once here rather
+    // than for every file
+    exit_ip_.Resolve(GetCurrentProxy());
+
+    // Files are processed while the scan is still finding more
+    std::thread scan_thread(&BulkProcessor::ScanDirectory, this);
+
+    // Start the fingerprinting and the recognition stage
+    std::vector<std::thread> fingerprint_workers;
+    for (int i = 0; i < max_workers; ++i) {
+        fingerprint_workers.emplace_back(&BulkProcessor::FingerprintWorker, this, i);
     }
+    std::thread submission_thread(&BulkProcessor::SubmissionWorker, this);
+    std::thread completion_thread(&BulkProcessor::CompletionWorker, this);
+    std::thread retry_thread(&BulkProcessor::RetryWorker, this);
 
     // Start progress display thread
     std::thread progress_thread(&BulkProcessor::DisplayProgress, this);
+    std::thread scaling_thread;
+    if (auto_workers) {
+        scaling_thread = std::thread(&BulkProcessor::ScaleFingerprintWorkers, this, max_workers);
+    }
 
-    // Start auto-save thread (saves every 5 seconds)
-    std::thread autosave_thread(&BulkProcessor::AutoSaveThread, this);
-
-    // Wait for all workers to complete
-    for (auto& worker : workers) {
+    // Wait for all workers to complete; the recognition stage drains what is left once the
+    // fingerprinting stage is done
+    scan_thread.join();
+    for (auto& worker : fingerprint_workers) {
         worker.join();
     }
+    recognition_queue_.Close();
+    submission_thread.join();
+    completion_thread.join();
+    retry_thread.join();
 
     // Stop background threads
     processing_complete_ = true;
     progress_thread.join();
-    autosave_thread.join();
+    if (scaling_thread.joinable()) {
+        scaling_thread.join();
+    }
+    // duplicates of files whose processing was cut short
+    for (auto& pair : duplicate_groups_) {
+        for (PendingRecognition& pending : pair.second.waiting) {
+            vibra_free_fingerprint(pending.fingerprint);
+        }
+    }
 
-    // Final save
+    if (stats_.total_files.load() == 0) {
+        std::cout << "\nNo supported audio files found in directory." << std::endl;
+        results_log_.Close();
+        if (!resume_enabled_) {
+            unlink(results_log_path_.c_str()); // the empty log of this run
+        }
+        return;
+    }
+
+    // Compact the results log into the output
     SaveCache();
 
     auto end_time = std::chrono::steady_clock::now();
@@ -662,18 +1404,16 @@ void BulkProcessor::RotateProxy(int timeout_seconds) {
     // Simple flow: always rotate on 429, no cooldown
     std::cout << "Rate limited - rotating proxy IP..." << std::endl;
 
-    // Get the current IP before rotation (may fail if proxy is slow/rate-limited)
-    std::cout << "Getting current IP before rotation..." << std::endl;
-    std::string old_ip = FetchCurrentIP();
-    if (old_ip == "unknown") {
-        std::cout << "Could not get IP (proxy may be slow), proceeding with rotation..." << std::endl;
-    } else {
+    // The IP before rotation, as last looked up
+    std::string old_ip = exit_ip_.Current(current_proxy_);
+    if (!old_ip.empty()) {
         std::cout << "Current IP: " << old_ip << std::endl;
     }
 
     // Call the rotation URL to trigger IP rotation on the proxy service
     std::cout << "Calling rotation URL to rotate proxy IP..." << std::endl;
     FetchProxyFromURL(proxy_config_.rotation_url);
+    exit_ip_.Invalidate();
     std::cout << "IP rotation triggered" << std::endl;
 
     // Random wait between 5-10 seconds for rotation to take effect
@@ -698,7 +1438,7 @@ void BulkProcessor::RotateProxy(int timeout_seconds) {
 
         if (elapsed >= timeout_seconds) {
             std::cerr << "[X] Timeout (" << timeout_seconds << "s) - proxy never came back online" << std::endl;
-            processing_complete_ = true;
+            StopProcessing();
             return;
         }
 
@@ -708,11 +1448,13 @@ void BulkProcessor::RotateProxy(int timeout_seconds) {
         bool proxy_works = TestProxy(current_proxy_, 10);
 
         if (proxy_works) {
-            // Get new IP to show the change
-            std::string new_ip = FetchCurrentIP();
-            if (new_ip != "unknown" && old_ip != "unknown") {
+            proxy_generation_++;
+
+            // The test revealed the new IP
+            std::string new_ip = exit_ip_.Current(current_proxy_);
+            if (!new_ip.empty() && !old_ip.empty()) {
                 std::cout << "[OK] Proxy IP rotated: " << old_ip << " -> " << new_ip << std::endl;
-            } else if (new_ip != "unknown") {
+            } else if (!new_ip.empty()) {
                 std::cout << "[OK] Proxy is back online, new IP: " << new_ip << std::endl;
             } else {
                 std::cout << "[OK] Proxy is back online!" << std::endl;
@@ -726,36 +1468,17 @@ void BulkProcessor::RotateProxy(int timeout_seconds) {
 }
 
 std::string BulkProcessor::FetchProxyFromURL(const std::string& url) {
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        std::cerr << "Failed to initialize curl for proxy rotation" << std::endl;
-        return "";
-    }
-
-    std::string response;
-
-    // Callback function for curl
-    auto writeCallback = +[](void* contents, size_t size, size_t nmemb, void* userp) -> size_t {
-        std::string* buffer = reinterpret_cast<std::string*>(userp);
-        size_t realsize = size * nmemb;
-        buffer->append(reinterpret_cast<char*>(contents), realsize);
-        return realsize;
-    };
-
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L); // 10 second timeout
-
-    CURLcode res = curl_easy_perform(curl);
-
-    if (res != CURLE_OK) {
-        std::cerr << "Failed to fetch proxy from URL: " << curl_easy_strerror(res) << std::endl;
-        curl_easy_cleanup(curl);
+    HttpRequest request;
+    request.url = url;
+    request.timeout_seconds = 10; // 10 second timeout
+
+    HttpResponse fetched = HttpClient::Shared().Perform(request);
+    if (!fetched.ok()) {
+        std::cerr << "Failed to fetch proxy from URL: " << curl_easy_strerror(fetched.result)
+                  << std::endl;
         return "";
     }
-
-    curl_easy_cleanup(curl);
+    std::string response = fetched.body;
 
     // Trim whitespace from response
     response.erase(0, response.find_first_not_of(" \t\r\n"));
@@ -817,128 +1540,17 @@ bool BulkProcessor::TestProxy(const std::string& proxy, int timeout_seconds) {
         return true; // No proxy means direct connection, always "works"
     }
 
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        return false;
-    }
-
-    std::string response;
-
-    auto writeCallback = +[](void* contents, size_t size, size_t nmemb, void* userp) -> size_t {
-        std::string* buffer = reinterpret_cast<std::string*>(userp);
-        size_t realsize = size * nmemb;
-        buffer->append(reinterpret_cast<char*>(contents), realsize);
-        return realsize;
-    };
-
-    curl_easy_setopt(curl, CURLOPT_URL, "https://api.country.is");
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, (long)timeout_seconds);
-
-    // Parse and apply proxy
-    std::string proxy_str = proxy;
-    curl_proxytype proxy_type = CURLPROXY_HTTP;
-
-    if (proxy_str.find("socks5://") == 0) {
-        proxy_type = CURLPROXY_SOCKS5;
-        proxy_str = proxy_str.substr(9);
-    } else if (proxy_str.find("http://") == 0) {
-        proxy_str = proxy_str.substr(7);
-    }
-
-    std::string auth;
-    size_t at_pos = proxy_str.find('@');
-    if (at_pos != std::string::npos) {
-        auth = proxy_str.substr(0, at_pos);
-        proxy_str = proxy_str.substr(at_pos + 1);
-    }
-
-    curl_easy_setopt(curl, CURLOPT_PROXY, proxy_str.c_str());
-    curl_easy_setopt(curl, CURLOPT_PROXYTYPE, proxy_type);
-
-    if (!auth.empty()) {
-        curl_easy_setopt(curl, CURLOPT_PROXYUSERPWD, auth.c_str());
-    }
-
-    CURLcode res = curl_easy_perform(curl);
-
-    bool success = (res == CURLE_OK);
-
-    if (!success) {
-        std::cerr << "  Proxy test failed: " << curl_easy_strerror(res) << std::endl;
-    }
-
-    curl_easy_cleanup(curl);
-    return success;
-}
+    HttpRequest request;
+    request.url = "https://api.country.is";
+    request.timeout_seconds = timeout_seconds;
+    request.proxy = proxy;
 
-std::string BulkProcessor::FetchCurrentIP() {
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        return "unknown";
-    }
-
-    std::string response;
-    std::string proxy = GetCurrentProxy();
-
-    // Callback function for curl
-    auto writeCallback = +[](void* contents, size_t size, size_t nmemb, void* userp) -> size_t {
-        std::string* buffer = reinterpret_cast<std::string*>(userp);
-        size_t realsize = size * nmemb;
-        buffer->append(reinterpret_cast<char*>(contents), realsize);
-        return realsize;
-    };
-
-    curl_easy_setopt(curl, CURLOPT_URL, "https://api.country.is");
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L); // 10 second timeout
-
-    // Apply proxy if configured
-    if (!proxy.empty()) {
-        std::string proxy_str = proxy;
-        curl_proxytype proxy_type = CURLPROXY_HTTP;
-
-        if (proxy_str.find("socks5://") == 0) {
-            proxy_type = CURLPROXY_SOCKS5;
-            proxy_str = proxy_str.substr(9);
-        } else if (proxy_str.find("http://") == 0) {
-            proxy_str = proxy_str.substr(7);
-        }
-
-        std::string auth;
-        size_t at_pos = proxy_str.find('@');
-        if (at_pos != std::string::npos) {
-            auth = proxy_str.substr(0, at_pos);
-            proxy_str = proxy_str.substr(at_pos + 1);
-        }
-
-        curl_easy_setopt(curl, CURLOPT_PROXY, proxy_str.c_str());
-        curl_easy_setopt(curl, CURLOPT_PROXYTYPE, proxy_type);
-
-        if (!auth.empty()) {
-            curl_easy_setopt(curl, CURLOPT_PROXYUSERPWD, auth.c_str());
-        }
-    }
-
-    CURLcode res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-
-    if (res != CURLE_OK) {
-        return "unknown";
-    }
-
-    // Parse JSON response to extract IP
-    // Response format: {"ip":"1.2.3.4","country":"US"}
-    size_t ip_start = response.find("\"ip\":\"");
-    if (ip_start != std::string::npos) {
-        ip_start += 6; // Skip '{"ip":"'
-        size_t ip_end = response.find("\"", ip_start);
-        if (ip_end != std::string::npos) {
-            return response.substr(ip_start, ip_end - ip_start);
-        }
+    HttpResponse response = HttpClient::Shared().Perform(request);
+    if (!response.ok()) {
+        std::cerr << "  Proxy test failed: " << curl_easy_strerror(response.result) << std::endl;
+    } else {
+        // the test asks the exit IP lookup service, so it tells where requests leave from
+        exit_ip_.Record(proxy, Shazam::ParseExitIP(response.body));
     }
-
-    return "unknown";
+    return response.ok();
 }
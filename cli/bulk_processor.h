@@ -7,7 +7,24 @@
 #include <mutex>
 #include <atomic>
 #include <thread>
+#include <memory>
+#include <chrono>
+#include <condition_variable>
 #include <csignal>
+#include <cstdint>
+#include "communication/exit_ip_tracker.h"
+#include "utils/append_log.h"
+#include "utils/bounded_queue.h"
+#include "utils/directory_scanner.h"
+#include "utils/duplicate_index.h"
+#include "utils/rate_limiter.h"
+#include "utils/resume_index.h"
+#include "utils/retry_queue.h"
+
+// forward declaration
+struct Fingerprint;
+struct VibraContext;
+//
 
 struct BulkResult {
     std::string file_path;
@@ -15,6 +32,30 @@ struct BulkResult {
     bool success;
     std::string error_message;
     std::string ip_address;
+    FileIdentity identity; // unknown for results loaded from the output JSON
+    std::string duplicate_of; // the file whose result this one got, if it holds the same audio
+};
+
+// Where a result is kept
+enum class ResultSource {
+    OUTPUT,  // the output JSON being resumed
+    LOG,     // the results log
+};
+
+// A result as kept in memory: where to read it from, and what resuming needs of it without
+// reading it
+struct StoredResult {
+    ResultSource source = ResultSource::LOG;
+    std::uint32_t length = 0;
+    std::uint64_t offset = 0;
+    FileIdentity identity;
+    bool success = false;
+};
+
+// A file found by the directory scan
+struct ScannedFile {
+    std::string path;
+    FileIdentity identity;
 };
 
 struct ProxyConfig {
@@ -26,18 +67,62 @@ struct ProxyConfig {
     std::string rotation_url;  // URL to fetch new proxy from
 };
 
+// The order files are processed in
+enum class FileOrder {
+    DISCOVERY,      // as the directory scan finds them, starting right away
+    PATH,           // by path, once the scan is done
+    LONGEST_FIRST,  // by estimated duration, once the scan is done
+};
+
+// A fingerprinted file on its way from the CPU stage to the network stage
+struct PendingRecognition {
+    std::string file_path;
+    FileIdentity identity;
+    Fingerprint* fingerprint = nullptr;
+    int attempts = 0; // requests that failed on a transient error
+    int duplicate_group = -1; // set if its result goes to the duplicates found of it
+};
+
+// A recognition on the HttpEventLoop, handed to the completion thread once its request is done
+struct InFlightRecognition {
+    std::string file_path;
+    FileIdentity identity;
+    Fingerprint* fingerprint = nullptr;
+    int attempts = 0;
+    int duplicate_group = -1;
+    std::string proxy;
+    int proxy_generation = 0;
+    std::string response;
+    std::string transport_error; // empty if the request got a response
+    long status_code = 0;
+    long retry_after_seconds = 0;
+    std::string ip_address; // the exit address when the request was sent
+};
+
+// Files holding the same audio: the first one found is recognized, the others get its result
+struct DuplicateGroup {
+    std::string representative;
+    bool resolved = false;   // the representative has its result
+    bool shareable = false;  // and it holds for the others too
+    std::vector<PendingRecognition> waiting;  // found while the representative was under way
+};
+
 struct BulkStats {
     std::atomic<int> total_files{0};
     std::atomic<int> processed{0};
     std::atomic<int> successful{0};
     std::atomic<int> failed{0};
     std::atomic<int> skipped{0};
+    std::atomic<int> requeued{0}; // throttled requests sent again
+    std::atomic<int> retried{0};  // requests sent again after a transient error
+    std::atomic<int> duplicates{0};  // files that got the result of another holding the same audio
 };
 
 class BulkProcessor {
 public:
     BulkProcessor(const std::string& directory_path, const std::string& output_json_path,
                   int num_threads = 1, bool resume = false, int delay_seconds = 2);
+    ~BulkProcessor();
 
     // Main processing function
     void Process();
@@ -47,8 +132,20 @@ public:
     static BulkProcessor* current_instance_;
 
     // Configuration
+    // Recognition requests in flight at most
     void SetThreadCount(int threads) { num_threads_ = threads; }
+    // Fingerprinting threads; 0 for as many as the measured queue depths call for, up to one
+    // per core
+    void SetFingerprintWorkers(int workers) { fingerprint_workers_ = workers; }
     void EnableResume(bool enable) { resume_enabled_ = enable; }
+    // Anything but DISCOVERY waits for the whole tree to be scanned before processing starts
+    void SetFileOrder(FileOrder order) { file_order_ = order; }
+    // Seconds before the exit IP recorded with results is looked up again, 0 for only after a
+    // proxy rotation
+    void SetExitIPRefreshInterval(int seconds) { exit_ip_.SetRefreshInterval(seconds); }
+    // Files holding the same audio as one recognized before take its result instead of a
+    // request of their own
+    void SetDuplicateDetection(bool enable) { dedupe_enabled_ = enable; }
     void SetSupportedFormats(const std::vector<std::string>& formats);
     void SetProxyConfig(const ProxyConfig& config);
 
@@ -56,14 +153,25 @@ public:
     const BulkStats& GetStats() const { return stats_; }
 
 private:
-    // File discovery
-    std::vector<std::string> ScanDirectory();
+    // File discovery: runs on its own thread, feeding scan_queue_ as files are found (or all
+    // at once, in file_order_) and closing it when done
+    void ScanDirectory();
     bool IsSupportedFormat(const std::string& file_path);
 
-    // Cache management
+    // Cache management. Results live on disk: they go to an append-only JSON Lines log as they
+    // come in, and only a StoredResult of each is kept in memory. SaveCache compacts them into
+    // the output JSON once processing ends, reading one at a time, and LoadCache indexes both
+    // files without keeping what they hold. The resume index next to them records which file,
+    // by identity, each result is for.
     void LoadCache();
     void SaveCache();
-    bool IsAlreadyProcessed(const std::string& file_path);
+    void OpenResultsLog();
+    bool SaveResumeIndex(const std::map<std::string, StoredResult>& results);
+    // False if the result can't be read back
+    bool ReadResult(const StoredResult& stored, BulkResult* result);
+    // True if the file is unchanged since it was processed, or was processed under another
+    // path (its result is copied over then)
+    bool IsAlreadyProcessed(const ScannedFile& file);
     void AddToCache(const BulkResult& result);
 
     // Proxy management
@@ -71,50 +179,107 @@ private:
     void RotateProxy(int timeout_seconds = 60);
     std::string FetchProxyFromURL(const std::string& url);
 
-    // IP detection
-    std::string FetchCurrentIP();
-
-    // Proxy testing
+    // Proxy testing; a working proxy's exit IP is recorded on the way
     bool TestProxy(const std::string& proxy, int timeout_seconds = 10);
 
-    // Processing
-    void ProcessFile(const std::string& file_path);
-    void WorkerThread();
+    // Processing: a CPU stage fingerprints files into recognition_queue_, a network stage
+    // drains it, so each runs at its own pace. The network stage is one thread submitting
+    // requests to the HttpEventLoop and one thread handling their results.
+    Fingerprint* FingerprintFile(VibraContext* context, const ScannedFile& file);
+    // False once processing stopped, the fingerprint is freed then
+    bool SubmitRecognition(const PendingRecognition& pending);
+    void FinishRecognition(InFlightRecognition& recognition);
+    // False if the file holds the same audio as one fingerprinted before: it takes that one's
+    // result then, or waits for it
+    bool NeedsRequest(PendingRecognition& pending);
+    // Hands a representative's result to the duplicates waiting for it; if it doesn't hold for
+    // them, they are sent on their own
+    void ResolveDuplicates(int group, const BulkResult& result, bool shareable);
+    // False if the representative has no result to copy
+    bool CopyDuplicateResult(const PendingRecognition& pending, const std::string& representative);
+    // Hands a throttled file back to the submission thread, fingerprint and all
+    void RequeueRecognition(const InFlightRecognition& recognition);
+    // Sends a file that failed on a transient error again after a backoff; false once it has
+    // used up its attempts
+    bool ScheduleRetry(const InFlightRecognition& recognition);
+    // The worker with this index fingerprints while it is among the active_workers_ first
+    void FingerprintWorker(int index);
+    void SubmissionWorker();
+    void CompletionWorker();
+    // Moves retries into recognition_queue_ as they come due
+    void RetryWorker();
+    // Auto mode: adds a fingerprinting thread while the network stage waits for fingerprints,
+    // parks one while they pile up
+    void ScaleFingerprintWorkers(int max_workers);
+    // At most num_threads_ requests are in flight, fewer while rate_limiter_ shrinks its
+    // window, and each needs a token. Acquire returns false once processing stops.
+    bool AcquireRequestSlot();
+    void ReleaseRequestSlot();
+    // Ends the run early: stops both stages and frees queued fingerprints
+    void StopProcessing();
 
     // Progress display
     void DisplayProgress();
     void PrintFinalReport();
-    void AutoSaveThread();
 
     // Member variables
     std::string directory_path_;
     std::string output_json_path_;
+    std::string results_log_path_;
+    std::string resume_index_path_;
     int num_threads_;
+    int fingerprint_workers_;
     bool resume_enabled_;
     int delay_seconds_;
+    FileOrder file_order_;
+    bool dedupe_enabled_;
 
     std::vector<std::string> supported_formats_;
-    std::vector<std::string> files_to_process_;
-    std::map<std::string, BulkResult> results_cache_;
+    std::map<std::string, StoredResult> results_cache_;
+    AppendLog results_log_;
+    // the output JSON being resumed, opened by LoadCache; SaveCache replaces the file but this
+    // one stays readable
+    int output_fd_;
+    // opened by LoadCache, read-only from then on
+    ResumeIndex resume_index_;
 
     ProxyConfig proxy_config_;
     std::string current_proxy_;
     std::mutex proxy_mutex_;
     int proxy_rotation_timeout_;
+    ExitIPTracker exit_ip_;
+
+    DuplicateIndex duplicates_;
+    std::mutex duplicates_mutex_;
+    std::map<int, DuplicateGroup> duplicate_groups_;
 
     BulkStats stats_;
     std::mutex cache_mutex_;
-    std::mutex queue_mutex_;
     std::mutex console_mutex_;
-    std::mutex recognition_mutex_;  // Serialize recognition calls for thread safety
+    BoundedQueue<ScannedFile> scan_queue_;
+    BoundedQueue<PendingRecognition> recognition_queue_;
+    RetryQueue<PendingRecognition> retry_queue_;
+    // never full, the request slots bound it
+    BoundedQueue<std::shared_ptr<InFlightRecognition>> completion_queue_;
+
+    // Fingerprinting threads at work, the others are parked
+    std::mutex workers_mutex_;
+    std::condition_variable workers_changed_;
+    int active_workers_ = 0;
+
+    // Request slots
+    std::mutex slots_mutex_;
+    std::condition_variable slots_changed_;
+    int in_flight_ = 0;
 
     // Rate limiting state
-    std::atomic<bool> rate_limited_{false};
+    std::unique_ptr<AdaptiveRateLimiter> rate_limiter_;
     std::atomic<int> rate_limit_retry_count_{0};
-    std::chrono::steady_clock::time_point rate_limit_until_;
-    std::mutex rate_limit_mutex_;
+    // bumped by every proxy rotation
+    std::atomic<int> proxy_generation_{0};
 
-    size_t next_file_index_;
+    // total_files keeps growing until then
+    std::atomic<bool> scan_complete_{false};
     std::atomic<bool> processing_complete_{false};
 };
 
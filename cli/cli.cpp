@@ -1,11 +1,33 @@
 #include "../cli/cli.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <vector>
 #include <args.hxx>
 #include "communication/shazam.h"
 #include "bulk_processor.h"
 
+// Where bulk runs cache fingerprints unless told otherwise, empty if there is no home
+static std::string defaultCacheDirectory()
+{
+    const char *cache_home = std::getenv("XDG_CACHE_HOME");
+    if (cache_home && *cache_home)
+    {
+        return std::string(cache_home) + "/vibra/fingerprints";
+    }
+    const char *home = std::getenv("HOME");
+    if (home && *home)
+    {
+        return std::string(home) + "/.cache/vibra/fingerprints";
+    }
+    return std::string();
+}
+
 int CLI::Run(int argc, char **argv)
 {
     args::ArgumentParser parser("");
@@ -27,6 +49,8 @@ int CLI::Run(int argc, char **argv)
     args::Flag recognize(actions, "recognize", "Recognize a song", {'R', "recognize"});
     args::Flag bulk_recognize(actions, "bulk", "Bulk recognize all audio files in a directory",
                               {'B', "bulk"});
+    args::Flag print_duration(actions, "duration", "Print the duration of a file in seconds",
+                              {"duration"});
     args::HelpFlag help(actions, "help", "Display this help menu", {'h', "help"});
 
     args::Group sources(parser, "Sources:", args::Group::Validators::Xor);
@@ -52,14 +76,32 @@ int CLI::Run(int argc, char **argv)
                                              "Output JSON file path (default: results.json)",
                                              {'o', "output"});
     args::ValueFlag<int> threads(bulk_options, "threads",
-                                 "Number of parallel threads (default: 1)",
+                                 "Number of concurrent recognition requests (default: 1)",
                                  {'t', "threads"});
+    args::ValueFlag<std::string> workers(bulk_options, "workers",
+                                         "Number of fingerprinting threads, or auto to follow "
+                                         "the network stage (default: one per core)",
+                                         {"workers"});
     args::ValueFlag<int> delay(bulk_options, "delay",
-                               "Delay in seconds after each file (default: 2, helps avoid rate limiting)",
+                               "Initial seconds between requests per thread (default: 2)",
                                {'w', "delay"});
     args::Flag resume(bulk_options, "resume",
                      "Resume from previous run (skip already processed files)",
                      {"resume"});
+    args::Flag sort_files(bulk_options, "sort",
+                          "Process files in path order (waits for the directory scan to finish)",
+                          {"sort"});
+    args::Flag longest_first(bulk_options, "longest-first",
+                             "Process the longest files first, by estimated duration (waits for "
+                             "the directory scan to finish)",
+                             {"longest-first"});
+    args::ValueFlag<int> ip_refresh(bulk_options, "seconds",
+                                    "Seconds before the exit IP is looked up again (default: 300, "
+                                    "0: only after proxy rotation)",
+                                    {"ip-refresh"});
+    args::Flag no_dedupe(bulk_options, "no-dedupe",
+                         "Recognize every file, even those holding the same audio as another",
+                         {"no-dedupe"});
 
     args::Group proxy_options(parser, "Proxy options:");
     args::ValueFlag<std::string> proxy_host(proxy_options, "host",
@@ -103,6 +145,12 @@ int CLI::Run(int argc, char **argv)
     args::Flag unified_output(recognition_options, "unified",
                               "Output clean unified JSON format",
                               {"unified"});
+    args::ValueFlag<std::string> cache_dir(
+        recognition_options, "dir",
+        "Cache fingerprints in this directory (bulk default: ~/.cache/vibra/fingerprints)",
+        {"cache"});
+    args::Flag no_cache(recognition_options, "no-cache", "Don't cache fingerprints",
+                        {"no-cache"});
 
     try
     {
@@ -122,6 +170,21 @@ int CLI::Run(int argc, char **argv)
         return 1;
     }
 
+    // Unchanged files are then not decoded again by later runs
+    std::string fingerprint_cache_dir;
+    if (!no_cache)
+    {
+        fingerprint_cache_dir = cache_dir ? args::get(cache_dir)
+                                : bulk_recognize ? defaultCacheDirectory()
+                                                 : std::string();
+    }
+    if (!fingerprint_cache_dir.empty() &&
+        !vibra_set_fingerprint_cache(fingerprint_cache_dir.c_str()))
+    {
+        std::cerr << "Warning: cannot create fingerprint cache " << fingerprint_cache_dir
+                  << ", fingerprints are not cached" << std::endl;
+    }
+
     // Handle bulk recognition mode
     if (bulk_recognize)
     {
@@ -138,10 +201,41 @@ int CLI::Run(int argc, char **argv)
         bool enable_resume = resume;
 
         if (num_threads < 1) num_threads = 1;
-        if (num_threads > 16) num_threads = 16; // Reasonable upper limit
         if (delay_seconds < 0) delay_seconds = 0;
 
         BulkProcessor processor(dir_path, json_path, num_threads, enable_resume, delay_seconds);
+        if (workers)
+        {
+            // 0 asks for auto mode
+            std::string value = args::get(workers);
+            long count = 0;
+            if (value != "auto")
+            {
+                // digits only, all of them: "4x" or "1e3" are mistakes, not 4 or 1
+                char *end = nullptr;
+                errno = 0;
+                count = std::strtol(value.c_str(), &end, 10);
+                if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0])) ||
+                    *end != '\0' || errno == ERANGE || count < 1 || count > INT_MAX)
+                {
+                    count = -1;
+                }
+            }
+            if (count < 0)
+            {
+                std::cerr << "Error: --workers takes a positive number or auto" << std::endl;
+                return 1;
+            }
+            processor.SetFingerprintWorkers(static_cast<int>(count));
+        }
+        processor.SetFileOrder(longest_first ? FileOrder::LONGEST_FIRST
+                               : sort_files  ? FileOrder::PATH
+                                             : FileOrder::DISCOVERY);
+        if (ip_refresh)
+        {
+            processor.SetExitIPRefreshInterval(std::max(0, args::get(ip_refresh)));
+        }
+        processor.SetDuplicateDetection(!no_dedupe);
 
         // Configure proxy if provided
         if (proxy_host || proxy_rotation_url)
@@ -185,6 +279,24 @@ int CLI::Run(int argc, char **argv)
         return 0;
     }
 
+    if (print_duration)
+    {
+        if (!music_file)
+        {
+            std::cerr << "Error: --file/-f is required for --duration" << std::endl;
+            return 1;
+        }
+        double duration = vibra_get_duration(args::get(music_file).c_str());
+        if (duration <= 0.0)
+        {
+            std::cerr << "Error: cannot read the duration of " << args::get(music_file)
+                      << std::endl;
+            return 1;
+        }
+        std::cout << std::fixed << std::setprecision(3) << duration << std::endl;
+        return 0;
+    }
+
     // Handle single file recognition mode
     Fingerprint *fingerprint = nullptr;
     std::vector<Fingerprint*> fingerprints;  // For precise mode
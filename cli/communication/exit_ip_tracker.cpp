@@ -0,0 +1,99 @@
+#include "communication/exit_ip_tracker.h"
+#include "communication/shazam.h"
+
+// Until the first lookup succeeds, a failed one is retried after this long
+constexpr int EXIT_IP_RETRY_SECONDS = 30;
+
+ExitIPTracker::ExitIPTracker(int refresh_seconds)
+    : state_(std::make_shared<State>()), refresh_seconds_(refresh_seconds)
+{
+}
+
+void ExitIPTracker::SetRefreshInterval(int refresh_seconds)
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    refresh_seconds_ = refresh_seconds;
+}
+
+std::string ExitIPTracker::Current(const std::string &proxy)
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (state_->looking_up || !stale(proxy, now))
+    {
+        return state_->ip;
+    }
+
+    if (state_->proxy != proxy)
+    {
+        state_->ip.clear();
+        state_->proxy = proxy;
+    }
+    state_->valid = true;
+    state_->looking_up = true;
+    state_->checked = now;
+    int epoch = ++state_->epoch;
+    std::shared_ptr<State> state = state_;
+    Shazam::SubmitExitIPLookup(proxy, [state, epoch](const std::string &ip) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->epoch != epoch)
+        {
+            return;
+        }
+        state->looking_up = false;
+        // a failed lookup keeps the last known address
+        if (!ip.empty())
+        {
+            state->ip = ip;
+        }
+    });
+    return state_->ip;
+}
+
+std::string ExitIPTracker::Resolve(const std::string &proxy)
+{
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (!stale(proxy, std::chrono::steady_clock::now()) && !state_->ip.empty())
+        {
+            return state_->ip;
+        }
+    }
+    std::string ip = Shazam::FetchExitIP(proxy);
+    Record(proxy, ip);
+    return ip;
+}
+
+void ExitIPTracker::Record(const std::string &proxy, const std::string &ip)
+{
+    if (ip.empty())
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->epoch++;
+    state_->proxy = proxy;
+    state_->ip = ip;
+    state_->valid = true;
+    state_->looking_up = false;
+    state_->checked = std::chrono::steady_clock::now();
+}
+
+void ExitIPTracker::Invalidate()
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->epoch++;
+    state_->ip.clear();
+    state_->valid = false;
+    state_->looking_up = false;
+}
+
+bool ExitIPTracker::stale(const std::string &proxy, std::chrono::steady_clock::time_point now) const
+{
+    if (!state_->valid || state_->proxy != proxy)
+    {
+        return true;
+    }
+    int max_age = state_->ip.empty() ? EXIT_IP_RETRY_SECONDS : refresh_seconds_;
+    return max_age > 0 && now - state_->checked >= std::chrono::seconds(max_age);
+}
@@ -0,0 +1,54 @@
+#ifndef CLI_COMMUNICATION_EXIT_IP_TRACKER_H_
+#define CLI_COMMUNICATION_EXIT_IP_TRACKER_H_
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Knows the address requests leave from, so results can record it without a lookup of their
+// own. It is looked up once per proxy and again when the proxy rotates; the refresh interval
+// catches proxies that change their exit on their own. Lookups run in the background on the
+// HttpEventLoop, and callers get the last known address meanwhile.
+class ExitIPTracker
+{
+public:
+    // refresh_seconds: how old the address may get, 0 to only look it up again after a rotation
+    explicit ExitIPTracker(int refresh_seconds);
+
+    void SetRefreshInterval(int refresh_seconds);
+
+    // Thread-safe. The address requests through proxy leave from, empty until a lookup has
+    // succeeded. Starts a lookup when the known address is for another proxy, or is stale.
+    std::string Current(const std::string &proxy);
+    // Like Current(), but looks the address up and waits for it unless a fresh one is known;
+    // empty if the lookup failed
+    std::string Resolve(const std::string &proxy);
+    // Takes an address some other request revealed, e.g. a proxy test; an empty one is ignored
+    void Record(const std::string &proxy, const std::string &ip);
+    // Forgets the address, e.g. once the proxy has rotated, so the next Current() looks it up
+    void Invalidate();
+
+private:
+    // Shared with lookups still in flight, which may outlive the tracker
+    struct State
+    {
+        std::mutex mutex;
+        std::string proxy;
+        std::string ip;
+        std::chrono::steady_clock::time_point checked;
+        bool valid = false;
+        bool looking_up = false;
+        // bumped whenever the address is replaced or forgotten, so an older lookup can't
+        // overwrite it
+        int epoch = 0;
+    };
+
+    bool stale(const std::string &proxy, std::chrono::steady_clock::time_point now) const;
+
+private:
+    std::shared_ptr<State> state_;
+    int refresh_seconds_; // guarded by state_->mutex
+};
+
+#endif // CLI_COMMUNICATION_EXIT_IP_TRACKER_H_
@@ -0,0 +1,197 @@
+#include "communication/http_client.h"
+
+namespace
+{
+
+std::size_t appendToString(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    std::string *buffer = reinterpret_cast<std::string *>(userp);
+    std::size_t realsize = size * nmemb;
+    buffer->append(reinterpret_cast<char *>(contents), realsize);
+    return realsize;
+}
+
+// Cleans up the calling thread's handle when the thread exits
+struct ThreadHandle
+{
+    CURL *curl = nullptr;
+
+    ~ThreadHandle()
+    {
+        if (curl)
+        {
+            curl_easy_cleanup(curl);
+        }
+    }
+};
+
+thread_local ThreadHandle thread_handle;
+
+} // namespace
+
+HttpClient &HttpClient::Shared()
+{
+    static HttpClient client;
+    return client;
+}
+
+HttpClient::HttpClient() : share_(nullptr)
+{
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    share_ = curl_share_init();
+    curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, lockShare);
+    curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, unlockShare);
+    curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+
+HttpClient::~HttpClient()
+{
+    // the main thread's handle is gone by now, thread_local objects are destroyed first
+    curl_share_cleanup(share_);
+    curl_global_cleanup();
+}
+
+CURL *HttpClient::threadHandle()
+{
+    if (!thread_handle.curl)
+    {
+        thread_handle.curl = curl_easy_init();
+        if (thread_handle.curl)
+        {
+            curl_easy_setopt(thread_handle.curl, CURLOPT_SHARE, share_);
+        }
+    }
+    return thread_handle.curl;
+}
+
+void HttpClient::lockShare(CURL *, curl_lock_data data, curl_lock_access, void *client)
+{
+    static_cast<HttpClient *>(client)->share_locks_[data].lock();
+}
+
+void HttpClient::unlockShare(CURL *, curl_lock_data data, void *client)
+{
+    static_cast<HttpClient *>(client)->share_locks_[data].unlock();
+}
+
+void HttpClient::SetProxy(CURL *curl, const std::string &proxy)
+{
+    if (proxy.empty())
+    {
+        return;
+    }
+
+    std::string proxy_str = proxy;
+    curl_proxytype proxy_type = CURLPROXY_HTTP;
+
+    if (proxy_str.find("socks5://") == 0)
+    {
+        proxy_type = CURLPROXY_SOCKS5;
+        proxy_str = proxy_str.substr(9);
+    }
+    else if (proxy_str.find("http://") == 0)
+    {
+        proxy_str = proxy_str.substr(7);
+    }
+
+    std::string auth;
+    size_t at_pos = proxy_str.find('@');
+    if (at_pos != std::string::npos)
+    {
+        auth = proxy_str.substr(0, at_pos);
+        proxy_str = proxy_str.substr(at_pos + 1);
+    }
+
+    curl_easy_setopt(curl, CURLOPT_PROXY, proxy_str.c_str());
+    curl_easy_setopt(curl, CURLOPT_PROXYTYPE, proxy_type);
+
+    if (!auth.empty())
+    {
+        curl_easy_setopt(curl, CURLOPT_PROXYUSERPWD, auth.c_str());
+    }
+}
+
+curl_slist *HttpClient::Prepare(CURL *curl, const HttpRequest &request, std::string *body)
+{
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
+    struct curl_slist *headers = nullptr;
+    for (const std::string &header : request.headers)
+    {
+        headers = curl_slist_append(headers, header.c_str());
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, request.url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, appendToString);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, body);
+    if (headers)
+    {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    }
+    if (!request.post_fields.empty())
+    {
+        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request.post_fields.c_str());
+    }
+    if (!request.user_agent.empty())
+    {
+        curl_easy_setopt(curl, CURLOPT_USERAGENT, request.user_agent.c_str());
+    }
+    if (!request.accept_encoding.empty())
+    {
+        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, request.accept_encoding.c_str());
+    }
+    if (!request.ca_info.empty())
+    {
+        curl_easy_setopt(curl, CURLOPT_CAINFO, request.ca_info.c_str());
+    }
+    if (request.timeout_seconds > 0)
+    {
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, request.timeout_seconds);
+    }
+    if (request.follow_location)
+    {
+        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    }
+    if (request.http_1_1)
+    {
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+    }
+    SetProxy(curl, request.proxy);
+    return headers;
+}
+
+long HttpClient::RetryAfter(CURL *curl)
+{
+    curl_off_t retry_after = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after) != CURLE_OK)
+    {
+        return 0;
+    }
+    return static_cast<long>(retry_after);
+}
+
+HttpResponse HttpClient::Perform(const HttpRequest &request)
+{
+    HttpResponse response;
+    CURL *curl = threadHandle();
+    if (!curl)
+    {
+        response.result = CURLE_FAILED_INIT;
+        return response;
+    }
+
+    // drops the previous request's options; the share, open connections and caches stay
+    curl_easy_reset(curl);
+    struct curl_slist *headers = Prepare(curl, request, &response.body);
+
+    response.result = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status_code);
+    response.retry_after_seconds = RetryAfter(curl);
+
+    curl_slist_free_all(headers);
+    return response;
+}
@@ -0,0 +1,75 @@
+#ifndef CLI_COMMUNICATION_HTTP_CLIENT_H_
+#define CLI_COMMUNICATION_HTTP_CLIENT_H_
+
+#include <curl/curl.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct HttpRequest
+{
+    std::string url;
+    // [type://][user:pass@]host:port, empty for a direct connection
+    std::string proxy;
+    // Sent as a POST body when not empty
+    std::string post_fields;
+    std::vector<std::string> headers;
+    std::string user_agent;
+    std::string accept_encoding;
+    // CA bundle to verify the server against instead of the system one
+    std::string ca_info;
+    long timeout_seconds = 0; // 0: no limit
+    bool follow_location = false;
+    bool http_1_1 = false;
+};
+
+struct HttpResponse
+{
+    CURLcode result = CURLE_OK;
+    long status_code = 0;
+    // Retry-After of a 429 or 503, 0 without one
+    long retry_after_seconds = 0;
+    std::string body;
+
+    inline bool ok() const
+    {
+        return result == CURLE_OK;
+    }
+};
+
+// Process-wide HTTP client. Every thread gets one easy handle that lives as long as the thread,
+// and all of them share a DNS cache, TLS sessions and the connection pool, so repeated requests
+// to the same host skip the TCP and TLS handshakes (through the proxy as well).
+class HttpClient
+{
+public:
+    static HttpClient &Shared();
+
+    HttpClient(const HttpClient &) = delete;
+    HttpClient &operator=(const HttpClient &) = delete;
+
+    HttpResponse Perform(const HttpRequest &request);
+
+    // Applies a [type://][user:pass@]host:port proxy to the handle
+    static void SetProxy(CURL *curl, const std::string &proxy);
+    // Sets the request's options on a freshly reset handle, the response body goes to body.
+    // Returns the header list, to be freed once the transfer is done.
+    static curl_slist *Prepare(CURL *curl, const HttpRequest &request, std::string *body);
+    // Seconds from the finished transfer's Retry-After header, a delay or an HTTP date
+    static long RetryAfter(CURL *curl);
+
+private:
+    HttpClient();
+    ~HttpClient();
+
+    CURL *threadHandle();
+
+    static void lockShare(CURL *handle, curl_lock_data data, curl_lock_access access, void *client);
+    static void unlockShare(CURL *handle, curl_lock_data data, void *client);
+
+private:
+    CURLSH *share_;
+    std::mutex share_locks_[CURL_LOCK_DATA_LAST];
+};
+
+#endif // CLI_COMMUNICATION_HTTP_CLIENT_H_
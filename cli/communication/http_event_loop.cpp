@@ -0,0 +1,138 @@
+#include "communication/http_event_loop.h"
+
+constexpr int POLL_TIMEOUT_MS = 1000;
+
+HttpEventLoop &HttpEventLoop::Shared()
+{
+    static HttpEventLoop loop;
+    return loop;
+}
+
+HttpEventLoop::HttpEventLoop() : multi_(nullptr), stopping_(false)
+{
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    multi_ = curl_multi_init();
+    curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    thread_ = std::thread(&HttpEventLoop::run, this);
+}
+
+HttpEventLoop::~HttpEventLoop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    curl_multi_wakeup(multi_);
+    thread_.join();
+
+    for (CURL *easy : idle_handles_)
+    {
+        curl_easy_cleanup(easy);
+    }
+    curl_multi_cleanup(multi_);
+    curl_global_cleanup();
+}
+
+void HttpEventLoop::Submit(const HttpRequest &request, Callback callback)
+{
+    std::unique_ptr<Transfer> transfer(new Transfer());
+    transfer->request = request;
+    transfer->callback = std::move(callback);
+    transfer->headers = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        submitted_.push_back(std::move(transfer));
+    }
+    curl_multi_wakeup(multi_);
+}
+
+std::future<HttpResponse> HttpEventLoop::Submit(const HttpRequest &request)
+{
+    std::shared_ptr<std::promise<HttpResponse>> promise(new std::promise<HttpResponse>());
+    Submit(request, [promise](HttpResponse &response) { promise->set_value(std::move(response)); });
+    return promise->get_future();
+}
+
+HttpResponse HttpEventLoop::Perform(const HttpRequest &request)
+{
+    return Submit(request).get();
+}
+
+void HttpEventLoop::run()
+{
+    for (;;)
+    {
+        std::vector<std::unique_ptr<Transfer>> submitted;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            submitted.swap(submitted_);
+            if (stopping_ && submitted.empty() && running_.empty())
+            {
+                return;
+            }
+        }
+        for (std::unique_ptr<Transfer> &transfer : submitted)
+        {
+            start(std::move(transfer));
+        }
+
+        int still_running = 0;
+        curl_multi_perform(multi_, &still_running);
+
+        int messages_left = 0;
+        while (CURLMsg *message = curl_multi_info_read(multi_, &messages_left))
+        {
+            if (message->msg == CURLMSG_DONE)
+            {
+                finish(message->easy_handle, message->data.result);
+            }
+        }
+
+        // woken up early by socket activity, curl's timers and Submit()
+        curl_multi_poll(multi_, nullptr, 0, POLL_TIMEOUT_MS, nullptr);
+    }
+}
+
+void HttpEventLoop::start(std::unique_ptr<Transfer> transfer)
+{
+    CURL *easy = nullptr;
+    if (!idle_handles_.empty())
+    {
+        easy = idle_handles_.back();
+        idle_handles_.pop_back();
+        curl_easy_reset(easy);
+    }
+    else
+    {
+        easy = curl_easy_init();
+    }
+    if (!easy)
+    {
+        transfer->response.result = CURLE_FAILED_INIT;
+        transfer->callback(transfer->response);
+        return;
+    }
+
+    transfer->headers = HttpClient::Prepare(easy, transfer->request, &transfer->response.body);
+    // wait for a connection that can take one more stream rather than opening another
+    curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+    running_[easy] = std::move(transfer);
+    curl_multi_add_handle(multi_, easy);
+}
+
+void HttpEventLoop::finish(CURL *easy, CURLcode result)
+{
+    auto found = running_.find(easy);
+    std::unique_ptr<Transfer> transfer = std::move(found->second);
+    running_.erase(found);
+
+    curl_multi_remove_handle(multi_, easy);
+    transfer->response.result = result;
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &transfer->response.status_code);
+    transfer->response.retry_after_seconds = HttpClient::RetryAfter(easy);
+    curl_slist_free_all(transfer->headers);
+    // the connection stays in the multi handle's pool, the handle is kept for the next request
+    idle_handles_.push_back(easy);
+
+    transfer->callback(transfer->response);
+}
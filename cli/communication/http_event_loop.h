@@ -0,0 +1,63 @@
+#ifndef CLI_COMMUNICATION_HTTP_EVENT_LOOP_H_
+#define CLI_COMMUNICATION_HTTP_EVENT_LOOP_H_
+
+#include <curl/curl.h>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "communication/http_client.h"
+
+// Runs any number of requests concurrently on a single thread, driving a curl multi handle.
+// Requests to the same host share connections, and are multiplexed over one HTTP/2
+// connection where the server supports it (requests with http_1_1 set queue for a connection
+// instead). timeout_seconds limits each request on its own.
+class HttpEventLoop
+{
+public:
+    // Runs on the loop thread once the request is done; must not block or throw
+    using Callback = std::function<void(HttpResponse &response)>;
+
+    static HttpEventLoop &Shared();
+
+    HttpEventLoop();
+    HttpEventLoop(const HttpEventLoop &) = delete;
+    HttpEventLoop &operator=(const HttpEventLoop &) = delete;
+    // Finishes every submitted request, then stops the loop
+    ~HttpEventLoop();
+
+    // Thread-safe; the request is copied
+    void Submit(const HttpRequest &request, Callback callback);
+    std::future<HttpResponse> Submit(const HttpRequest &request);
+    // Submits and waits for the response
+    HttpResponse Perform(const HttpRequest &request);
+
+private:
+    struct Transfer
+    {
+        HttpRequest request;
+        Callback callback;
+        HttpResponse response;
+        curl_slist *headers;
+    };
+
+    void run();
+    void start(std::unique_ptr<Transfer> transfer);
+    void finish(CURL *easy, CURLcode result);
+
+private:
+    CURLM *multi_;
+    // loop thread only
+    std::map<CURL *, std::unique_ptr<Transfer>> running_;
+    std::vector<CURL *> idle_handles_;
+    // guarded by mutex_
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Transfer>> submitted_;
+    bool stopping_;
+    std::thread thread_;
+};
+
+#endif // CLI_COMMUNICATION_HTTP_EVENT_LOOP_H_
@@ -1,5 +1,4 @@
 #include "communication/shazam.h"
-#include <curl/curl.h>
 #include <algorithm>
 #include <random>
 #include <sstream>
@@ -15,6 +14,8 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #endif
+#include "communication/http_client.h"
+#include "communication/http_event_loop.h"
 #include "communication/timezones.h"
 #include "communication/user_agents.h"
 #include "utils/uuid4.h"
@@ -23,12 +24,28 @@
 // static variables initialization
 constexpr char Shazam::HOST[];
 
-std::size_t writeCallback(void *contents, size_t size, size_t nmemb, void *userp)
+// Below these a clip is silence, a fade or a click track and never matches
+constexpr double MIN_PEAK_DENSITY = 5.0; // peaks per second
+constexpr double MAX_SILENCE_RATIO = 0.9;
+
+// A tag request without url and body, the same for every segment of a recognition
+static HttpRequest tagRequest(const std::string &proxy, const std::string &user_agent)
 {
-    std::string *buffer = reinterpret_cast<std::string *>(userp);
-    std::size_t realsize = size * nmemb;
-    buffer->append(reinterpret_cast<char *>(contents), realsize);
-    return realsize;
+    HttpRequest request;
+    request.headers = {"Accept-Encoding: gzip, deflate, br", "Accept: */*",
+                       "Connection: keep-alive", "Content-Type: application/json",
+                       "Content-Language: en_US"};
+    request.accept_encoding = "gzip, deflate, br";
+    request.http_1_1 = true;
+    request.user_agent = user_agent;
+    request.proxy = proxy;
+    return request;
+}
+
+bool Shazam::IsWorthQuerying(Fingerprint *fingerprint)
+{
+    return vibra_get_peak_density_from_fingerprint(fingerprint) >= MIN_PEAK_DENSITY &&
+           vibra_get_silence_ratio_from_fingerprint(fingerprint) <= MAX_SILENCE_RATIO;
 }
 
 std::string Shazam::Recognize(const Fingerprint *fingerprint, const std::string& proxy)
@@ -37,81 +54,31 @@ std::string Shazam::Recognize(const Fingerprint *fingerprint, const std::string&
     auto user_agent = getUserAgent();
     std::string url = getShazamHost();
 
-    CURL *curl = curl_easy_init();
-    std::string read_buffer;
+    HttpRequest request = tagRequest(proxy, user_agent);
+    request.url = url;
+    request.post_fields = content;
 
-    if (curl)
+    HttpResponse response = HttpClient::Shared().Perform(request);
+    if (!response.ok())
     {
-        struct curl_slist *headers = nullptr;
-        headers = curl_slist_append(headers, "Accept-Encoding: gzip, deflate, br");
-        headers = curl_slist_append(headers, "Accept: */*");
-        headers = curl_slist_append(headers, "Connection: keep-alive");
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-        headers = curl_slist_append(headers, "Content-Language: en_US");
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_POST, 1L);
-        curl_easy_setopt(curl, CURLOPT_USERAGENT, user_agent.c_str());
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, content.c_str());
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &read_buffer);
-
-        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip, deflate, br");
-        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
-
-        // Configure proxy if provided
-        if (!proxy.empty())
-        {
-            // Parse proxy format: [type://][user:pass@]host:port
-            std::string proxy_str = proxy;
-            curl_proxytype proxy_type = CURLPROXY_HTTP;
-
-            // Detect proxy type from URL scheme
-            if (proxy_str.find("socks5://") == 0)
-            {
-                proxy_type = CURLPROXY_SOCKS5;
-                proxy_str = proxy_str.substr(9); // Remove "socks5://"
-            }
-            else if (proxy_str.find("http://") == 0)
-            {
-                proxy_str = proxy_str.substr(7); // Remove "http://"
-            }
-
-            // Extract authentication if present (user:pass@)
-            std::string auth;
-            size_t at_pos = proxy_str.find('@');
-            if (at_pos != std::string::npos)
-            {
-                auth = proxy_str.substr(0, at_pos);
-                proxy_str = proxy_str.substr(at_pos + 1);
-            }
-
-            // Set proxy options
-            curl_easy_setopt(curl, CURLOPT_PROXY, proxy_str.c_str());
-            curl_easy_setopt(curl, CURLOPT_PROXYTYPE, proxy_type);
-
-            if (!auth.empty())
-            {
-                curl_easy_setopt(curl, CURLOPT_PROXYUSERPWD, auth.c_str());
-            }
-        }
-
-        CURLcode res = curl_easy_perform(curl);
-        if (res != CURLE_OK)
-        {
-            std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(res) << std::endl;
-        }
-
-        std::int64_t http_code = 0;
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-        if (http_code != 200)
-        {
-            std::cerr << "HTTP code: " << http_code << std::endl;
-        }
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
+        std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(response.result)
+                  << std::endl;
     }
-    return read_buffer;
+    if (response.status_code != 200)
+    {
+        std::cerr << "HTTP code: " << response.status_code << std::endl;
+    }
+    return response.body;
+}
+
+void Shazam::SubmitRecognition(const Fingerprint *fingerprint, const std::string& proxy,
+                               std::function<void(HttpResponse& response)> callback)
+{
+    HttpRequest request = tagRequest(proxy, getUserAgent());
+    request.http_1_1 = false;
+    request.url = getShazamHost();
+    request.post_fields = getRequestContent(fingerprint->uri, fingerprint->sample_ms);
+    HttpEventLoop::Shared().Submit(request, std::move(callback));
 }
 
 std::string Shazam::getShazamHost()
@@ -171,60 +138,34 @@ std::string Shazam::getTimezone()
 
 std::string Shazam::FetchExitIP(const std::string& proxy)
 {
-    CURL *curl = curl_easy_init();
-    if (!curl)
-    {
-        return "";
-    }
-
-    std::string read_buffer;
-
-    curl_easy_setopt(curl, CURLOPT_URL, "https://api.country.is");
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &read_buffer);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
-
-    // Configure proxy if provided
-    if (!proxy.empty())
-    {
-        std::string proxy_str = proxy;
-        curl_proxytype proxy_type = CURLPROXY_HTTP;
-
-        if (proxy_str.find("socks5://") == 0)
-        {
-            proxy_type = CURLPROXY_SOCKS5;
-            proxy_str = proxy_str.substr(9);
-        }
-        else if (proxy_str.find("http://") == 0)
-        {
-            proxy_str = proxy_str.substr(7);
-        }
-
-        std::string auth;
-        size_t at_pos = proxy_str.find('@');
-        if (at_pos != std::string::npos)
-        {
-            auth = proxy_str.substr(0, at_pos);
-            proxy_str = proxy_str.substr(at_pos + 1);
-        }
-
-        curl_easy_setopt(curl, CURLOPT_PROXY, proxy_str.c_str());
-        curl_easy_setopt(curl, CURLOPT_PROXYTYPE, proxy_type);
+    HttpRequest request;
+    request.url = "https://api.country.is";
+    request.timeout_seconds = 10;
+    request.proxy = proxy;
 
-        if (!auth.empty())
-        {
-            curl_easy_setopt(curl, CURLOPT_PROXYUSERPWD, auth.c_str());
-        }
-    }
-
-    CURLcode res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-
-    if (res != CURLE_OK)
+    HttpResponse response = HttpClient::Shared().Perform(request);
+    if (!response.ok())
     {
         return "";
     }
+    return ParseExitIP(response.body);
+}
 
+void Shazam::SubmitExitIPLookup(const std::string& proxy,
+                                std::function<void(const std::string& ip)> callback)
+{
+    HttpRequest request;
+    request.url = "https://api.country.is";
+    request.timeout_seconds = 10;
+    request.proxy = proxy;
+
+    HttpEventLoop::Shared().Submit(request, [callback](HttpResponse &response) {
+        callback(response.ok() ? ParseExitIP(response.body) : "");
+    });
+}
+
+std::string Shazam::ParseExitIP(const std::string& read_buffer)
+{
     // Parse IP from response: {"ip":"x.x.x.x","country":"XX"}
     size_t ip_start = read_buffer.find("\"ip\":\"");
     if (ip_start != std::string::npos)
@@ -310,111 +251,84 @@ int Shazam::extractMatchCount(const std::string& response)
     return count;
 }
 
-std::string Shazam::RecognizeContinuous(const std::string& file_path, const std::string& proxy, int consecutive_required)
+Fingerprint *Shazam::nextContinuousSegment(const std::string &file_path, unsigned int duration,
+                                           unsigned int segment_duration, unsigned int *offset,
+                                           size_t *segment_index)
 {
-    std::vector<SegmentResult> results;
-
-    // Get duration
-    double duration = vibra_get_duration(file_path.c_str());
-    unsigned int segment_duration = 15;
-
-    // Create single CURL handle to reuse for all requests
-    CURL *curl = curl_easy_init();
-    if (!curl)
-    {
-        return "{\"error\":\"Failed to initialize CURL\"}";
-    }
-
-    // Setup headers once
-    struct curl_slist *headers = nullptr;
-    headers = curl_slist_append(headers, "Accept-Encoding: gzip, deflate, br");
-    headers = curl_slist_append(headers, "Accept: */*");
-    headers = curl_slist_append(headers, "Connection: keep-alive");
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    headers = curl_slist_append(headers, "Content-Language: en_US");
-
-    // Set common options
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip, deflate, br");
-    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-
-    // Configure proxy if provided
-    if (!proxy.empty())
+    for (; *offset + segment_duration <= duration; *offset += segment_duration)
     {
-        std::string proxy_str = proxy;
-        curl_proxytype proxy_type = CURLPROXY_HTTP;
-
-        if (proxy_str.find("socks5://") == 0)
+        // Generate fingerprint for this segment
+        Fingerprint *fp = vibra_get_fingerprint_from_offset(file_path.c_str(), *offset);
+        if (!fp)
         {
-            proxy_type = CURLPROXY_SOCKS5;
-            proxy_str = proxy_str.substr(9);
+            continue;
         }
-        else if (proxy_str.find("http://") == 0)
+        (*segment_index)++;
+        if (!IsWorthQuerying(fp))
         {
-            proxy_str = proxy_str.substr(7);
-        }
-
-        std::string auth;
-        size_t at_pos = proxy_str.find('@');
-        if (at_pos != std::string::npos)
-        {
-            auth = proxy_str.substr(0, at_pos);
-            proxy_str = proxy_str.substr(at_pos + 1);
+            std::cerr << "[Segment " << *segment_index << "] offset=" << fp->offset_ms
+                      << "ms: SKIPPED (silent)" << std::endl;
+            vibra_free_fingerprint(fp);
+            continue;
         }
+        *offset += segment_duration;
+        return fp;
+    }
+    return nullptr;
+}
 
-        curl_easy_setopt(curl, CURLOPT_PROXY, proxy_str.c_str());
-        curl_easy_setopt(curl, CURLOPT_PROXYTYPE, proxy_type);
+std::string Shazam::RecognizeContinuous(const std::string& file_path, const std::string& proxy, int consecutive_required)
+{
+    std::vector<SegmentResult> results;
 
-        if (!auth.empty())
-        {
-            curl_easy_setopt(curl, CURLOPT_PROXYUSERPWD, auth.c_str());
-        }
-    }
+    // Get duration
+    double duration = vibra_get_duration(file_path.c_str());
+    unsigned int segment_duration = 15;
 
-    // Get consistent user agent for all requests
-    auto user_agent = getUserAgent();
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, user_agent.c_str());
+    // Same user agent for all requests; they go out on one pooled connection
+    HttpRequest request = tagRequest(proxy, getUserAgent());
+    request.http_1_1 = false;
 
     // Process segments one at a time and stop on 3 consecutive matches
     std::map<std::string, std::vector<size_t>> track_hits; // track_id -> indices that matched
     int consecutive_count = 0;
     std::string consecutive_track_id;
+    unsigned int offset = 0;
+    size_t next_segment_index = 0;
     size_t segment_index = 0;
 
-    for (unsigned int offset = 0; offset + segment_duration <= static_cast<unsigned int>(duration); offset += segment_duration) {
-        // Generate fingerprint for this segment
-        Fingerprint* fp = vibra_get_fingerprint_from_offset(file_path.c_str(), offset);
-        if (!fp) {
-            continue;
-        }
+    Fingerprint* fp = nextContinuousSegment(file_path, static_cast<unsigned int>(duration),
+                                            segment_duration, &offset, &next_segment_index);
+    while (fp) {
+        segment_index = next_segment_index - 1;
+        request.url = getShazamHost();
+        request.post_fields = getRequestContent(fp->uri, fp->sample_ms);
+        std::future<HttpResponse> pending = HttpEventLoop::Shared().Submit(request);
 
-        std::string read_buffer;
-        std::string url = getShazamHost();
-        auto content = getRequestContent(fp->uri, fp->sample_ms);
+        SegmentResult result;
+        result.offset_ms = fp->offset_ms;
+
+        // Free fingerprint
+        vibra_free_fingerprint(fp);
 
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, content.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &read_buffer);
+        // The next segment is decoded while this one's request is in flight
+        fp = nextContinuousSegment(file_path, static_cast<unsigned int>(duration),
+                                   segment_duration, &offset, &next_segment_index);
 
-        CURLcode res = curl_easy_perform(curl);
-        if (res != CURLE_OK)
+        HttpResponse response = pending.get();
+        if (!response.ok())
         {
-            std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(res) << std::endl;
+            std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(response.result)
+                      << std::endl;
         }
+        const std::string& read_buffer = response.body;
 
-        SegmentResult result;
-        result.offset_ms = fp->offset_ms;
         result.response = read_buffer;
         result.track_id = extractTrackId(read_buffer);
         result.title = extractTitle(read_buffer);
         result.artist = extractArtist(read_buffer);
         result.match_count = extractMatchCount(read_buffer);
 
-        // Free fingerprint
-        vibra_free_fingerprint(fp);
-
         // Debug output for each segment
         std::cerr << "[Segment " << (segment_index + 1) << "] offset=" << result.offset_ms << "ms: ";
         if (!result.track_id.empty()) {
@@ -440,8 +354,9 @@ std::string Shazam::RecognizeContinuous(const std::string& file_path, const std:
 
             // Stop on consecutive_required consecutive matches
             if (consecutive_count >= consecutive_required) {
-                curl_slist_free_all(headers);
-                curl_easy_cleanup(curl);
+                if (fp) {
+                    vibra_free_fingerprint(fp);
+                }
 
                 std::string final_response = result.response;
                 size_t last_brace = final_response.rfind('}');
@@ -458,14 +373,8 @@ std::string Shazam::RecognizeContinuous(const std::string& file_path, const std:
             consecutive_count = 0;
             consecutive_track_id = "";
         }
-
-        segment_index++;
     }
 
-    // Cleanup
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-
     // Find track with most matches
     std::string best_track_id;
     size_t best_count = 0;
@@ -520,80 +429,34 @@ std::string Shazam::RecognizePrecise(const std::vector<Fingerprint*>& fingerprin
 {
     std::vector<SegmentResult> results;
 
-    // Create single CURL handle to reuse for all requests (like a real app)
-    CURL *curl = curl_easy_init();
-    if (!curl)
-    {
-        return "{\"error\":\"Failed to initialize CURL\"}";
-    }
-
-    // Setup headers once
-    struct curl_slist *headers = nullptr;
-    headers = curl_slist_append(headers, "Accept-Encoding: gzip, deflate, br");
-    headers = curl_slist_append(headers, "Accept: */*");
-    headers = curl_slist_append(headers, "Connection: keep-alive");
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    headers = curl_slist_append(headers, "Content-Language: en_US");
-
-    // Set common options
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip, deflate, br");
-    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-
-    // Configure proxy if provided
-    if (!proxy.empty())
-    {
-        std::string proxy_str = proxy;
-        curl_proxytype proxy_type = CURLPROXY_HTTP;
-
-        if (proxy_str.find("socks5://") == 0)
-        {
-            proxy_type = CURLPROXY_SOCKS5;
-            proxy_str = proxy_str.substr(9);
-        }
-        else if (proxy_str.find("http://") == 0)
-        {
-            proxy_str = proxy_str.substr(7);
-        }
-
-        std::string auth;
-        size_t at_pos = proxy_str.find('@');
-        if (at_pos != std::string::npos)
-        {
-            auth = proxy_str.substr(0, at_pos);
-            proxy_str = proxy_str.substr(at_pos + 1);
-        }
-
-        curl_easy_setopt(curl, CURLOPT_PROXY, proxy_str.c_str());
-        curl_easy_setopt(curl, CURLOPT_PROXYTYPE, proxy_type);
-
-        if (!auth.empty())
-        {
-            curl_easy_setopt(curl, CURLOPT_PROXYUSERPWD, auth.c_str());
-        }
+    // Same user agent for all requests, multiplexed on one connection where possible
+    HttpRequest request = tagRequest(proxy, getUserAgent());
+    request.http_1_1 = false;
+    auto submit = [&](size_t i) {
+        request.url = getShazamHost();
+        request.post_fields = getRequestContent(fingerprints[i]->uri, fingerprints[i]->sample_ms);
+        return HttpEventLoop::Shared().Submit(request);
+    };
+
+    // The first two segments are always needed, so they are sent together; later ones only
+    // when the first two disagree
+    std::vector<std::future<HttpResponse>> responses;
+    for (size_t i = 0; i < fingerprints.size() && i < 2; i++) {
+        responses.push_back(submit(i));
     }
 
-    // Get consistent user agent for all requests
-    auto user_agent = getUserAgent();
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, user_agent.c_str());
-
-    // Process fingerprints sequentially, reusing connection
     for (size_t i = 0; i < fingerprints.size(); i++) {
+        if (i >= responses.size()) {
+            responses.push_back(submit(i));
+        }
         std::string read_buffer;
-        std::string url = getShazamHost();
-        auto content = getRequestContent(fingerprints[i]->uri, fingerprints[i]->sample_ms);
-
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, content.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &read_buffer);
-
-        CURLcode res = curl_easy_perform(curl);
-        if (res != CURLE_OK)
+        HttpResponse response = responses[i].get();
+        if (!response.ok())
         {
-            std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(res) << std::endl;
+            std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(response.result)
+                      << std::endl;
         }
+        read_buffer = response.body;
 
         SegmentResult result;
         result.offset_ms = fingerprints[i]->offset_ms;
@@ -621,9 +484,6 @@ std::string Shazam::RecognizePrecise(const std::vector<Fingerprint*>& fingerprin
             if (!result.track_id.empty() &&
                 result.track_id == results[0].track_id) {
                 // Primary confirmed - return confident match
-                curl_slist_free_all(headers);
-                curl_easy_cleanup(curl);
-
                 std::string final_response = results[0].response;
                 size_t last_brace = final_response.rfind('}');
                 if (last_brace != std::string::npos) {
@@ -650,9 +510,6 @@ std::string Shazam::RecognizePrecise(const std::vector<Fingerprint*>& fingerprin
                 std::string primary_track = results[0].track_id;
                 if (!primary_track.empty() && vote_count[primary_track] >= 2) {
                     // Primary confirmed
-                    curl_slist_free_all(headers);
-                    curl_easy_cleanup(curl);
-
                     std::string final_response = results[0].response;
                     size_t last_brace = final_response.rfind('}');
                     if (last_brace != std::string::npos) {
@@ -683,9 +540,6 @@ std::string Shazam::RecognizePrecise(const std::vector<Fingerprint*>& fingerprin
 
                 if (all_others_agree && !agreed_track.empty() && agreed_track != primary_track) {
                     // All verification segments unanimously disagree with primary
-                    curl_slist_free_all(headers);
-                    curl_easy_cleanup(curl);
-
                     std::string final_response = results[1].response;
                     size_t last_brace = final_response.rfind('}');
                     if (last_brace != std::string::npos) {
@@ -698,9 +552,6 @@ std::string Shazam::RecognizePrecise(const std::vector<Fingerprint*>& fingerprin
                 }
 
                 // No unanimous agreement - trust primary (smart-analyzed segment)
-                curl_slist_free_all(headers);
-                curl_easy_cleanup(curl);
-
                 std::string final_response = results[0].response;
                 size_t last_brace = final_response.rfind('}');
                 if (last_brace != std::string::npos) {
@@ -714,10 +565,6 @@ std::string Shazam::RecognizePrecise(const std::vector<Fingerprint*>& fingerprin
         }
     }
 
-    // Cleanup
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
-
     // No confident match found - return ambiguous result
     std::stringstream json;
     json << "{\"matches\":[],\"vibra_segments_checked\":" << results.size();
@@ -764,62 +611,19 @@ std::string Shazam::FetchAppleMusicMetadata(const std::string& response, const s
         return response;
     }
 
-    CURL *curl = curl_easy_init();
-    if (!curl)
-    {
-        return response;
-    }
-
-    std::string read_buffer;
-    std::string url = "https://music.apple.com/song/" + apple_id;
-
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &read_buffer);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36");
-
-    // Configure proxy if provided
-    if (!proxy.empty())
-    {
-        std::string proxy_str = proxy;
-        curl_proxytype proxy_type = CURLPROXY_HTTP;
-
-        if (proxy_str.find("socks5://") == 0)
-        {
-            proxy_type = CURLPROXY_SOCKS5;
-            proxy_str = proxy_str.substr(9);
-        }
-        else if (proxy_str.find("http://") == 0)
-        {
-            proxy_str = proxy_str.substr(7);
-        }
-
-        std::string auth;
-        size_t at_pos = proxy_str.find('@');
-        if (at_pos != std::string::npos)
-        {
-            auth = proxy_str.substr(0, at_pos);
-            proxy_str = proxy_str.substr(at_pos + 1);
-        }
-
-        curl_easy_setopt(curl, CURLOPT_PROXY, proxy_str.c_str());
-        curl_easy_setopt(curl, CURLOPT_PROXYTYPE, proxy_type);
-
-        if (!auth.empty())
-        {
-            curl_easy_setopt(curl, CURLOPT_PROXYUSERPWD, auth.c_str());
-        }
-    }
-
-    CURLcode res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
+    HttpRequest request;
+    request.url = "https://music.apple.com/song/" + apple_id;
+    request.timeout_seconds = 10;
+    request.follow_location = true;
+    request.user_agent = "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36";
+    request.proxy = proxy;
 
-    if (res != CURLE_OK)
+    HttpResponse page = HttpClient::Shared().Perform(request);
+    if (!page.ok())
     {
         return response;
     }
+    const std::string &read_buffer = page.body;
 
     // Find schema:song JSON-LD
     size_t schema_start = read_buffer.find("<script id=\"schema:song\" type=\"application/ld+json\">");
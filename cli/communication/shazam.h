@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <functional>
+#include "communication/http_client.h"
 
 // forward declaration
 struct Fingerprint;
@@ -27,16 +29,32 @@ public:
     static std::string RecognizePrecise(const std::vector<Fingerprint*>& fingerprints, const std::string& proxy = "");
     static std::string RecognizeContinuous(const std::string& file_path, const std::string& proxy = "", int consecutive_required = 3);
     static std::string FetchExitIP(const std::string& proxy = "");
+    // Non-blocking versions of Recognize and FetchExitIP on the shared HttpEventLoop. The
+    // callback runs on the loop thread and must not block; the fingerprint may be freed as soon
+    // as SubmitRecognition returns.
+    static void SubmitRecognition(const Fingerprint *fingerprint, const std::string& proxy,
+                                  std::function<void(HttpResponse& response)> callback);
+    static void SubmitExitIPLookup(const std::string& proxy,
+                                   std::function<void(const std::string& ip)> callback);
+    // The address in a response of the exit IP lookup service, empty if there is none
+    static std::string ParseExitIP(const std::string& response);
     static bool RequestNewTorCircuit(const std::string& password = "");
     static std::string FetchAppleMusicMetadata(const std::string& response, const std::string& proxy = "");
     static std::string extractAppleMusicId(const std::string& response);
     static std::string BuildUnifiedResponse(const std::string& response);
+    // False for silent or near-empty clips that cannot match, so no request is spent on them
+    static bool IsWorthQuerying(Fingerprint *fingerprint);
 
 private:
     static std::string getShazamHost();
     static std::string getUserAgent();
     static std::string getRequestContent(const std::string &uri, unsigned int sample_ms);
     static std::string getTimezone();
+    // Fingerprints the segments from *offset on until one is worth a request; *segment_index
+    // counts the segments looked at, silent ones included. Null once the file is done.
+    static Fingerprint *nextContinuousSegment(const std::string &file_path, unsigned int duration,
+                                              unsigned int segment_duration, unsigned int *offset,
+                                              size_t *segment_index);
     static std::string extractTrackId(const std::string& response);
     static std::string extractTitle(const std::string& response);
     static std::string extractArtist(const std::string& response);
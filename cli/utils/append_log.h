@@ -0,0 +1,251 @@
+#ifndef CLI_UTILS_APPEND_LOG_H_
+#define CLI_UTILS_APPEND_LOG_H_
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// How long appended records gather before they are written and synced together
+constexpr int APPEND_LOG_FLUSH_INTERVAL_MS = 1000;
+// Written early once this much is pending
+constexpr std::size_t APPEND_LOG_MAX_BATCH_BYTES = 1 << 20;
+
+// Reads length bytes at offset of fd into data; false if the file ends before
+inline bool ReadAt(int fd, std::uint64_t offset, std::size_t length, std::string *data)
+{
+    data->resize(length);
+    std::size_t done = 0;
+    while (done < length)
+    {
+        ssize_t got = ::pread(fd, &(*data)[done], length - done, static_cast<off_t>(offset + done));
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            return false;
+        }
+        done += static_cast<std::size_t>(got);
+    }
+    return true;
+}
+
+// Append-only file of records, written by its own thread. Append() only copies the record into
+// the pending batch; the writer hands each batch to the kernel in one write() and syncs it, so
+// the cost of a record doesn't depend on how many came before and a crash loses at most the
+// batch in progress. Records can be read back by offset, whether written yet or not. Once a write
+// or sync fails nothing more is written: that batch and every record after it stay in memory.
+class AppendLog
+{
+public:
+    AppendLog() : fd_(-1), written_(0), stopping_(false), failed_(false)
+    {
+    }
+    AppendLog(const AppendLog &) = delete;
+    AppendLog &operator=(const AppendLog &) = delete;
+    ~AppendLog()
+    {
+        Close();
+    }
+
+    // Opens path for appending, creating it, or emptying it with truncate. Returns false with
+    // errno set on failure.
+    bool Open(const std::string &path, bool truncate)
+    {
+        int flags = O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0);
+        fd_ = ::open(path.c_str(), flags, 0644);
+        struct stat st;
+        if (fd_ < 0 || fstat(fd_, &st) != 0)
+        {
+            int error = errno;
+            if (fd_ >= 0)
+            {
+                ::close(fd_);
+                fd_ = -1;
+            }
+            errno = error;
+            return false;
+        }
+        written_ = static_cast<std::uint64_t>(st.st_size);
+        unwritten_.clear();
+        stopping_ = false;
+        failed_ = false;
+        thread_ = std::thread(&AppendLog::run, this);
+        return true;
+    }
+
+    // Thread-safe. The record is written as is, terminator included. Returns the offset it
+    // starts at in the file.
+    std::uint64_t Append(const std::string &record)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::uint64_t offset = written_ + unwritten_.size() + writing_.size() + pending_.size();
+        pending_ += record;
+        if (pending_.size() >= APPEND_LOG_MAX_BATCH_BYTES)
+        {
+            changed_.notify_one();
+        }
+        return offset;
+    }
+
+    // Thread-safe. Reads back length bytes appended at offset, e.g. a record Append() returned
+    // the offset of. False if they can't be read, or the file is closed.
+    bool Read(std::uint64_t offset, std::size_t length, std::string *data)
+    {
+        int fd;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            // records don't straddle batches, Append() adds them whole
+            std::uint64_t writing_start = written_ + unwritten_.size();
+            std::uint64_t pending_start = writing_start + writing_.size();
+            if (offset >= pending_start)
+            {
+                return copyOut(pending_, offset - pending_start, length, data);
+            }
+            if (offset >= writing_start)
+            {
+                return copyOut(writing_, offset - writing_start, length, data);
+            }
+            if (offset >= written_)
+            {
+                return copyOut(unwritten_, offset - written_, length, data);
+            }
+            fd = fd_;
+        }
+        // written, so it no longer changes; the file has to stay open until reads are done
+        return fd >= 0 && ReadAt(fd, offset, length, data);
+    }
+
+    // Thread-safe. Bytes appended since the file was created, whether written yet or not.
+    std::uint64_t size()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return written_ + unwritten_.size() + writing_.size() + pending_.size();
+    }
+
+    // Writes and syncs whatever is pending, then closes the file. Returns false if any write
+    // failed since Open().
+    bool Close()
+    {
+        if (!thread_.joinable())
+        {
+            return !failed_;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        changed_.notify_one();
+        thread_.join();
+        std::lock_guard<std::mutex> lock(mutex_);
+        ::close(fd_);
+        fd_ = -1;
+        return !failed_;
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_ || !pending_.empty())
+        {
+            changed_.wait_for(lock, std::chrono::milliseconds(APPEND_LOG_FLUSH_INTERVAL_MS),
+                              [this] {
+                                  return stopping_ || pending_.size() >= APPEND_LOG_MAX_BATCH_BYTES;
+                              });
+            if (pending_.empty())
+            {
+                continue;
+            }
+            if (failed_)
+            {
+                unwritten_ += pending_;
+                pending_.clear();
+                continue;
+            }
+            // the swap hands the emptied buffer back, its capacity is reused; nothing changes
+            // writing_ until it is written, so Read() can copy from it meanwhile
+            writing_.swap(pending_);
+            lock.unlock();
+            bool written = writeAll(writing_) && sync();
+            lock.lock();
+            if (written)
+            {
+                written_ += writing_.size();
+            }
+            else
+            {
+                // part of it may be in the file, so the file no longer tells where records are
+                unwritten_ += writing_;
+                failed_ = true;
+            }
+            writing_.clear();
+        }
+    }
+
+    bool writeAll(const std::string &data)
+    {
+        const char *next = data.data();
+        std::size_t left = data.size();
+        while (left > 0)
+        {
+            ssize_t written = ::write(fd_, next, left);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            next += written;
+            left -= static_cast<std::size_t>(written);
+        }
+        return true;
+    }
+
+    static bool copyOut(const std::string &buffer, std::uint64_t start, std::size_t length,
+                        std::string *data)
+    {
+        if (start > buffer.size() || length > buffer.size() - start)
+        {
+            return false;
+        }
+        data->assign(buffer, static_cast<std::size_t>(start), length);
+        return true;
+    }
+
+    bool sync()
+    {
+#ifdef __APPLE__
+        return ::fsync(fd_) == 0;
+#else
+        // the size changes with every append, so this still writes the inode
+        return ::fdatasync(fd_) == 0;
+#endif
+    }
+
+private:
+    int fd_;
+    std::thread thread_;
+    // guarded by mutex_
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::uint64_t written_; // file size, counting the batches written before
+    std::string unwritten_; // everything since a write or sync failed
+    std::string writing_;   // the batch being written
+    std::string pending_;   // the batch after
+    bool stopping_;
+    bool failed_;
+};
+
+#endif // CLI_UTILS_APPEND_LOG_H_
@@ -0,0 +1,90 @@
+#ifndef CLI_UTILS_BOUNDED_QUEUE_H_
+#define CLI_UTILS_BOUNDED_QUEUE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// Blocking FIFO between pipeline stages. Producers wait while it is full, so a fast stage
+// can't run ahead of a slow one by more than the capacity.
+template <typename T> class BoundedQueue
+{
+public:
+    explicit BoundedQueue(std::size_t capacity) : capacity_(capacity == 0 ? 1 : capacity)
+    {
+    }
+
+    // Waits for room. Returns false once the queue is closed.
+    bool Push(const T &value)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+        if (closed_)
+        {
+            return false;
+        }
+        items_.push_back(value);
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // Puts an item that was taken out back at the front. Ignores the capacity and Close(), so a
+    // consumer handing work back never blocks or loses it.
+    void Requeue(const T &value)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        items_.push_front(value);
+        not_empty_.notify_one();
+    }
+
+    // Waits for an item. Returns false once the queue is closed and drained.
+    bool Pop(T *value)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty())
+        {
+            return false;
+        }
+        *value = items_.front();
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    // Wakes everybody up: pushes fail from now on, pops drain what is left
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+    // Takes out everything still queued, e.g. to free it after an abort
+    std::deque<T> Drain()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::deque<T> items;
+        items.swap(items_);
+        not_full_.notify_all();
+        return items;
+    }
+
+    std::size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return items_.size();
+    }
+
+private:
+    std::size_t capacity_;
+    bool closed_ = false;
+    std::deque<T> items_;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+};
+
+#endif // CLI_UTILS_BOUNDED_QUEUE_H_
@@ -0,0 +1,230 @@
+#ifndef CLI_UTILS_DIRECTORY_SCANNER_H_
+#define CLI_UTILS_DIRECTORY_SCANNER_H_
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Walks a directory tree with several threads listing directories at once. Listing is mostly
+// waiting on the filesystem, which on a network mount means a round trip per directory, so
+// the threads overlap those waits. Files are handed over as they are found rather than once
+// the whole tree has been walked.
+//
+// Entries are opened and stat'ed relative to their directory's descriptor, so the kernel never
+// resolves a full path again. The type readdir() reports decides what an entry is; only files
+// the name filter keeps are stat'ed, and only symbolic links and entries of unknown type need
+// a stat to be told apart. Symbolic links are followed. A file is reported once however many
+// hard links or symbolic links lead to it, and a directory is listed once, so link loops end.
+class DirectoryScanner
+{
+public:
+    // Decides from the name alone whether a file is wanted
+    using NameFilter = std::function<bool(const char *name)>;
+    // Gets each wanted regular file, on one of the scanning threads. Returning false stops the
+    // scan.
+    using FileHandler = std::function<bool(const std::string &path, const struct stat &st)>;
+
+    DirectoryScanner(int threads, NameFilter filter, FileHandler handler)
+        : threads_(threads < 1 ? 1 : threads), filter_(std::move(filter)),
+          handler_(std::move(handler)), busy_(0), stopped_(false)
+    {
+    }
+    DirectoryScanner(const DirectoryScanner &) = delete;
+    DirectoryScanner &operator=(const DirectoryScanner &) = delete;
+
+    // Returns once the tree below root has been walked or the handler stopped the scan
+    void Scan(const std::string &root)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.clear();
+            pending_.push_back(Directory{nullptr, root, root});
+            busy_ = 0;
+            stopped_ = false;
+        }
+        std::vector<std::thread> threads;
+        for (int i = 0; i < threads_; i++)
+        {
+            threads.emplace_back(&DirectoryScanner::run, this);
+        }
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+private:
+    // An open directory; the descriptor stays open while subdirectories waiting to be listed
+    // are opened relative to it
+    struct Handle
+    {
+        DIR *dir;
+        explicit Handle(DIR *dir) : dir(dir)
+        {
+        }
+        ~Handle()
+        {
+            closedir(dir);
+        }
+    };
+
+    struct Directory
+    {
+        std::shared_ptr<Handle> parent; // null for the root, which is opened by path
+        std::string name;
+        std::string path;
+    };
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;)
+        {
+            // done once nothing is pending and nobody is listing a directory that may add more
+            work_changed_.wait(lock,
+                               [this] { return stopped_ || !pending_.empty() || busy_ == 0; });
+            if (stopped_ || pending_.empty())
+            {
+                return;
+            }
+            // last in, first out: the walk goes deep first, which keeps few directories open
+            Directory directory = std::move(pending_.back());
+            pending_.pop_back();
+            busy_++;
+            lock.unlock();
+
+            std::vector<Directory> subdirectories;
+            bool keep_going = list(directory, &subdirectories);
+
+            lock.lock();
+            busy_--;
+            stopped_ = stopped_ || !keep_going;
+            for (Directory &subdirectory : subdirectories)
+            {
+                pending_.push_back(std::move(subdirectory));
+            }
+            work_changed_.notify_all();
+        }
+    }
+
+    // Lists one directory, collecting its subdirectories. Returns false if the handler stopped
+    // the scan.
+    bool list(const Directory &directory, std::vector<Directory> *subdirectories)
+    {
+        const int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+        int fd = directory.parent
+                     ? openat(dirfd(directory.parent->dir), directory.name.c_str(), flags)
+                     : ::open(directory.path.c_str(), flags);
+        if (fd < 0)
+        {
+            return true;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !firstVisit(directories_, st))
+        {
+            ::close(fd);
+            return true;
+        }
+        DIR *dir = fdopendir(fd);
+        if (!dir)
+        {
+            ::close(fd);
+            return true;
+        }
+        std::shared_ptr<Handle> handle = std::make_shared<Handle>(dir);
+
+        while (struct dirent *entry = readdir(dir))
+        {
+            const char *name = entry->d_name;
+            if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0)
+            {
+                continue;
+            }
+
+            if (entry->d_type == DT_DIR)
+            {
+                subdirectories->push_back(Directory{handle, name, directory.path + "/" + name});
+                continue;
+            }
+            else if (entry->d_type == DT_REG)
+            {
+                if (!filter_(name) || fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                {
+                    continue;
+                }
+            }
+            else if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN)
+            {
+                if (fstatat(fd, name, &st, 0) != 0)
+                {
+                    continue;
+                }
+                if (S_ISDIR(st.st_mode))
+                {
+                    subdirectories->push_back(Directory{handle, name, directory.path + "/" + name});
+                    continue;
+                }
+                if (!S_ISREG(st.st_mode) || !filter_(name))
+                {
+                    continue;
+                }
+            }
+            else
+            {
+                continue;
+            }
+
+            if (!firstVisit(files_, st))
+            {
+                continue;
+            }
+            if (!handler_(directory.path + "/" + name, st))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Records the device and inode st is for; false if they were recorded before
+    bool firstVisit(std::set<std::pair<std::uint64_t, std::uint64_t>> &visited,
+                    const struct stat &st)
+    {
+        std::lock_guard<std::mutex> lock(visited_mutex_);
+        return visited
+            .insert(std::make_pair(static_cast<std::uint64_t>(st.st_dev),
+                                   static_cast<std::uint64_t>(st.st_ino)))
+            .second;
+    }
+
+private:
+    int threads_;
+    NameFilter filter_;
+    FileHandler handler_;
+
+    // guarded by mutex_
+    std::mutex mutex_;
+    std::condition_variable work_changed_;
+    std::vector<Directory> pending_;
+    int busy_;
+    bool stopped_;
+
+    // guarded by visited_mutex_
+    std::mutex visited_mutex_;
+    std::set<std::pair<std::uint64_t, std::uint64_t>> directories_;
+    std::set<std::pair<std::uint64_t, std::uint64_t>> files_;
+};
+
+#endif // CLI_UTILS_DIRECTORY_SCANNER_H_
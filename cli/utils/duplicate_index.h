@@ -0,0 +1,153 @@
+#ifndef CLI_UTILS_DUPLICATE_INDEX_H_
+#define CLI_UTILS_DUPLICATE_INDEX_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Values kept per group to estimate overlaps from; the estimate is off by about
+// sqrt(J * (1 - J) / DUPLICATE_SKETCH_SIZE), under 0.05 for this many
+constexpr std::size_t DUPLICATE_SKETCH_SIZE = 128;
+// Of those, the smallest few are looked up by; two sets overlapping as much as duplicates do
+// share one of them almost always (all of them are missed with odds of (1 - J)^8)
+constexpr std::size_t DUPLICATE_ANCHORS = 8;
+// Groups looked up per anchor at most, so a landmark common to many recordings stays cheap
+constexpr std::size_t DUPLICATE_MAX_GROUPS_PER_ANCHOR = 64;
+
+// Groups fingerprints of the same audio by their landmarks (vibra_get_landmarks_from_fingerprint).
+// A group keeps a bottom-k sketch of its first member's landmarks: the DUPLICATE_SKETCH_SIZE
+// smallest landmark hashes, from which the overlap (Jaccard index) of two landmark sets can be
+// estimated without the sets themselves. Memory per group and the cost of a lookup stay the
+// same however many files there are.
+class DuplicateIndex
+{
+public:
+    // min_similarity: share of their landmarks two fingerprints have in common at least, of
+    // all the landmarks either has, to count as the same audio
+    explicit DuplicateIndex(double min_similarity) : min_similarity_(min_similarity)
+    {
+    }
+
+    // Thread-safe. The group of an earlier fingerprint with these landmarks, or a new group
+    // founded by this one (*founded tells which); -1 if there are too few landmarks to tell.
+    int Assign(const unsigned int *landmarks, std::size_t count, bool *founded)
+    {
+        *founded = false;
+        if (count < DUPLICATE_SKETCH_SIZE)
+        {
+            return -1;
+        }
+        Sketch sketch = sketchOf(landmarks, count);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        int best_group = -1;
+        double best_similarity = min_similarity_;
+        std::vector<int> checked;
+        for (std::size_t i = 0; i < DUPLICATE_ANCHORS; i++)
+        {
+            auto found = by_anchor_.find(sketch.values[i]);
+            if (found == by_anchor_.end())
+            {
+                continue;
+            }
+            for (int group : found->second)
+            {
+                if (std::find(checked.begin(), checked.end(), group) != checked.end())
+                {
+                    continue;
+                }
+                checked.push_back(group);
+                double similarity = estimateSimilarity(sketch, groups_[group]);
+                if (similarity >= best_similarity)
+                {
+                    best_group = group;
+                    best_similarity = similarity;
+                }
+            }
+        }
+        if (best_group >= 0)
+        {
+            return best_group;
+        }
+
+        int group = static_cast<int>(groups_.size());
+        groups_.push_back(sketch);
+        for (std::size_t i = 0; i < DUPLICATE_ANCHORS; i++)
+        {
+            std::vector<int> &anchored = by_anchor_[sketch.values[i]];
+            if (anchored.size() < DUPLICATE_MAX_GROUPS_PER_ANCHOR)
+            {
+                anchored.push_back(group);
+            }
+        }
+        *founded = true;
+        return group;
+    }
+
+private:
+    struct Sketch
+    {
+        std::uint32_t values[DUPLICATE_SKETCH_SIZE]; // ascending
+    };
+
+    static Sketch sketchOf(const unsigned int *landmarks, std::size_t count)
+    {
+        std::vector<std::uint32_t> hashes(landmarks, landmarks + count);
+        for (std::uint32_t &hash : hashes)
+        {
+            hash = mix(hash);
+        }
+        std::partial_sort(hashes.begin(), hashes.begin() + DUPLICATE_SKETCH_SIZE, hashes.end());
+        Sketch sketch;
+        std::copy(hashes.begin(), hashes.begin() + DUPLICATE_SKETCH_SIZE, sketch.values);
+        return sketch;
+    }
+
+    // Of the smallest DUPLICATE_SKETCH_SIZE hashes of the union, the share found in both sets
+    static double estimateSimilarity(const Sketch &a, const Sketch &b)
+    {
+        std::size_t i = 0, j = 0, shared = 0;
+        for (std::size_t taken = 0; taken < DUPLICATE_SKETCH_SIZE; taken++)
+        {
+            if (a.values[i] == b.values[j])
+            {
+                shared++;
+                i++;
+                j++;
+            }
+            else if (a.values[i] < b.values[j])
+            {
+                i++;
+            }
+            else
+            {
+                j++;
+            }
+        }
+        return static_cast<double>(shared) / DUPLICATE_SKETCH_SIZE;
+    }
+
+    // Landmarks are packed fields, this spreads them evenly over the hash range (murmur3's
+    // finalizer)
+    static std::uint32_t mix(std::uint32_t value)
+    {
+        value ^= value >> 16;
+        value *= 0x85ebca6bU;
+        value ^= value >> 13;
+        value *= 0xc2b2ae35U;
+        value ^= value >> 16;
+        return value;
+    }
+
+private:
+    double min_similarity_;
+    // guarded by mutex_
+    std::mutex mutex_;
+    std::vector<Sketch> groups_;
+    std::unordered_map<std::uint32_t, std::vector<int>> by_anchor_;
+};
+
+#endif // CLI_UTILS_DUPLICATE_INDEX_H_
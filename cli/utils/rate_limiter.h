@@ -0,0 +1,124 @@
+#ifndef CLI_UTILS_RATE_LIMITER_H_
+#define CLI_UTILS_RATE_LIMITER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+constexpr double RATE_LIMITER_MIN_RATE = 0.05; // requests per second
+// Per second of successful requests at full speed
+constexpr double RATE_LIMITER_INCREASE = 0.1;
+constexpr double RATE_LIMITER_DECREASE_FACTOR = 0.5;
+
+// Token bucket whose rate and concurrency window follow AIMD: every success adds a little,
+// every throttling response halves both and pauses all requests for the server's Retry-After.
+// Settles just below whatever rate the service currently tolerates.
+class AdaptiveRateLimiter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Rates in requests per second; the window starts at max_concurrency
+    AdaptiveRateLimiter(double initial_rate, double max_rate, std::size_t max_concurrency)
+        : max_rate_(std::max(max_rate, RATE_LIMITER_MIN_RATE)),
+          rate_(std::min(std::max(initial_rate, RATE_LIMITER_MIN_RATE), max_rate_)), tokens_(1.0),
+          max_window_(std::max<std::size_t>(max_concurrency, 1)), window_(max_window_),
+          last_refill_(Clock::now()), paused_until_(last_refill_)
+    {
+    }
+
+    // Waits for a token, or until abort gets set (returns false then)
+    bool Acquire(const std::atomic<bool> &abort)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!abort.load())
+        {
+            Clock::time_point now = Clock::now();
+            refill(now);
+            Clock::time_point ready = paused_until_;
+            if (now >= paused_until_)
+            {
+                if (tokens_ >= 1.0)
+                {
+                    tokens_ -= 1.0;
+                    return true;
+                }
+                ready = now + std::chrono::duration_cast<Clock::duration>(
+                                  std::chrono::duration<double>((1.0 - tokens_) / rate_));
+            }
+            // wake up now and then to look at abort
+            changed_.wait_until(lock, std::min(ready, now + std::chrono::milliseconds(500)));
+        }
+        return false;
+    }
+
+    void OnSuccess()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rate_ = std::min(max_rate_, rate_ + RATE_LIMITER_INCREASE / rate_);
+        window_ = std::min(static_cast<double>(max_window_), window_ + 1.0 / window_);
+    }
+
+    // Backs off and pauses for pause_seconds. Requests that were already in flight tend to get
+    // throttled together; those arriving during the pause don't back off again. Returns whether
+    // this one did.
+    bool OnThrottled(double pause_seconds)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Clock::time_point now = Clock::now();
+        if (now < paused_until_)
+        {
+            return false;
+        }
+        rate_ = std::max(RATE_LIMITER_MIN_RATE, rate_ * RATE_LIMITER_DECREASE_FACTOR);
+        window_ = std::max(1.0, window_ * RATE_LIMITER_DECREASE_FACTOR);
+        tokens_ = 0.0;
+        last_refill_ = now;
+        paused_until_ = now + std::chrono::duration_cast<Clock::duration>(
+                                  std::chrono::duration<double>(pause_seconds));
+        changed_.notify_all();
+        return true;
+    }
+
+    double rate()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return rate_;
+    }
+
+    // Requests that may be in flight at once
+    std::size_t concurrency()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<std::size_t>(window_);
+    }
+
+private:
+    void refill(Clock::time_point now)
+    {
+        if (now <= last_refill_)
+        {
+            return;
+        }
+        std::chrono::duration<double> elapsed = now - last_refill_;
+        last_refill_ = now;
+        // at most a second's worth, so an idle spell doesn't turn into a burst
+        tokens_ = std::min(std::max(1.0, rate_), tokens_ + elapsed.count() * rate_);
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    double max_rate_;
+    double rate_;
+    double tokens_;
+    std::size_t max_window_;
+    double window_;
+    Clock::time_point last_refill_;
+    Clock::time_point paused_until_;
+};
+
+#endif // CLI_UTILS_RATE_LIMITER_H_
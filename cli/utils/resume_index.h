@@ -0,0 +1,371 @@
+#ifndef CLI_UTILS_RESUME_INDEX_H_
+#define CLI_UTILS_RESUME_INDEX_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Changes with the layout
+constexpr char RESUME_INDEX_MAGIC[] = "VIBRIDX1";
+
+// What a file is, as opposed to where it is: a moved file keeps it, a modified one doesn't
+struct FileIdentity
+{
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    std::uint64_t size = 0;
+    std::int64_t mtime_ns = 0;
+
+    inline bool operator==(const FileIdentity &other) const
+    {
+        return device == other.device && inode == other.inode && size == other.size &&
+               mtime_ns == other.mtime_ns;
+    }
+    inline bool operator!=(const FileIdentity &other) const
+    {
+        return !(*this == other);
+    }
+    // Size and modification time only, for a file known by its path: device numbers of NFS,
+    // SMB, FUSE and removable mounts change with every remount, and some inodes do too
+    inline bool SameContentAs(const FileIdentity &other) const
+    {
+        return size == other.size && mtime_ns == other.mtime_ns;
+    }
+    // False for a default-constructed identity, no file has inode 0
+    inline bool known() const
+    {
+        return inode != 0;
+    }
+};
+
+inline FileIdentity IdentityOf(const struct stat &st)
+{
+    FileIdentity identity;
+    identity.device = static_cast<std::uint64_t>(st.st_dev);
+    identity.inode = static_cast<std::uint64_t>(st.st_ino);
+    identity.size = static_cast<std::uint64_t>(st.st_size);
+#ifdef __APPLE__
+    identity.mtime_ns = static_cast<std::int64_t>(st.st_mtimespec.tv_sec) * 1000000000 +
+                        st.st_mtimespec.tv_nsec;
+#else
+    identity.mtime_ns = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                        st.st_mtim.tv_nsec;
+#endif
+    return identity;
+}
+
+// Read-only on-disk hash table of processed files, looked up by identity or by path. The file
+// is mapped rather than read, so opening it costs the same for ten entries or ten million,
+// and lookups need no locking. Layout, all in native byte order:
+//   Header
+//   Entry entries[count]
+//   uint32_t by_identity[capacity], by_path[capacity]   entry index + 1, 0 for an empty slot
+//   char paths[paths_size]                              not NUL-terminated
+class ResumeIndex
+{
+public:
+    struct Entry
+    {
+        FileIdentity identity;
+        std::uint64_t path_hash;
+        std::uint64_t path_offset;
+        std::uint32_t path_length;
+        std::uint32_t success;
+    };
+
+    struct Record
+    {
+        std::string path;
+        FileIdentity identity;
+        bool success;
+    };
+
+    ResumeIndex() : data_(nullptr), size_(0), header_(nullptr)
+    {
+    }
+    ResumeIndex(const ResumeIndex &) = delete;
+    ResumeIndex &operator=(const ResumeIndex &) = delete;
+    ~ResumeIndex()
+    {
+        Close();
+    }
+
+    // False if the file is missing or isn't a complete index
+    bool Open(const std::string &path)
+    {
+        Close();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(Header))
+        {
+            ::close(fd);
+            return false;
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps the file alive
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            return false;
+        }
+        data_ = data;
+        header_ = static_cast<const Header *>(data_);
+        if (!valid())
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+        if (data_)
+        {
+            munmap(data_, size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+        header_ = nullptr;
+    }
+
+    std::size_t size() const
+    {
+        return header_ ? static_cast<std::size_t>(header_->count) : 0;
+    }
+
+    const Entry *FindByPath(const std::string &path) const
+    {
+        if (!header_)
+        {
+            return nullptr;
+        }
+        std::uint64_t hash = hashBytes(path.data(), path.size());
+        const std::uint32_t *slots = pathSlots();
+        std::uint64_t slot = hash & mask();
+        for (std::uint64_t probe = 0; probe < header_->capacity; probe++)
+        {
+            const Entry *entry = entryAt(slots[slot]);
+            if (!entry)
+            {
+                return nullptr;
+            }
+            if (entry->path_hash == hash && entry->path_length == path.size() &&
+                std::memcmp(paths() + entry->path_offset, path.data(), path.size()) == 0)
+            {
+                return entry;
+            }
+            slot = (slot + 1) & mask();
+        }
+        return nullptr;
+    }
+
+    // Any of the entries with this identity, hard links share one
+    const Entry *FindByIdentity(const FileIdentity &identity) const
+    {
+        if (!header_)
+        {
+            return nullptr;
+        }
+        const std::uint32_t *slots = identitySlots();
+        std::uint64_t slot = hashIdentity(identity) & mask();
+        for (std::uint64_t probe = 0; probe < header_->capacity; probe++)
+        {
+            const Entry *entry = entryAt(slots[slot]);
+            if (!entry)
+            {
+                return nullptr;
+            }
+            if (entry->identity == identity)
+            {
+                return entry;
+            }
+            slot = (slot + 1) & mask();
+        }
+        return nullptr;
+    }
+
+    std::string PathOf(const Entry &entry) const
+    {
+        return std::string(paths() + entry.path_offset, entry.path_length);
+    }
+
+    // Writes an index of records to path, replacing it in one rename. Records with an unknown
+    // identity are left out.
+    static bool Write(const std::string &path, const std::vector<Record> &records)
+    {
+        std::vector<Entry> entries;
+        entries.reserve(records.size());
+        std::string paths;
+        for (const Record &record : records)
+        {
+            if (!record.identity.known())
+            {
+                continue;
+            }
+            Entry entry;
+            entry.identity = record.identity;
+            entry.path_hash = hashBytes(record.path.data(), record.path.size());
+            entry.path_offset = paths.size();
+            entry.path_length = static_cast<std::uint32_t>(record.path.size());
+            entry.success = record.success ? 1 : 0;
+            entries.push_back(entry);
+            paths += record.path;
+        }
+
+        // at most half full, so probes stay short
+        std::uint64_t capacity = 16;
+        while (capacity < entries.size() * 2)
+        {
+            capacity *= 2;
+        }
+        std::vector<std::uint32_t> by_identity(capacity, 0);
+        std::vector<std::uint32_t> by_path(capacity, 0);
+        for (std::size_t i = 0; i < entries.size(); i++)
+        {
+            insert(by_identity, hashIdentity(entries[i].identity), static_cast<std::uint32_t>(i));
+            insert(by_path, entries[i].path_hash, static_cast<std::uint32_t>(i));
+        }
+
+        Header header;
+        std::memcpy(header.magic, RESUME_INDEX_MAGIC, sizeof(header.magic));
+        header.capacity = capacity;
+        header.count = entries.size();
+        header.paths_size = paths.size();
+
+        std::string temp_path = path + ".tmp";
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(Entry));
+        std::size_t slots_size = capacity * sizeof(std::uint32_t);
+        out.write(reinterpret_cast<const char *>(by_identity.data()), slots_size);
+        out.write(reinterpret_cast<const char *>(by_path.data()), slots_size);
+        out.write(paths.data(), paths.size());
+        out.close();
+        if (out.fail())
+        {
+            std::remove(temp_path.c_str());
+            return false;
+        }
+        return std::rename(temp_path.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    struct Header
+    {
+        char magic[8];
+        std::uint64_t capacity; // a power of two
+        std::uint64_t count;
+        std::uint64_t paths_size;
+    };
+
+    // FNV-1a
+    static std::uint64_t hashBytes(const void *data, std::size_t length)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        std::uint64_t hash = 14695981039346656037ULL;
+        for (std::size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    static std::uint64_t hashIdentity(const FileIdentity &identity)
+    {
+        std::uint64_t fields[4] = {identity.device, identity.inode, identity.size,
+                                   static_cast<std::uint64_t>(identity.mtime_ns)};
+        return hashBytes(fields, sizeof(fields));
+    }
+
+    static void insert(std::vector<std::uint32_t> &slots, std::uint64_t hash, std::uint32_t index)
+    {
+        std::uint64_t mask = slots.size() - 1;
+        std::uint64_t slot = hash & mask;
+        while (slots[slot] != 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = index + 1;
+    }
+
+    bool valid() const
+    {
+        if (std::memcmp(header_->magic, RESUME_INDEX_MAGIC, sizeof(header_->magic)) != 0 ||
+            header_->capacity == 0 || (header_->capacity & (header_->capacity - 1)) != 0 ||
+            header_->count >= header_->capacity)
+        {
+            return false;
+        }
+        // each term is bounded by the file size first, so the sum can't wrap
+        std::uint64_t limit = size_;
+        if (header_->count > limit / sizeof(Entry) ||
+            header_->capacity > limit / (2 * sizeof(std::uint32_t)) || header_->paths_size > limit)
+        {
+            return false;
+        }
+        std::uint64_t expected = sizeof(Header) + header_->count * sizeof(Entry) +
+                                 header_->capacity * 2 * sizeof(std::uint32_t) +
+                                 header_->paths_size;
+        // entries are checked as they are looked up, checking them all here would read the
+        // whole file
+        return expected == size_;
+    }
+
+    // The entry a slot points at; null for an empty slot, and for one a damaged file points
+    // out of bounds with
+    const Entry *entryAt(std::uint32_t slot_value) const
+    {
+        if (slot_value == 0 || slot_value > header_->count)
+        {
+            return nullptr;
+        }
+        const Entry *entry = entries() + (slot_value - 1);
+        if (entry->path_offset > header_->paths_size ||
+            entry->path_length > header_->paths_size - entry->path_offset)
+        {
+            return nullptr;
+        }
+        return entry;
+    }
+
+    std::uint64_t mask() const
+    {
+        return header_->capacity - 1;
+    }
+    const Entry *entries() const
+    {
+        return reinterpret_cast<const Entry *>(static_cast<const char *>(data_) + sizeof(Header));
+    }
+    const std::uint32_t *identitySlots() const
+    {
+        return reinterpret_cast<const std::uint32_t *>(entries() + header_->count);
+    }
+    const std::uint32_t *pathSlots() const
+    {
+        return identitySlots() + header_->capacity;
+    }
+    const char *paths() const
+    {
+        return reinterpret_cast<const char *>(pathSlots() + header_->capacity);
+    }
+
+private:
+    void *data_;
+    std::size_t size_;
+    const Header *header_;
+};
+
+#endif // CLI_UTILS_RESUME_INDEX_H_
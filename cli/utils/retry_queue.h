@@ -0,0 +1,108 @@
+#ifndef CLI_UTILS_RETRY_QUEUE_H_
+#define CLI_UTILS_RETRY_QUEUE_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <vector>
+#include "utils/bounded_queue.h"
+
+// Items sitting out a backoff before they are tried again, handed on earliest due first
+template <typename T> class RetryQueue
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    RetryQueue() : sequence_(0), closed_(false)
+    {
+    }
+
+    void Push(const T &value, Clock::duration delay)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        items_.push(Item{Clock::now() + delay, sequence_++, value});
+        changed_.notify_one();
+    }
+
+    // Waits for the earliest item to come due and puts it at the front of target. Taking it out
+    // and requeueing it happen under one lock, so whoever checks size() before target's size
+    // never misses it. Returns false once closed.
+    bool MoveDue(BoundedQueue<T> &target)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;)
+        {
+            if (closed_)
+            {
+                return false;
+            }
+            if (items_.empty())
+            {
+                changed_.wait(lock);
+                continue;
+            }
+            // woken up early by a Push with an earlier due time, and by Close()
+            Clock::time_point due = items_.top().due;
+            if (Clock::now() < due)
+            {
+                changed_.wait_until(lock, due);
+                continue;
+            }
+            target.Requeue(items_.top().value);
+            items_.pop();
+            return true;
+        }
+    }
+
+    // Wakes up MoveDue for good
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        changed_.notify_all();
+    }
+
+    // Takes out everything still waiting, e.g. to free it after an abort
+    std::deque<T> Drain()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::deque<T> drained;
+        while (!items_.empty())
+        {
+            drained.push_back(items_.top().value);
+            items_.pop();
+        }
+        return drained;
+    }
+
+    std::size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return items_.size();
+    }
+
+private:
+    struct Item
+    {
+        Clock::time_point due;
+        std::uint64_t sequence; // keeps items due at the same time in order
+        T value;
+
+        // priority_queue puts the greatest on top, so the earliest has to compare greatest
+        bool operator<(const Item &other) const
+        {
+            return due != other.due ? due > other.due : sequence > other.sequence;
+        }
+    };
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::priority_queue<Item> items_;
+    std::uint64_t sequence_;
+    bool closed_;
+};
+
+#endif // CLI_UTILS_RETRY_QUEUE_H_
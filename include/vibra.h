@@ -1,7 +1,9 @@
 #ifndef INCLUDE_VIBRA_H_
 #define INCLUDE_VIBRA_H_
 
+#include <cstddef>
 #include <string>
+#include <vector>
 
 extern "C"
 {
@@ -16,11 +18,45 @@ struct Fingerprint
     std::string uri;        /**< The URI associated with the fingerprint. */
     unsigned int sample_ms; /**< The sample duration in milliseconds. */
     unsigned int offset_ms; /**< The offset in milliseconds where fingerprinting started. */
+    unsigned int band_peaks[4]; /**< Peaks per frequency band, lowest band first. */
+    double peak_density;        /**< Peaks per second of fingerprinted audio. */
+    double rms;                 /**< RMS level of the fingerprinted audio relative to full scale. */
+    double silence_ratio;       /**< Share of the fingerprinted audio below -60 dBFS. */
+    std::vector<unsigned int> landmarks; /**< Sorted peak pair hashes, see below. */
 };
 
+/**
+ * @brief Reusable fingerprinting state: signature generator, FFT plans and scratch buffers.
+ *
+ * The vibra_context_* variants of the entry points reuse it, so repeated calls skip the
+ * per-call setup (several megabytes of buffers and FFT plans) done by the plain ones.
+ * A context must only be used by one thread at a time; separate contexts share nothing and
+ * can be used from separate threads concurrently without any locking.
+ */
+typedef struct VibraContext vibra_context_t;
+
+/**
+ * @brief Create a fingerprinting context.
+ *
+ * @return vibra_context_t* Pointer to the new context.
+ *
+ * @note The returned pointer must be freed after use. See vibra_free_context().
+ */
+vibra_context_t *vibra_create_context();
+
+/**
+ * @brief Free a fingerprinting context.
+ *
+ * @param context Pointer to the context.
+ */
+void vibra_free_context(vibra_context_t *context);
+
 /**
  * @brief Generate a fingerprint from a music file.
  *
+ * WAV files (.wav, .rf64, .bw64) are decoded natively and their data chunk is streamed in
+ * bounded blocks, other formats are decoded with FFmpeg.
+ *
  * @param music_file_path The path to the music file.
  * @return Fingerprint* Pointer to the generated fingerprint.
  *
@@ -31,13 +67,16 @@ Fingerprint *vibra_get_fingerprint_from_music_file(const char *music_file_path);
 /**
  * @brief Generate a fingerprint from WAV data.
  *
+ * RIFF, RF64 and BW64 containers are accepted, with PCM, IEEE float and
+ * WAVE_FORMAT_EXTENSIBLE sample formats.
+ *
  * @param raw_wav The raw WAV data.
  * @param wav_data_size The size of the WAV data in bytes.
  * @return Fingerprint* Pointer to the generated fingerprint.
  *
  * @note The returned pointer must be freed after use. See vibra_free_fingerprint().
  */
-Fingerprint *vibra_get_fingerprint_from_wav_data(const char *raw_wav, int wav_data_size);
+Fingerprint *vibra_get_fingerprint_from_wav_data(const char *raw_wav, size_t wav_data_size);
 
 /**
  * @brief Generate a fingerprint from signed PCM data.
@@ -89,6 +128,64 @@ const char *vibra_get_uri_from_fingerprint(Fingerprint *fingerprint);
  */
 unsigned int vibra_get_sample_ms_from_fingerprint(Fingerprint *fingerprint);
 
+/**
+ * @brief Get the number of peaks a fingerprint holds in one frequency band.
+ *
+ * @param fingerprint Pointer to the fingerprint.
+ * @param band Band index: 0 = 250-520 Hz, 1 = 520-1450 Hz, 2 = 1450-3500 Hz, 3 = 3500-5500 Hz.
+ * @return unsigned int The peak count, 0 for an unknown band.
+ */
+unsigned int vibra_get_band_peaks_from_fingerprint(Fingerprint *fingerprint, int band);
+
+/**
+ * @brief Get the total number of peaks in a fingerprint.
+ *
+ * @param fingerprint Pointer to the fingerprint.
+ * @return unsigned int The sum of the peaks over all frequency bands.
+ */
+unsigned int vibra_get_peak_count_from_fingerprint(Fingerprint *fingerprint);
+
+/**
+ * @brief Get the peak density of a fingerprint.
+ *
+ * @param fingerprint Pointer to the fingerprint.
+ * @return double Peaks per second of fingerprinted audio, 0 for silence.
+ */
+double vibra_get_peak_density_from_fingerprint(Fingerprint *fingerprint);
+
+/**
+ * @brief Get the RMS level of the audio a fingerprint was generated from.
+ *
+ * @param fingerprint Pointer to the fingerprint.
+ * @return double The RMS level relative to full scale, between 0 and 1.
+ */
+double vibra_get_rms_from_fingerprint(Fingerprint *fingerprint);
+
+/**
+ * @brief Get the share of silence in the audio a fingerprint was generated from.
+ *
+ * @param fingerprint Pointer to the fingerprint.
+ * @return double The ratio of 8 ms blocks quieter than -60 dBFS, between 0 and 1.
+ */
+double vibra_get_silence_ratio_from_fingerprint(Fingerprint *fingerprint);
+
+/**
+ * @brief Get the landmarks of a fingerprint, to tell whether two files hold the same audio.
+ *
+ * A landmark packs two neighbouring peaks of one frequency band: both frequencies and the time
+ * between them. Where in the fingerprint the pair sits doesn't enter into it, so fingerprints
+ * of the same recording share most of their landmarks even across encodings and lead-ins,
+ * while those of different recordings share few.
+ *
+ * @param fingerprint Pointer to the fingerprint.
+ * @param count Where to store the number of landmarks.
+ * @return const unsigned int* The landmarks in ascending order, without duplicates.
+ *
+ * @note The returned pointer is valid as long as the fingerprint and should not be freed.
+ */
+const unsigned int *vibra_get_landmarks_from_fingerprint(Fingerprint *fingerprint,
+                                                         size_t *count);
+
 /**
  * @brief Free a fingerprint.
  *
@@ -115,6 +212,483 @@ double vibra_get_duration(const char *music_file_path);
  */
 Fingerprint *vibra_get_fingerprint_from_offset(const char *music_file_path, unsigned int offset_seconds);
 
+/**
+ * @brief Kill every running ffmpeg/ffprobe decode and make later ones fail immediately, until
+ *        vibra_resume_decoding() is called.
+ *
+ * @note Only an atomic flag is set, so this is safe to call from a signal handler.
+ *       Each decoder process is also killed after a fixed timeout on its own.
+ *       To stop a single piece of work instead, use vibra_cancel_job().
+ */
+void vibra_cancel_decoding();
+
+/**
+ * @brief Let decodes run again after vibra_cancel_decoding().
+ *
+ * @note Decodes cancelled before the call stay failed.
+ */
+void vibra_resume_decoding();
+
+/**
+ * @brief Keep the fingerprints of music files in an on-disk cache.
+ *
+ * Every entry point taking a music file path, batches and queued jobs included, looks the
+ * file up before decoding it and stores what it computes. Entries are keyed by a hash of the
+ * file's size and of samples of its content, plus the offset asked for, so a renamed or
+ * copied file is found and a modified one is fingerprinted again. Processes can share the
+ * directory. A file whose duration couldn't be read is fingerprinted from its start and not
+ * stored, so the next call looks for its best window again.
+ *
+ * @param directory The cache directory, created if missing; NULL turns the cache off.
+ * @return int 1 on success, 0 if the directory could not be created.
+ *
+ * @note Affects every context in the process; meant to be called before fingerprinting.
+ */
+int vibra_set_fingerprint_cache(const char *directory);
+
+/**
+ * @brief vibra_get_fingerprint_from_music_file() reusing the state held by a context.
+ *
+ * @param context The context, used by this thread only.
+ * @param music_file_path The path to the music file.
+ * @return Fingerprint* Pointer to the generated fingerprint.
+ *
+ * @note The returned pointer must be freed after use. See vibra_free_fingerprint().
+ */
+Fingerprint *vibra_context_get_fingerprint_from_music_file(vibra_context_t *context,
+                                                           const char *music_file_path);
+
+/**
+ * @brief vibra_get_fingerprint_from_wav_data() reusing the state held by a context.
+ *
+ * @param context The context, used by this thread only.
+ * @param raw_wav The raw WAV data.
+ * @param wav_data_size The size of the WAV data in bytes.
+ * @return Fingerprint* Pointer to the generated fingerprint.
+ *
+ * @note The returned pointer must be freed after use. See vibra_free_fingerprint().
+ */
+Fingerprint *vibra_context_get_fingerprint_from_wav_data(vibra_context_t *context,
+                                                         const char *raw_wav, size_t wav_data_size);
+
+/**
+ * @brief vibra_get_fingerprint_from_signed_pcm() reusing the state held by a context.
+ *
+ * @param context The context, used by this thread only.
+ * @param raw_pcm The raw PCM data.
+ * @param pcm_data_size The size of the PCM data in bytes.
+ * @param sample_rate The sample rate of the PCM data.
+ * @param sample_width The sample width (bits per sample) of the PCM data.
+ * @param channel_count The number of channels in the PCM data.
+ * @return Fingerprint* Pointer to the generated fingerprint.
+ *
+ * @note The returned pointer must be freed after use. See vibra_free_fingerprint().
+ */
+Fingerprint *vibra_context_get_fingerprint_from_signed_pcm(vibra_context_t *context,
+                                                           const char *raw_pcm, int pcm_data_size,
+                                                           int sample_rate, int sample_width,
+                                                           int channel_count);
+
+/**
+ * @brief vibra_get_fingerprint_from_float_pcm() reusing the state held by a context.
+ *
+ * @param context The context, used by this thread only.
+ * @param raw_pcm The raw PCM data.
+ * @param pcm_data_size The size of the PCM data in bytes.
+ * @param sample_rate The sample rate of the PCM data.
+ * @param sample_width The sample width (bits per sample) of the PCM data.
+ * @param channel_count The number of channels in the PCM data.
+ * @return Fingerprint* Pointer to the generated fingerprint.
+ *
+ * @note The returned pointer must be freed after use. See vibra_free_fingerprint().
+ */
+Fingerprint *vibra_context_get_fingerprint_from_float_pcm(vibra_context_t *context,
+                                                          const char *raw_pcm, int pcm_data_size,
+                                                          int sample_rate, int sample_width,
+                                                          int channel_count);
+
+/**
+ * @brief vibra_get_fingerprint_from_offset() reusing the state held by a context.
+ *
+ * @param context The context, used by this thread only.
+ * @param music_file_path The path to the music file.
+ * @param offset_seconds The offset in seconds to start fingerprinting.
+ * @return Fingerprint* Pointer to the generated fingerprint.
+ *
+ * @note The returned pointer must be freed after use. See vibra_free_fingerprint().
+ */
+Fingerprint *vibra_context_get_fingerprint_from_offset(vibra_context_t *context,
+                                                       const char *music_file_path,
+                                                       unsigned int offset_seconds);
+
+/**
+ * @brief Output formats of the buffer-based entry points.
+ */
+typedef enum
+{
+    VIBRA_SIGNATURE_DATA_URI = 0, /**< Null-terminated data URI, the text of Fingerprint::uri. */
+    VIBRA_SIGNATURE_RAW = 1,      /**< The binary signature the data URI encodes. */
+} vibra_signature_format_t;
+
+/**
+ * @brief Fingerprint a music file into a caller-supplied buffer.
+ *
+ * Unlike the Fingerprint-returning functions nothing is allocated for the result, so a context
+ * and a buffer reused across calls fingerprint without allocator traffic for the output.
+ * The signature is written only if it fits; it also stays in the context either way, so a
+ * larger buffer can be filled with vibra_context_copy_signature() without fingerprinting again.
+ *
+ * @param context The context, used by this thread only.
+ * @param music_file_path The path to the music file.
+ * @param format The output format.
+ * @param buffer Where to write the signature, may be NULL to only learn its size.
+ * @param buffer_size The size of the buffer in bytes.
+ * @return size_t The size the signature needs in bytes (data URIs include the terminating
+ *         null), 0 if fingerprinting failed.
+ */
+size_t vibra_context_fingerprint_music_file(vibra_context_t *context, const char *music_file_path,
+                                            vibra_signature_format_t format, char *buffer,
+                                            size_t buffer_size);
+
+/**
+ * @brief Fingerprint WAV data into a caller-supplied buffer.
+ *
+ * See vibra_context_fingerprint_music_file() for the buffer handling.
+ *
+ * @param context The context, used by this thread only.
+ * @param raw_wav The raw WAV data.
+ * @param wav_data_size The size of the WAV data in bytes.
+ * @param format The output format.
+ * @param buffer Where to write the signature, may be NULL to only learn its size.
+ * @param buffer_size The size of the buffer in bytes.
+ * @return size_t The size the signature needs in bytes, 0 if fingerprinting failed.
+ */
+size_t vibra_context_fingerprint_wav_data(vibra_context_t *context, const char *raw_wav,
+                                          size_t wav_data_size, vibra_signature_format_t format,
+                                          char *buffer, size_t buffer_size);
+
+/**
+ * @brief Fingerprint signed PCM data into a caller-supplied buffer.
+ *
+ * See vibra_context_fingerprint_music_file() for the buffer handling.
+ *
+ * @param context The context, used by this thread only.
+ * @param raw_pcm The raw PCM data.
+ * @param pcm_data_size The size of the PCM data in bytes.
+ * @param sample_rate The sample rate of the PCM data.
+ * @param sample_width The sample width (bits per sample) of the PCM data.
+ * @param channel_count The number of channels in the PCM data.
+ * @param format The output format.
+ * @param buffer Where to write the signature, may be NULL to only learn its size.
+ * @param buffer_size The size of the buffer in bytes.
+ * @return size_t The size the signature needs in bytes, 0 if fingerprinting failed.
+ */
+size_t vibra_context_fingerprint_signed_pcm(vibra_context_t *context, const char *raw_pcm,
+                                            int pcm_data_size, int sample_rate, int sample_width,
+                                            int channel_count, vibra_signature_format_t format,
+                                            char *buffer, size_t buffer_size);
+
+/**
+ * @brief Fingerprint float PCM data into a caller-supplied buffer.
+ *
+ * See vibra_context_fingerprint_music_file() for the buffer handling.
+ *
+ * @param context The context, used by this thread only.
+ * @param raw_pcm The raw PCM data.
+ * @param pcm_data_size The size of the PCM data in bytes.
+ * @param sample_rate The sample rate of the PCM data.
+ * @param sample_width The sample width (bits per sample) of the PCM data.
+ * @param channel_count The number of channels in the PCM data.
+ * @param format The output format.
+ * @param buffer Where to write the signature, may be NULL to only learn its size.
+ * @param buffer_size The size of the buffer in bytes.
+ * @return size_t The size the signature needs in bytes, 0 if fingerprinting failed.
+ */
+size_t vibra_context_fingerprint_float_pcm(vibra_context_t *context, const char *raw_pcm,
+                                           int pcm_data_size, int sample_rate, int sample_width,
+                                           int channel_count, vibra_signature_format_t format,
+                                           char *buffer, size_t buffer_size);
+
+/**
+ * @brief Fingerprint a music file from a specific offset into a caller-supplied buffer.
+ *
+ * See vibra_context_fingerprint_music_file() for the buffer handling.
+ *
+ * @param context The context, used by this thread only.
+ * @param music_file_path The path to the music file.
+ * @param offset_seconds The offset in seconds to start fingerprinting.
+ * @param format The output format.
+ * @param buffer Where to write the signature, may be NULL to only learn its size.
+ * @param buffer_size The size of the buffer in bytes.
+ * @return size_t The size the signature needs in bytes, 0 if fingerprinting failed.
+ */
+size_t vibra_context_fingerprint_offset(vibra_context_t *context, const char *music_file_path,
+                                        unsigned int offset_seconds,
+                                        vibra_signature_format_t format, char *buffer,
+                                        size_t buffer_size);
+
+/**
+ * @brief Get the size of the last signature generated with a context.
+ *
+ * @param context The context.
+ * @param format The output format.
+ * @return size_t The size in bytes (data URIs include the terminating null), 0 if the last
+ *         fingerprinting call failed or there was none.
+ */
+size_t vibra_context_get_signature_size(vibra_context_t *context, vibra_signature_format_t format);
+
+/**
+ * @brief Copy the last signature generated with a context into a caller-supplied buffer.
+ *
+ * @param context The context.
+ * @param format The output format.
+ * @param buffer Where to write the signature, may be NULL to only learn its size.
+ * @param buffer_size The size of the buffer in bytes, nothing is written if it is too small.
+ * @return size_t The size the signature needs in bytes, 0 if there is none.
+ */
+size_t vibra_context_copy_signature(vibra_context_t *context, vibra_signature_format_t format,
+                                    char *buffer, size_t buffer_size);
+
+/**
+ * @brief Get the sample duration of the last signature generated with a context.
+ *
+ * @param context The context.
+ * @return unsigned int The sample duration in milliseconds, 0 if there is no signature.
+ */
+unsigned int vibra_context_get_sample_ms(vibra_context_t *context);
+
+/**
+ * @brief Get the offset of the last signature generated with a context.
+ *
+ * @param context The context.
+ * @return unsigned int The offset in milliseconds where fingerprinting started.
+ */
+unsigned int vibra_context_get_offset_ms(vibra_context_t *context);
+
+/**
+ * @brief Options for vibra_fingerprint_batch().
+ */
+typedef struct
+{
+    unsigned int threads; /**< Worker threads, 0 = one per hardware thread. */
+} vibra_batch_options_t;
+
+/**
+ * @brief Receives one result of vibra_fingerprint_batch().
+ *
+ * @param index Position of the file in the paths array.
+ * @param fingerprint The fingerprint, NULL on failure.
+ * @param error Why the file failed, NULL on success. Only valid during the call.
+ * @param user_data The user_data pointer given to vibra_fingerprint_batch().
+ *
+ * @note The fingerprint belongs to the callback and must be freed after use.
+ *       See vibra_free_fingerprint().
+ */
+typedef void (*vibra_batch_callback_t)(size_t index, Fingerprint *fingerprint, const char *error,
+                                       void *user_data);
+
+/**
+ * @brief Fingerprint many music files in parallel.
+ *
+ * The files are spread over a work-stealing pool of worker threads, each with its own
+ * vibra_context_t, so one file's decoding overlaps with other files' FFT work. Results are
+ * handed to the callback as soon as each file is done, in completion order.
+ *
+ * @param paths The paths of the music files.
+ * @param count The number of paths.
+ * @param options The options, NULL for the defaults.
+ * @param callback Called once per path, from the worker threads but never concurrently.
+ *                 It must not throw.
+ * @param user_data Passed through to the callback.
+ * @return size_t The number of files fingerprinted successfully.
+ *
+ * @note After vibra_cancel_decoding() the remaining files are reported as failed right away,
+ *       until vibra_resume_decoding().
+ */
+size_t vibra_fingerprint_batch(const char *const *paths, size_t count,
+                               const vibra_batch_options_t *options,
+                               vibra_batch_callback_t callback, void *user_data);
+
+/**
+ * @brief A set of worker threads running fingerprint jobs in the background.
+ *
+ * Jobs are submitted without blocking. Their results are delivered through a completion
+ * queue, which can be polled, waited on or watched through a file descriptor, or through a
+ * per-job callback.
+ */
+typedef struct VibraQueue vibra_queue_t;
+
+/**
+ * @brief Handle of a submitted job, unique within its queue. Never 0.
+ */
+typedef unsigned long long vibra_job_t;
+
+/**
+ * @brief How a job ended.
+ */
+typedef enum
+{
+    VIBRA_JOB_SUCCEEDED = 0,
+    VIBRA_JOB_FAILED = 1,
+    VIBRA_JOB_CANCELLED = 2,
+} vibra_job_status_t;
+
+/**
+ * @brief The result of a job.
+ */
+typedef struct
+{
+    vibra_job_t job;           /**< The job this is the result of. */
+    vibra_job_status_t status; /**< How the job ended. */
+    Fingerprint *fingerprint;  /**< The fingerprint if the job succeeded, NULL otherwise. */
+    void *user_data;           /**< The user_data of the job's options. */
+    char error[256];           /**< Why the job failed, empty if it succeeded. */
+} vibra_completion_t;
+
+/**
+ * @brief Receives the completion of a job, on the worker thread that ran it or, for a job
+ *        cancelled before it started, in vibra_cancel_job().
+ *
+ * @param completion The completion, only valid during the call.
+ *
+ * @note The fingerprint belongs to the callback and must be freed after use.
+ *       See vibra_free_fingerprint(). The callback must not block for long or throw.
+ */
+typedef void (*vibra_completion_callback_t)(const vibra_completion_t *completion);
+
+/**
+ * @brief Options of a job, all zero for the defaults.
+ */
+typedef struct
+{
+    int use_offset;                       /**< Nonzero: fingerprint music files at offset_seconds
+                                               instead of at the best window found. */
+    unsigned int offset_seconds;          /**< See use_offset. */
+    vibra_completion_callback_t callback; /**< Receives the completion instead of the queue. */
+    void *user_data;                      /**< Handed back in the completion. */
+} vibra_job_options_t;
+
+/**
+ * @brief Create a job queue with its worker threads.
+ *
+ * @param threads The number of worker threads, 0 for one per hardware thread.
+ * @return vibra_queue_t* Pointer to the new queue.
+ *
+ * @note The returned pointer must be freed after use. See vibra_free_queue().
+ */
+vibra_queue_t *vibra_create_queue(unsigned int threads);
+
+/**
+ * @brief Cancel every job of a queue, wait for its workers and free it.
+ *
+ * Callbacks of cancelled jobs still run, queued completions are discarded along with their
+ * fingerprints.
+ *
+ * @param queue Pointer to the queue.
+ */
+void vibra_free_queue(vibra_queue_t *queue);
+
+/**
+ * @brief Submit a music file for fingerprinting.
+ *
+ * @param queue Pointer to the queue.
+ * @param music_file_path The path to the music file, copied.
+ * @param options The job options, NULL for the defaults.
+ * @return vibra_job_t The handle of the job.
+ */
+vibra_job_t vibra_submit_music_file(vibra_queue_t *queue, const char *music_file_path,
+                                    const vibra_job_options_t *options);
+
+/**
+ * @brief Submit WAV data for fingerprinting.
+ *
+ * @param queue Pointer to the queue.
+ * @param raw_wav The raw WAV data, copied.
+ * @param wav_data_size The size of the WAV data in bytes.
+ * @param options The job options, NULL for the defaults.
+ * @return vibra_job_t The handle of the job.
+ */
+vibra_job_t vibra_submit_wav_data(vibra_queue_t *queue, const char *raw_wav,
+                                  size_t wav_data_size, const vibra_job_options_t *options);
+
+/**
+ * @brief Submit signed PCM data for fingerprinting.
+ *
+ * @param queue Pointer to the queue.
+ * @param raw_pcm The raw PCM data, copied.
+ * @param pcm_data_size The size of the PCM data in bytes.
+ * @param sample_rate The sample rate of the PCM data.
+ * @param sample_width The sample width (bits per sample) of the PCM data.
+ * @param channel_count The number of channels in the PCM data.
+ * @param options The job options, NULL for the defaults.
+ * @return vibra_job_t The handle of the job.
+ */
+vibra_job_t vibra_submit_signed_pcm(vibra_queue_t *queue, const char *raw_pcm, int pcm_data_size,
+                                    int sample_rate, int sample_width, int channel_count,
+                                    const vibra_job_options_t *options);
+
+/**
+ * @brief Submit float PCM data for fingerprinting.
+ *
+ * @param queue Pointer to the queue.
+ * @param raw_pcm The raw PCM data, copied.
+ * @param pcm_data_size The size of the PCM data in bytes.
+ * @param sample_rate The sample rate of the PCM data.
+ * @param sample_width The sample width (bits per sample) of the PCM data.
+ * @param channel_count The number of channels in the PCM data.
+ * @param options The job options, NULL for the defaults.
+ * @return vibra_job_t The handle of the job.
+ */
+vibra_job_t vibra_submit_float_pcm(vibra_queue_t *queue, const char *raw_pcm, int pcm_data_size,
+                                   int sample_rate, int sample_width, int channel_count,
+                                   const vibra_job_options_t *options);
+
+/**
+ * @brief Cancel a job.
+ *
+ * A job still waiting for a worker completes as cancelled right away. A running job has its
+ * ffmpeg/ffprobe processes killed and its FFT work stopped, and completes as cancelled shortly.
+ *
+ * @param queue Pointer to the queue.
+ * @param job The handle of the job.
+ * @return int 1 if the job was still pending, 0 if it had already completed or is unknown.
+ */
+int vibra_cancel_job(vibra_queue_t *queue, vibra_job_t job);
+
+/**
+ * @brief Take completions off the queue without blocking.
+ *
+ * @param queue Pointer to the queue.
+ * @param completions Where to store the completions.
+ * @param max_completions The number of completions that fit.
+ * @return size_t The number of completions stored, in completion order.
+ */
+size_t vibra_queue_poll(vibra_queue_t *queue, vibra_completion_t *completions,
+                        size_t max_completions);
+
+/**
+ * @brief Take completions off the queue, waiting for at least one.
+ *
+ * @param queue Pointer to the queue.
+ * @param completions Where to store the completions.
+ * @param max_completions The number of completions that fit.
+ * @param timeout_ms How long to wait at most, negative to wait without limit.
+ * @return size_t The number of completions stored, 0 on timeout.
+ */
+size_t vibra_queue_wait(vibra_queue_t *queue, vibra_completion_t *completions,
+                        size_t max_completions, int timeout_ms);
+
+/**
+ * @brief Get a file descriptor that is readable while completions are queued.
+ *
+ * Meant for epoll/poll/select based event loops: wait for it to become readable, then call
+ * vibra_queue_poll() until it returns 0. Only the queue reads from it.
+ *
+ * @param queue Pointer to the queue.
+ * @return int The file descriptor (an eventfd on Linux), -1 on Windows.
+ */
+int vibra_queue_get_fd(vibra_queue_t *queue);
+
 } // extern "C"
 
 #endif // INCLUDE_VIBRA_H_
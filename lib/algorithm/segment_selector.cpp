@@ -0,0 +1,185 @@
+#include "algorithm/segment_selector.h"
+#include <algorithm>
+#include "algorithm/signature_generator.h"
+#include "utils/hanning.h"
+
+constexpr long double PEAK_MIN_MAGNITUDE = 1.0 / 64.0; // same floor as SignatureGenerator
+constexpr double BIN_HZ = static_cast<double>(LOW_QUALITY_SAMPLE_RATE) / SEGMENT_FFT_SIZE;
+// Band edges of FrequencyBand::_250_520 ... _3500_5500
+constexpr double BAND_EDGES_HZ[SEGMENT_BAND_COUNT + 1] = {250, 520, 1450, 3500, 5500};
+constexpr int PEAK_NEIGHBOR_LOW = -10;
+constexpr int PEAK_NEIGHBOR_HIGH = 8;
+
+SegmentSelector::SegmentSelector(std::uint32_t window_seconds)
+    : window_seconds_(window_seconds), best_offset_seconds_(0), best_score_(-1.0),
+      best_window_(), fft_object_(), fft_input_(SEGMENT_FFT_SIZE, 0.0),
+      spectra_(SEGMENT_SPECTRA), spectra_blocks_(SEGMENT_SPECTRA, 0), num_spectra_(0),
+      samples_since_frame_(0), current_block_samples_(0), num_blocks_(0), block_peaks_(),
+      // one extra second: windows are scored a block late, once all their peaks are confirmed
+      recent_samples_((window_seconds + 1) * LOW_QUALITY_SAMPLE_RATE, 0)
+{
+}
+
+void SegmentSelector::Reset()
+{
+    best_offset_seconds_ = 0;
+    best_score_ = -1.0;
+    best_window_.clear();
+    // stale spectra are never read, peaks are only counted once SEGMENT_SPECTRA new ones exist
+    num_spectra_ = 0;
+    samples_since_frame_ = 0;
+    current_block_samples_ = 0;
+    num_blocks_ = 0;
+    block_peaks_.clear();
+    recent_samples_.Reset(0);
+}
+
+void SegmentSelector::FeedInput(const LowQualitySample *samples, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; i++)
+    {
+        recent_samples_.Append(samples[i]);
+
+        if (++samples_since_frame_ == SEGMENT_FFT_HOP)
+        {
+            samples_since_frame_ = 0;
+            analyzeFrame();
+        }
+        if (++current_block_samples_ == LOW_QUALITY_SAMPLE_RATE)
+        {
+            current_block_samples_ = 0;
+            num_blocks_++;
+            if (num_blocks_ > window_seconds_)
+            {
+                scoreWindow(num_blocks_ - 1, LOW_QUALITY_SAMPLE_RATE);
+            }
+        }
+    }
+}
+
+LowQualityTrack SegmentSelector::best_window()
+{
+    // the last full window never got its late turn
+    if (num_blocks_ >= window_seconds_)
+    {
+        scoreWindow(num_blocks_, current_block_samples_);
+    }
+    if (best_score_ < 0.0)
+    {
+        return recentSamples(0);
+    }
+    return best_window_;
+}
+
+void SegmentSelector::analyzeFrame()
+{
+    // Hann-windowed excerpt of the last SEGMENT_FFT_SIZE samples, like SignatureGenerator::doFFT
+    std::uint32_t size = recent_samples_.size();
+    std::uint32_t start = (recent_samples_.position() + size - SEGMENT_FFT_SIZE) % size;
+    for (std::size_t i = 0; i < SEGMENT_FFT_SIZE; i++)
+    {
+        fft_input_[i] = recent_samples_[(start + i) % size] * HANNIG_MATRIX[i];
+    }
+    std::size_t slot = num_spectra_ % SEGMENT_SPECTRA;
+    spectra_[slot] = fft_object_.RFFT(fft_input_);
+    spectra_blocks_[slot] = num_blocks_;
+    num_spectra_++;
+
+    if (num_spectra_ >= SEGMENT_SPECTRA)
+    {
+        countPeaks();
+    }
+}
+
+void SegmentSelector::countPeaks()
+{
+    std::size_t center_slot = (num_spectra_ - 1 - SEGMENT_PEAK_RADIUS) % SEGMENT_SPECTRA;
+    const Spectrum &center = spectra_[center_slot];
+    std::size_t block = spectra_blocks_[center_slot];
+    if (block_peaks_.size() <= block)
+    {
+        BandPeaks empty;
+        empty.fill(0);
+        block_peaks_.resize(block + 1, empty);
+    }
+
+    for (std::size_t band = 0; band < SEGMENT_BAND_COUNT; band++)
+    {
+        int first_bin = static_cast<int>(BAND_EDGES_HZ[band] / BIN_HZ);
+        int last_bin = static_cast<int>(BAND_EDGES_HZ[band + 1] / BIN_HZ);
+        for (int bin = first_bin; bin < last_bin; bin++)
+        {
+            long double magnitude = center[bin];
+            if (magnitude < PEAK_MIN_MAGNITUDE)
+            {
+                continue;
+            }
+
+            // a peak dominates its neighbours in frequency...
+            bool is_peak = true;
+            for (int neighbor = PEAK_NEIGHBOR_LOW; neighbor <= PEAK_NEIGHBOR_HIGH && is_peak;
+                 neighbor++)
+            {
+                is_peak = neighbor == 0 || magnitude > center[bin + neighbor];
+            }
+            // ...and the same bins (spread by one) in the surrounding frames
+            for (std::size_t slot = 0; slot < SEGMENT_SPECTRA && is_peak; slot++)
+            {
+                if (slot != center_slot)
+                {
+                    const Spectrum &other = spectra_[slot];
+                    is_peak = magnitude > std::max({other[bin - 1], other[bin], other[bin + 1]});
+                }
+            }
+            if (is_peak)
+            {
+                block_peaks_[block][band]++;
+            }
+        }
+    }
+}
+
+void SegmentSelector::scoreWindow(std::size_t end_block, std::uint32_t newer_samples)
+{
+    // Peaks SignatureGenerator is expected to find in the window; more peaks means MAX_PEAKS
+    // is reached sooner and the signature carries more to match on
+    double score = 0.0;
+    for (std::size_t block = end_block - window_seconds_; block < end_block; block++)
+    {
+        if (block >= block_peaks_.size())
+        {
+            break;
+        }
+        for (std::size_t band = 0; band < SEGMENT_BAND_COUNT; band++)
+        {
+            score += block_peaks_[block][band];
+        }
+    }
+
+    if (score > best_score_)
+    {
+        best_score_ = score;
+        best_offset_seconds_ = static_cast<std::uint32_t>(end_block - window_seconds_);
+        best_window_ = recentSamples(newer_samples);
+    }
+}
+
+LowQualityTrack SegmentSelector::recentSamples(std::uint32_t newer_samples)
+{
+    LowQualityTrack samples;
+    std::uint32_t size = recent_samples_.size();
+    std::uint32_t written = std::min(recent_samples_.num_written(), size);
+    if (written <= newer_samples)
+    {
+        return samples;
+    }
+    std::uint32_t stored = std::min(written - newer_samples, window_seconds_ * LOW_QUALITY_SAMPLE_RATE);
+    samples.reserve(stored);
+    // oldest sample first
+    std::uint32_t start = (recent_samples_.position() + 2 * size - newer_samples - stored) % size;
+    for (std::uint32_t i = 0; i < stored; i++)
+    {
+        samples.push_back(recent_samples_[(start + i) % size]);
+    }
+    return samples;
+}
@@ -0,0 +1,71 @@
+#ifndef LIB_ALGORITHM_SEGMENT_SELECTOR_H_
+#define LIB_ALGORITHM_SEGMENT_SELECTOR_H_
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "audio/downsampler.h"
+#include "utils/fft.h"
+#include "utils/ring_buffer.h"
+
+constexpr std::size_t SEGMENT_FFT_SIZE = 2048u;
+constexpr std::uint32_t SEGMENT_FFT_HOP = 128u * 4; // every fourth SignatureGenerator hop
+constexpr std::size_t SEGMENT_BAND_COUNT = 4;
+// SignatureGenerator compares a peak against roughly +-45 hops, i.e. +-11 decimated frames
+constexpr std::size_t SEGMENT_PEAK_RADIUS = 11;
+constexpr std::size_t SEGMENT_SPECTRA = 2 * SEGMENT_PEAK_RADIUS + 1;
+
+// Picks the most promising fingerprint window out of a single streamed decode.
+// A decimated copy of the SignatureGenerator front end (one FFT every fourth hop, no encoding)
+// counts the time/frequency local maxima each one-second block would yield per frequency band.
+// Windows are ranked by their peak count, i.e. by how quickly SignatureGenerator would collect
+// MAX_PEAKS from them.
+class SegmentSelector
+{
+public:
+    explicit SegmentSelector(std::uint32_t window_seconds);
+    // Forgets everything fed so far, keeping the FFT plan and buffers for the next input
+    void Reset();
+    // Appends the next decoded 16 kHz mono samples.
+    void FeedInput(const LowQualitySample *samples, std::size_t count);
+
+    // Offset of the best window from the first fed sample, in whole seconds.
+    inline std::uint32_t best_offset_seconds() const
+    {
+        return best_offset_seconds_;
+    }
+    // Samples of the best window. Holds everything fed so far while no full window is seen yet.
+    LowQualityTrack best_window();
+
+private:
+    using BandPeaks = std::array<std::uint32_t, SEGMENT_BAND_COUNT>;
+    using Spectrum = fft::FFT<SEGMENT_FFT_SIZE>::FFTOutput;
+
+    void analyzeFrame();
+    void countPeaks();
+    // Scores the window made of the window_seconds blocks before end_block
+    void scoreWindow(std::size_t end_block, std::uint32_t newer_samples);
+    LowQualityTrack recentSamples(std::uint32_t newer_samples);
+
+private:
+    std::uint32_t window_seconds_;
+    std::uint32_t best_offset_seconds_;
+    double best_score_;
+    LowQualityTrack best_window_;
+
+    fft::FFT<SEGMENT_FFT_SIZE> fft_object_;
+    std::vector<long double> fft_input_;
+    // the last SEGMENT_SPECTRA decimated spectra and the block each one belongs to;
+    // the middle one is checked for peaks, so peaks are confirmed SEGMENT_PEAK_RADIUS frames late
+    std::vector<Spectrum> spectra_;
+    std::vector<std::size_t> spectra_blocks_;
+    std::uint32_t num_spectra_;
+    std::uint32_t samples_since_frame_;
+
+    std::uint32_t current_block_samples_;
+    std::size_t num_blocks_;
+    std::vector<BandPeaks> block_peaks_;
+    RingBuffer<LowQualitySample> recent_samples_;
+};
+
+#endif // LIB_ALGORITHM_SEGMENT_SELECTOR_H_
@@ -1,12 +1,14 @@
 #include "algorithm/signature.h"
 #include <algorithm>
-#include <sstream>
+#include <cmath>
+#include <cstring>
 #include <string>
 #include "utils/base64.h"
 #include "utils/crc32.h"
 
 Signature::Signature(std::uint32_t sample_rate, std::uint32_t num_samples)
-    : sample_rate_(sample_rate), num_samples_(num_samples)
+    : sample_rate_(sample_rate), num_samples_(num_samples), square_sum_(0.0),
+      num_level_samples_(0), num_level_blocks_(0), num_silent_blocks_(0)
 {
 }
 
@@ -15,6 +17,52 @@ void Signature::Reset(std::uint32_t sampleRate, std::uint32_t num_samples)
     sample_rate_ = sampleRate;
     num_samples_ = num_samples;
     frequency_band_to_peaks_.clear();
+    square_sum_ = 0.0;
+    num_level_samples_ = 0;
+    num_level_blocks_ = 0;
+    num_silent_blocks_ = 0;
+}
+
+double Signature::rms() const
+{
+    if (num_level_samples_ == 0)
+    {
+        return 0.0;
+    }
+    return std::sqrt(square_sum_ / num_level_samples_) / 32768.0;
+}
+
+double Signature::silence_ratio() const
+{
+    if (num_level_blocks_ == 0)
+    {
+        return 1.0;
+    }
+    return static_cast<double>(num_silent_blocks_) / num_level_blocks_;
+}
+
+Signature::Levels Signature::levels() const
+{
+    Levels levels;
+    levels.square_sum = square_sum_;
+    levels.num_samples = num_level_samples_;
+    levels.num_blocks = num_level_blocks_;
+    levels.num_silent_blocks = num_silent_blocks_;
+    return levels;
+}
+
+void Signature::set_levels(const Levels &levels)
+{
+    square_sum_ = levels.square_sum;
+    num_level_samples_ = levels.num_samples;
+    num_level_blocks_ = levels.num_blocks;
+    num_silent_blocks_ = levels.num_silent_blocks;
+}
+
+std::uint32_t Signature::PeaksInBand(FrequencyBand band) const
+{
+    auto it = frequency_band_to_peaks_.find(band);
+    return it == frequency_band_to_peaks_.end() ? 0 : it->second.size();
 }
 
 std::uint32_t Signature::SumOfPeaksLength() const
@@ -27,70 +75,212 @@ std::uint32_t Signature::SumOfPeaksLength() const
     return sum;
 }
 
-std::string Signature::EncodeBase64() const
+std::vector<std::uint32_t> Signature::Landmarks() const
 {
-    RawSignatureHeader header;
+    // peaks paired with each one, and how far apart in FFT passes (8 ms each) they may be
+    constexpr std::size_t FAN_OUT = 3;
+    constexpr std::uint32_t MAX_PASS_DISTANCE = 63;
+
+    std::vector<std::uint32_t> landmarks;
+    for (const auto &pair : frequency_band_to_peaks_)
+    {
+        std::uint32_t band = static_cast<std::uint32_t>(pair.first) & 0x3;
+        const std::list<FrequencyPeak> &peaks = pair.second;
+        for (auto first = peaks.begin(); first != peaks.end(); ++first)
+        {
+            auto second = first;
+            for (std::size_t paired = 0; paired < FAN_OUT && ++second != peaks.end(); paired++)
+            {
+                std::uint32_t distance = second->fft_pass_number() - first->fft_pass_number();
+                if (distance > MAX_PASS_DISTANCE)
+                {
+                    break;
+                }
+                // whole FFT bins, the 1/64 bin corrections differ between encodings
+                std::uint32_t first_bin = (first->corrected_peak_frequency_bin() >> 6) & 0x3ff;
+                std::uint32_t second_bin = (second->corrected_peak_frequency_bin() >> 6) & 0x3ff;
+                // and pairs of passes, a peak lands one pass off when the audio starts elsewhere
+                landmarks.push_back(band << 30 | first_bin << 20 | second_bin << 10 |
+                                    distance >> 1);
+            }
+        }
+    }
+    std::sort(landmarks.begin(), landmarks.end());
+    landmarks.erase(std::unique(landmarks.begin(), landmarks.end()), landmarks.end());
+    return landmarks;
+}
+
+std::size_t Signature::peaksSize(const std::list<FrequencyPeak> &peaks)
+{
+    std::size_t size = 0;
+    std::uint32_t fft_pass_number = 0;
+    for (const auto &peak : peaks)
+    {
+        if (peak.fft_pass_number() - fft_pass_number >= 255)
+        {
+            size += 5; // 0xff marker and the absolute pass number
+        }
+        size += 5;
+        fft_pass_number = peak.fft_pass_number();
+    }
+    return size;
+}
+
+std::size_t Signature::EncodedSize() const
+{
+    std::size_t size = sizeof(RawSignatureHeader) + 8;
+    for (const auto &pair : frequency_band_to_peaks_)
+    {
+        // band tag, length and the peaks padded to four bytes
+        size += 8 + (peaksSize(pair.second) + 3) / 4 * 4;
+    }
+    return size;
+}
+
+void Signature::Encode(char *out) const
+{
+    std::size_t size = EncodedSize();
+    std::uint32_t contents_size = static_cast<std::uint32_t>(size - sizeof(RawSignatureHeader) - 8);
+
+    RawSignatureHeader header = RawSignatureHeader();
     header.magic1 = 0xcafe2580;
     header.magic2 = 0x94119c00;
     header.shifted_sample_rate_id = 3 << 27;
     header.fixed_value = ((15 << 19) + 0x40000);
     header.number_samples_plus_divided_sample_rate =
         static_cast<std::uint32_t>(num_samples_ + sample_rate_ * 0.24);
-    std::stringstream contents;
+    header.size_minus_header = contents_size + 8;
+
+    char *cursor = out + sizeof(RawSignatureHeader);
+    cursor = write_little_endian(cursor, 0x40000000u);
+    cursor = write_little_endian(cursor, contents_size + 8);
     for (const auto &pair : frequency_band_to_peaks_)
     {
         const auto &band = pair.first;
         const auto &peaks = pair.second;
+        std::size_t peaks_size = peaksSize(peaks);
 
-        std::stringstream peak_buf;
-        std::size_t fft_pass_number = 0;
+        cursor = write_little_endian(cursor, 0x60030040u + static_cast<std::uint32_t>(band));
+        cursor = write_little_endian(cursor, static_cast<std::uint32_t>(peaks_size));
 
+        std::uint32_t fft_pass_number = 0;
         for (const auto &peak : peaks)
         {
             if (peak.fft_pass_number() - fft_pass_number >= 255)
             {
-                peak_buf << "\xff";
-                write_little_endian(peak_buf, peak.fft_pass_number());
+                *cursor++ = '\xff';
+                cursor = write_little_endian(cursor, peak.fft_pass_number());
                 fft_pass_number = peak.fft_pass_number();
             }
 
-            peak_buf << static_cast<char>(peak.fft_pass_number() - fft_pass_number);
-            write_little_endian(peak_buf, peak.peak_magnitude(), 2);
-            write_little_endian(peak_buf, peak.corrected_peak_frequency_bin(), 2);
+            *cursor++ = static_cast<char>(peak.fft_pass_number() - fft_pass_number);
+            cursor = write_little_endian(cursor, peak.peak_magnitude(), 2);
+            cursor = write_little_endian(cursor, peak.corrected_peak_frequency_bin(), 2);
 
             fft_pass_number = peak.fft_pass_number();
         }
 
-        write_little_endian(contents, 0x60030040u + static_cast<std::uint32_t>(band));
-        write_little_endian(contents, static_cast<std::uint32_t>(peak_buf.str().size()));
-        contents << peak_buf.str();
-
-        for (std::size_t i = 0; i < (-peak_buf.str().size() % 4); ++i)
-            contents << '\0';
+        for (std::size_t i = 0; i < (-peaks_size % 4); ++i)
+        {
+            *cursor++ = '\0';
+        }
     }
 
-    header.size_minus_header = contents.str().size() + 8;
+    // the checksum covers everything after the crc32 field, header included
+    std::memcpy(out, &header, sizeof(header));
+    header.crc32 = crc32::crc32(out + 8, size - 8) & 0xffffffff;
+    std::memcpy(out, &header, sizeof(header));
+}
 
-    std::stringstream header_buf;
-    header_buf.write(reinterpret_cast<const char *>(&header), sizeof(header));
+std::size_t Signature::DataUriSize(std::size_t encoded_size)
+{
+    return sizeof(SIGNATURE_DATA_URI_PREFIX) - 1 + base64::encoded_size(encoded_size);
+}
 
-    write_little_endian(header_buf, 0x40000000u);
-    write_little_endian(header_buf, static_cast<std::uint32_t>(contents.str().size()) + 8);
+void Signature::WriteDataUri(const char *encoded, std::size_t encoded_size, char *out)
+{
+    std::memcpy(out, SIGNATURE_DATA_URI_PREFIX, sizeof(SIGNATURE_DATA_URI_PREFIX) - 1);
+    base64::encode(encoded, encoded_size, out + sizeof(SIGNATURE_DATA_URI_PREFIX) - 1);
+}
 
-    header_buf << contents.str();
+std::string Signature::EncodeBase64() const
+{
+    std::string encoded(EncodedSize(), '\0');
+    Encode(&encoded[0]);
 
-    const auto &header_buf_str = header_buf.str();
-    header.crc32 = crc32::crc32(header_buf_str.c_str() + 8, header_buf_str.size() - 8) & 0xffffffff;
+    std::string base64_uri(DataUriSize(encoded.size()), '\0');
+    WriteDataUri(encoded.data(), encoded.size(), &base64_uri[0]);
+    return base64_uri;
+}
 
-    header_buf.seekp(0);
-    header_buf.write(reinterpret_cast<const char *>(&header), sizeof(header));
+bool Signature::DecodePeaks(const char *data, std::size_t size)
+{
+    frequency_band_to_peaks_.clear();
+    if (size < sizeof(RawSignatureHeader) + 8)
+    {
+        return false;
+    }
+    RawSignatureHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic1 != 0xcafe2580 || header.magic2 != 0x94119c00 ||
+        header.size_minus_header != size - sizeof(RawSignatureHeader) ||
+        header.crc32 != (crc32::crc32(data + 8, size - 8) & 0xffffffff))
+    {
+        return false;
+    }
 
-    std::string header_string = header_buf.str();
+    const char *cursor = data + sizeof(RawSignatureHeader) + 8;
+    const char *end = data + size;
+    while (end - cursor >= 8)
+    {
+        std::uint32_t tag = read_little_endian<std::uint32_t>(cursor);
+        std::uint32_t peaks_size = read_little_endian<std::uint32_t>(cursor + 4);
+        cursor += 8;
+        std::size_t padded_size = (static_cast<std::size_t>(peaks_size) + 3) / 4 * 4;
+        if (padded_size > static_cast<std::size_t>(end - cursor))
+        {
+            frequency_band_to_peaks_.clear();
+            return false;
+        }
 
-    std::string base64_uri;
-    base64_uri += "data:audio/vnd.shazam.sig;base64,";
-    base64_uri += base64::encode(header_string.c_str(), header_string.size());
-    return base64_uri;
+        auto band = static_cast<FrequencyBand>(static_cast<int>(tag - 0x60030040u));
+        std::list<FrequencyPeak> &peaks = frequency_band_to_peaks_[band];
+        const char *peaks_end = cursor + peaks_size;
+        std::uint32_t fft_pass_number = 0;
+        while (cursor < peaks_end)
+        {
+            if (*cursor == '\xff')
+            {
+                if (peaks_end - cursor < 5)
+                {
+                    break;
+                }
+                fft_pass_number = read_little_endian<std::uint32_t>(cursor + 1);
+                cursor += 5;
+                continue;
+            }
+            if (peaks_end - cursor < 5)
+            {
+                break;
+            }
+            fft_pass_number += static_cast<unsigned char>(*cursor);
+            peaks.emplace_back(fft_pass_number, read_little_endian<std::uint32_t>(cursor + 1, 2),
+                               read_little_endian<std::uint32_t>(cursor + 3, 2), sample_rate_);
+            cursor += 5;
+        }
+        if (cursor != peaks_end)
+        {
+            frequency_band_to_peaks_.clear();
+            return false;
+        }
+        cursor += padded_size - peaks_size;
+    }
+    if (cursor != end)
+    {
+        frequency_band_to_peaks_.clear();
+        return false;
+    }
+    return true;
 }
 
 Signature::~Signature()
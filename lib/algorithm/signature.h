@@ -4,8 +4,8 @@
 #include <list>
 #include <map>
 #include <memory>
-#include <sstream>
 #include <string>
+#include <vector>
 #include "algorithm/frequency.h"
 
 // Prevent Structure Padding
@@ -33,9 +33,20 @@ struct RawSignatureHeader
 #pragma pack(pop)
 #endif
 
+constexpr char SIGNATURE_DATA_URI_PREFIX[] = "data:audio/vnd.shazam.sig;base64,";
+
 class Signature
 {
 public:
+    // The statistics behind rms() and silence_ratio()
+    struct Levels
+    {
+        double square_sum;
+        std::uint64_t num_samples;
+        std::uint32_t num_blocks;
+        std::uint32_t num_silent_blocks;
+    };
+
     Signature(std::uint32_t sample_rate, std::uint32_t num_samples);
     ~Signature();
     void Reset(std::uint32_t sampleRate, std::uint32_t num_samples);
@@ -56,25 +67,73 @@ public:
     {
         return frequency_band_to_peaks_;
     }
+    // Level statistics of one processed block of samples, gathered while it is fed through the FFT
+    inline void AddLevel(double square_sum, std::uint32_t num_samples, bool silent)
+    {
+        square_sum_ += square_sum;
+        num_level_samples_ += num_samples;
+        num_level_blocks_++;
+        num_silent_blocks_ += silent ? 1 : 0;
+    }
+    // Root mean square of the processed samples, relative to full scale (0..1)
+    double rms() const;
+    // Share of the processed blocks that were below the silence floor (0..1)
+    double silence_ratio() const;
+    Levels levels() const;
+    void set_levels(const Levels &levels);
+    std::uint32_t PeaksInBand(FrequencyBand band) const;
     std::uint32_t SumOfPeaksLength() const;
+    // Each peak paired with the next few in its band, as band, both frequency bins and the time
+    // between them packed into one value; sorted, without duplicates. They don't depend on
+    // where the pair sits in the signature, so two signatures of the same audio share most of
+    // them even when they start at different points.
+    std::vector<std::uint32_t> Landmarks() const;
+
+    // Size in bytes of the binary signature
+    std::size_t EncodedSize() const;
+    // Writes the EncodedSize() bytes of the binary signature to out
+    void Encode(char *out) const;
+    // Length of the data URI wrapping encoded_size bytes of binary signature
+    static std::size_t DataUriSize(std::size_t encoded_size);
+    // Writes the DataUriSize() characters of the data URI for an encoded signature to out,
+    // without a terminating null
+    static void WriteDataUri(const char *encoded, std::size_t encoded_size, char *out);
     std::string EncodeBase64() const;
+    // Replaces the peaks with those of a binary signature written by Encode(), keeping the
+    // sample rate and count. Returns false, with no peaks, if data isn't a valid signature.
+    bool DecodePeaks(const char *data, std::size_t size);
 
 private:
     template <typename T>
-    std::stringstream &write_little_endian(std::stringstream &stream, const T &&value,
-                                           size_t size = sizeof(T)) const
+    static char *write_little_endian(char *out, T value, size_t size = sizeof(T))
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            *out++ = static_cast<char>(value >> (i << 3));
+        }
+        return out;
+    }
+    template <typename T>
+    static T read_little_endian(const char *in, size_t size = sizeof(T))
     {
+        T value = 0;
         for (size_t i = 0; i < size; ++i)
         {
-            stream << static_cast<char>(value >> (i << 3));
+            value |= static_cast<T>(static_cast<unsigned char>(in[i])) << (i << 3);
         }
-        return stream;
+        return value;
     }
+    // Bytes the peaks of one band take up, before padding
+    static std::size_t peaksSize(const std::list<FrequencyPeak> &peaks);
 
 private:
     std::uint32_t sample_rate_;
     std::uint32_t num_samples_;
     std::map<FrequencyBand, std::list<FrequencyPeak>> frequency_band_to_peaks_;
+    double square_sum_;
+    std::uint64_t num_level_samples_;
+    std::uint32_t num_level_blocks_;
+    std::uint32_t num_silent_blocks_;
 };
 
 #endif // LIB_ALGORITHM_SIGNATURE_H_
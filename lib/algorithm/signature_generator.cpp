@@ -17,33 +17,50 @@ SignatureGenerator::SignatureGenerator()
 
 void SignatureGenerator::FeedInput(const LowQualityTrack &input)
 {
+    if (sample_processed_ > 0)
+    {
+        // drop samples which already went through the FFT so streamed input stays bounded
+        input_pending_processing_.erase(input_pending_processing_.begin(),
+                                        input_pending_processing_.begin() + sample_processed_);
+        sample_processed_ = 0;
+    }
     input_pending_processing_.reserve(input_pending_processing_.size() + input.size());
     input_pending_processing_.insert(input_pending_processing_.end(), input.begin(), input.end());
 }
 
 Signature SignatureGenerator::GetNextSignature()
 {
-    if (input_pending_processing_.size() - sample_processed_ < 128)
+    if (input_pending_processing_.size() - sample_processed_ < 128 &&
+        next_signature_.num_samples() == 0)
     {
         throw std::runtime_error("Not enough input to generate signature");
     }
 
-    double num_samples = static_cast<double>(next_signature_.num_samples());
-    while (input_pending_processing_.size() - sample_processed_ >= 128 &&
-           (num_samples / next_signature_.sample_rate() < max_time_seconds_ ||
-            next_signature_.SumOfPeaksLength() < MAX_PEAKS))
+    ProcessPendingInput();
+
+    Signature result = std::move(next_signature_);
+    resetSignatureGenerater();
+    return result; // RVO
+}
+
+bool SignatureGenerator::ProcessPendingInput()
+{
+    while (input_pending_processing_.size() - sample_processed_ >= 128 && !isSignatureComplete())
     {
         LowQualityTrack input(input_pending_processing_.begin() + sample_processed_,
                               input_pending_processing_.begin() + sample_processed_ + 128);
 
         processInput(input);
         sample_processed_ += 128;
-        num_samples = static_cast<double>(next_signature_.num_samples());
     }
+    return isSignatureComplete();
+}
 
-    Signature result = std::move(next_signature_);
-    resetSignatureGenerater();
-    return result; // RVO
+bool SignatureGenerator::isSignatureComplete() const
+{
+    double num_samples = static_cast<double>(next_signature_.num_samples());
+    return num_samples / next_signature_.sample_rate() >= max_time_seconds_ &&
+           next_signature_.SumOfPeaksLength() >= MAX_PEAKS;
 }
 
 void SignatureGenerator::processInput(const LowQualityTrack &input)
@@ -53,6 +70,15 @@ void SignatureGenerator::processInput(const LowQualityTrack &input)
     {
         LowQualityTrack chunk_input(input.begin() + chunk, input.begin() + chunk + 128);
 
+        double square_sum = 0.0;
+        for (LowQualitySample sample : chunk_input)
+        {
+            square_sum += static_cast<double>(sample) * sample;
+        }
+        next_signature_.AddLevel(square_sum, chunk_input.size(),
+                                 square_sum < SILENCE_RMS_THRESHOLD * SILENCE_RMS_THRESHOLD *
+                                                  chunk_input.size());
+
         doFFT(chunk_input);
         doPeakSpreadingAndRecoginzation();
     }
@@ -202,10 +228,19 @@ void SignatureGenerator::doPeakRecognition()
     }
 }
 
+void SignatureGenerator::Reset()
+{
+    input_pending_processing_.clear();
+    sample_processed_ = 0;
+    max_time_seconds_ = 3.1;
+    resetSignatureGenerater();
+}
+
 void SignatureGenerator::resetSignatureGenerater()
 {
-    next_signature_ = Signature(16000, 0);
-    samples_ring_buffer_ = RingBuffer<std::int16_t>(FFT_BUFFER_CHUNK_SIZE, 0);
-    fft_outputs_ = RingBuffer<decltype(fft_object_)::FFTOutput>(256, {0.0});
-    spread_ffts_output_ = RingBuffer<decltype(fft_object_)::FFTOutput>(256, {0.0});
+    // refill in place, the FFT ring buffers alone are several megabytes
+    next_signature_.Reset(16000, 0);
+    samples_ring_buffer_.Reset(0);
+    fft_outputs_.Reset();
+    spread_ffts_output_.Reset();
 }
@@ -8,6 +8,8 @@
 
 constexpr std::size_t MAX_PEAKS = 255u;
 constexpr std::size_t FFT_BUFFER_CHUNK_SIZE = 2048u;
+// 128-sample hops quieter than -60 dBFS count as silence in Signature::silence_ratio()
+constexpr double SILENCE_RMS_THRESHOLD = 32768.0 / 1000.0;
 
 class SignatureGenerator
 {
@@ -15,6 +17,12 @@ public:
     SignatureGenerator();
     void FeedInput(const LowQualityTrack &input);
     Signature GetNextSignature();
+    // Drops all pending input and state so the generator can be reused for unrelated audio,
+    // keeping its FFT plan and buffers
+    void Reset();
+    // Runs the pending input through the pipeline, stopping early once the signature is
+    // complete. Returns true when no more input is needed for the current signature.
+    bool ProcessPendingInput();
 
     inline void AddSampleProcessed(std::uint32_t sample_processed)
     {
@@ -27,6 +35,7 @@ public:
     }
 
 private:
+    bool isSignatureComplete() const;
     void processInput(const LowQualityTrack &input);
     void doFFT(const LowQualityTrack &input);
     void doPeakSpreadingAndRecoginzation();
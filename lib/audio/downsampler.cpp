@@ -2,6 +2,8 @@
 #include <cstring>
 #include <algorithm>
 #include <map>
+#include <memory>
+#include <stdexcept>
 #include <tuple>
 #include "audio/byte_control.h"
 #include "audio/wav.h"
@@ -18,20 +20,27 @@ LowQualityTrack Downsampler::GetLowQualityPCM(const Wav &wav, std::int32_t start
     const auto audio_format = wav.audio_format();
     const std::uint8_t *pcm_data = wav.data().get();
 
+    if (pcm_data == nullptr)
+    {
+        throw std::runtime_error("WAV data is streamed, use ReadLowQualityPCM instead");
+    }
+
     if (channels == 1 && sample_rate == LOW_QUALITY_SAMPLE_RATE &&
         bits_per_sample == LOW_QUALITY_SAMPLE_BIT_WIDTH && start_sec == 0 && end_sec == -1)
     {
         // no need to convert low quality pcm. just copy raw data
-        low_quality_pcm.resize(data_size);
-        std::memcpy(low_quality_pcm.data(), wav.data().get(), data_size);
+        low_quality_pcm.resize(data_size / sizeof(LowQualitySample));
+        std::memcpy(low_quality_pcm.data(), pcm_data,
+                    low_quality_pcm.size() * sizeof(LowQualitySample));
         return low_quality_pcm;
     }
 
     double downsample_ratio = sample_rate / static_cast<double>(LOW_QUALITY_SAMPLE_RATE);
     std::uint32_t width = bits_per_sample / 8;
-    std::uint32_t sample_count = data_size / width;
+    std::uint64_t sample_count = data_size / width;
 
-    const void *src_raw_data = pcm_data + (start_sec * sample_rate * width * channels);
+    const void *src_raw_data =
+        pcm_data + (static_cast<std::uint64_t>(start_sec) * sample_rate * width * channels);
 
     std::uint32_t new_sample_count = sample_count / channels / downsample_ratio;
 
@@ -51,6 +60,47 @@ LowQualityTrack Downsampler::GetLowQualityPCM(const Wav &wav, std::int32_t start
     return low_quality_pcm;
 }
 
+bool Downsampler::ReadLowQualityPCM(Wav *wav, LowQualityTrack *dst, std::uint32_t block_seconds)
+{
+    const auto channels = wav->num_channels();
+    const auto sample_rate = wav->sample_rate_();
+    const auto bits_per_sample = wav->bits_per_sample();
+    const std::uint32_t width = bits_per_sample / 8;
+    const std::uint64_t frame_size = wav->frame_size();
+
+    // Whole-second blocks keep the decimation grid identical to downsampling the whole track
+    // at once: sample i of second k always maps to source frame k * rate + floor(i * ratio).
+    const std::uint64_t block_frames = static_cast<std::uint64_t>(sample_rate) * block_seconds;
+    std::unique_ptr<std::uint8_t[]> block(new std::uint8_t[block_frames * frame_size]);
+
+    std::uint64_t bytes_read = wav->ReadData(block.get(), block_frames * frame_size);
+    dst->clear();
+    if (bytes_read == 0)
+    {
+        return false;
+    }
+    std::uint64_t frames_read = bytes_read / frame_size;
+
+    if (channels == 1 && sample_rate == LOW_QUALITY_SAMPLE_RATE &&
+        bits_per_sample == LOW_QUALITY_SAMPLE_BIT_WIDTH)
+    {
+        dst->resize(frames_read);
+        std::memcpy(dst->data(), block.get(), frames_read * sizeof(LowQualitySample));
+        return true;
+    }
+
+    double downsample_ratio = sample_rate / static_cast<double>(LOW_QUALITY_SAMPLE_RATE);
+    std::uint32_t new_sample_count = frames_read == block_frames
+                                         ? LOW_QUALITY_SAMPLE_RATE * block_seconds
+                                         : static_cast<std::uint32_t>(frames_read / downsample_ratio);
+    dst->resize(new_sample_count);
+
+    bool is_signed = wav->audio_format() == 1;
+    auto downsample_func = getDownsampleFunc(is_signed, bits_per_sample, channels);
+    downsample_func(dst, block.get(), downsample_ratio, new_sample_count, width, channels);
+    return true;
+}
+
 DownsampleFunc Downsampler::getDownsampleFunc(bool is_signed, std::uint32_t width,
                                               std::uint32_t channels)
 {
@@ -23,6 +23,9 @@ class Downsampler
 public:
     static LowQualityTrack GetLowQualityPCM(const Wav &wav, std::int32_t start_sec = 0,
                                             std::int32_t end_sec = -1);
+    // Streams the next block_seconds of the WAV data chunk into dst (replacing its contents).
+    // Returns false once the data chunk is exhausted.
+    static bool ReadLowQualityPCM(Wav *wav, LowQualityTrack *dst, std::uint32_t block_seconds = 1);
 
 private:
     static DownsampleFunc getDownsampleFunc(bool is_signed, std::uint32_t width,
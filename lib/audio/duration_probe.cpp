@@ -0,0 +1,472 @@
+#include "audio/duration_probe.h"
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include "audio/wav.h"
+
+constexpr std::uint64_t MPEG_PROBE_BYTES = 64 * 1024;
+// MPEG audio and ADTS have no signature, only a sync pattern random data holds often: this many
+// frames have to follow each other from the start of the stream before it counts as one
+constexpr int SYNC_MIN_FRAMES = 4;
+constexpr std::uint64_t OGG_TAIL_SEARCH_BYTES = 64 * 1024;
+constexpr int ADTS_ESTIMATE_FRAMES = 64;
+constexpr std::uint32_t ID3V1_TAG_SIZE = 128;
+
+static std::uint32_t be32(const std::uint8_t *p)
+{
+    return (static_cast<std::uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static std::uint64_t be64(const std::uint8_t *p)
+{
+    return (static_cast<std::uint64_t>(be32(p)) << 32) | be32(p + 4);
+}
+
+static std::uint32_t le16(const std::uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static std::uint32_t le32(const std::uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+}
+
+static std::uint64_t le64(const std::uint8_t *p)
+{
+    return le32(p) | (static_cast<std::uint64_t>(le32(p + 4)) << 32);
+}
+
+// Reads up to size bytes at offset, returns how many were read
+static std::size_t read_at(std::istream &stream, std::uint64_t offset, std::uint8_t *buffer,
+                           std::size_t size)
+{
+    stream.clear();
+    stream.seekg(offset, std::ios::beg);
+    stream.read(reinterpret_cast<char *>(buffer), size);
+    return static_cast<std::size_t>(stream.gcount());
+}
+
+double DurationProbe::FromFile(const std::string &path)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.is_open())
+    {
+        return 0.0;
+    }
+    stream.seekg(0, std::ios::end);
+    std::uint64_t file_size = static_cast<std::uint64_t>(stream.tellg());
+
+    std::uint8_t head[12];
+    if (read_at(stream, 0, head, sizeof(head)) != sizeof(head))
+    {
+        return 0.0;
+    }
+
+    try
+    {
+        if ((std::memcmp(head, "RIFF", 4) == 0 || std::memcmp(head, "RF64", 4) == 0 ||
+             std::memcmp(head, "BW64", 4) == 0) &&
+            std::memcmp(head + 8, "WAVE", 4) == 0)
+        {
+            return probeWav(path);
+        }
+        if (std::memcmp(head + 4, "ftyp", 4) == 0)
+        {
+            return probeMp4(stream, file_size);
+        }
+        if (std::memcmp(head, "OggS", 4) == 0)
+        {
+            return probeOgg(stream, file_size);
+        }
+
+        // MP3, FLAC and AAC files may start with an ID3v2 tag
+        std::uint64_t offset = 0;
+        if (std::memcmp(head, "ID3", 3) == 0)
+        {
+            std::uint64_t tag_size =
+                (head[6] & 0x7F) << 21 | (head[7] & 0x7F) << 14 | (head[8] & 0x7F) << 7 |
+                (head[9] & 0x7F);
+            bool has_footer = (head[5] & 0x10) != 0;
+            offset = 10 + tag_size + (has_footer ? 10 : 0);
+            if (read_at(stream, offset, head, 4) != 4)
+            {
+                return 0.0;
+            }
+        }
+
+        if (std::memcmp(head, "fLaC", 4) == 0)
+        {
+            return probeFlac(stream, offset);
+        }
+        return probeMpegAudio(stream, offset, file_size);
+    }
+    catch (const std::exception &)
+    {
+        return 0.0;
+    }
+}
+
+double DurationProbe::probeWav(const std::string &path)
+{
+    Wav wav = Wav::FromFile(path);
+    std::uint64_t bytes_per_second =
+        static_cast<std::uint64_t>(wav.sample_rate_()) * wav.frame_size();
+    if (bytes_per_second == 0)
+    {
+        return 0.0;
+    }
+    return static_cast<double>(wav.data_size()) / bytes_per_second;
+}
+
+double DurationProbe::probeFlac(std::istream &stream, std::uint64_t offset)
+{
+    // "fLaC", then the mandatory STREAMINFO metadata block
+    std::uint8_t block[4 + 34];
+    if (read_at(stream, offset + 4, block, sizeof(block)) != sizeof(block) ||
+        (block[0] & 0x7F) != 0)
+    {
+        return 0.0;
+    }
+    const std::uint8_t *info = block + 4;
+    std::uint32_t sample_rate = (info[10] << 12) | (info[11] << 4) | (info[12] >> 4);
+    std::uint64_t total_samples = (static_cast<std::uint64_t>(info[13] & 0x0F) << 32) |
+                                  be32(info + 14);
+    if (sample_rate == 0 || total_samples == 0)
+    {
+        return 0.0; // total samples are allowed to be unknown
+    }
+    return static_cast<double>(total_samples) / sample_rate;
+}
+
+// Finds the first box of the given type in [begin, end), sets its payload range
+static bool find_mp4_box(std::istream &stream, std::uint64_t begin, std::uint64_t end,
+                         const char *type, std::uint64_t *payload_begin, std::uint64_t *payload_end)
+{
+    std::uint64_t position = begin;
+    while (position + 8 <= end)
+    {
+        std::uint8_t header[16];
+        if (read_at(stream, position, header, 8) != 8)
+        {
+            return false;
+        }
+        std::uint64_t size = be32(header);
+        std::uint64_t header_size = 8;
+        if (size == 1)
+        {
+            if (read_at(stream, position + 8, header + 8, 8) != 8)
+            {
+                return false;
+            }
+            size = be64(header + 8);
+            header_size = 16;
+        }
+        else if (size == 0)
+        {
+            size = end - position; // box runs to the end of its parent
+        }
+        if (size < header_size || position + size > end)
+        {
+            return false;
+        }
+
+        if (std::memcmp(header + 4, type, 4) == 0)
+        {
+            *payload_begin = position + header_size;
+            *payload_end = position + size;
+            return true;
+        }
+        position += size;
+    }
+    return false;
+}
+
+// mvhd and mdhd share the version/timescale/duration layout
+static double read_mp4_duration_box(std::istream &stream, std::uint64_t payload)
+{
+    std::uint8_t box[32];
+    std::size_t size = read_at(stream, payload, box, sizeof(box));
+    if (size < 24)
+    {
+        return 0.0;
+    }
+    std::uint32_t timescale;
+    std::uint64_t duration;
+    if (box[0] == 1)
+    {
+        if (size < 32)
+        {
+            return 0.0;
+        }
+        timescale = be32(box + 20);
+        duration = be64(box + 24);
+    }
+    else
+    {
+        timescale = be32(box + 12);
+        duration = be32(box + 16);
+        if (duration == 0xFFFFFFFF)
+        {
+            return 0.0;
+        }
+    }
+    if (timescale == 0)
+    {
+        return 0.0;
+    }
+    return static_cast<double>(duration) / timescale;
+}
+
+double DurationProbe::probeMp4(std::istream &stream, std::uint64_t file_size)
+{
+    std::uint64_t moov_begin, moov_end;
+    if (!find_mp4_box(stream, 0, file_size, "moov", &moov_begin, &moov_end))
+    {
+        return 0.0;
+    }
+
+    std::uint64_t begin, end;
+    if (find_mp4_box(stream, moov_begin, moov_end, "mvhd", &begin, &end))
+    {
+        double duration = read_mp4_duration_box(stream, begin);
+        if (duration > 0.0)
+        {
+            return duration;
+        }
+    }
+
+    // fragmented or sloppily muxed files: fall back to the first track's media header
+    std::uint64_t trak_begin, trak_end, mdia_begin, mdia_end;
+    if (find_mp4_box(stream, moov_begin, moov_end, "trak", &trak_begin, &trak_end) &&
+        find_mp4_box(stream, trak_begin, trak_end, "mdia", &mdia_begin, &mdia_end) &&
+        find_mp4_box(stream, mdia_begin, mdia_end, "mdhd", &begin, &end))
+    {
+        return read_mp4_duration_box(stream, begin);
+    }
+    return 0.0;
+}
+
+double DurationProbe::probeOgg(std::istream &stream, std::uint64_t file_size)
+{
+    // The first page carries the codec identification header
+    std::uint8_t page[27 + 255 + 19];
+    std::size_t size = read_at(stream, 0, page, sizeof(page));
+    if (size < 27 || size < 27u + page[26] + 19)
+    {
+        return 0.0;
+    }
+    std::uint32_t serial = le32(page + 14);
+    const std::uint8_t *packet = page + 27 + page[26];
+
+    std::uint32_t sample_rate = 0;
+    std::uint64_t pre_skip = 0;
+    if (std::memcmp(packet, "\x01vorbis", 7) == 0)
+    {
+        sample_rate = le32(packet + 12);
+    }
+    else if (std::memcmp(packet, "OpusHead", 8) == 0)
+    {
+        sample_rate = 48000; // Opus granule positions always count 48 kHz samples
+        pre_skip = le16(packet + 10);
+    }
+    if (sample_rate == 0)
+    {
+        return 0.0;
+    }
+
+    // The granule position of the last page of the stream is its length in samples
+    std::uint64_t tail_size = std::min(file_size, OGG_TAIL_SEARCH_BYTES);
+    std::vector<std::uint8_t> tail(tail_size);
+    tail_size = read_at(stream, file_size - tail_size, tail.data(), tail.size());
+    for (std::size_t i = tail_size >= 27 ? tail_size - 27 + 1 : 0; i-- > 0;)
+    {
+        if (std::memcmp(&tail[i], "OggS", 4) != 0 || le32(&tail[i + 14]) != serial)
+        {
+            continue;
+        }
+        std::uint64_t granule = le64(&tail[i + 6]);
+        if (granule == ~0ULL)
+        {
+            continue; // no packet ends on this page
+        }
+        if (granule <= pre_skip)
+        {
+            return 0.0;
+        }
+        return static_cast<double>(granule - pre_skip) / sample_rate;
+    }
+    return 0.0;
+}
+
+static const std::uint16_t MPEG1_BITRATES[3][16] = {
+    {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0}, // Layer I
+    {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},    // Layer II
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0},     // Layer III
+};
+static const std::uint16_t MPEG2_BITRATES[2][16] = {
+    {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0}, // Layer I
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},      // Layer II & III
+};
+static const std::uint32_t MPEG_SAMPLE_RATES[3] = {44100, 48000, 32000};
+static const std::uint32_t ADTS_SAMPLE_RATES[13] = {96000, 88200, 64000, 48000, 44100,
+                                                    32000, 24000, 22050, 16000, 12000,
+                                                    11025, 8000,  7350};
+
+struct MpegFrameHeader
+{
+    bool mpeg1;
+    int layer; // 1, 2 or 3
+    std::uint32_t bitrate; // bits per second
+    std::uint32_t sample_rate;
+    std::uint32_t samples_per_frame;
+    std::uint32_t frame_size;
+    bool mono;
+};
+
+static bool parse_mpeg_frame_header(const std::uint8_t *p, MpegFrameHeader *header)
+{
+    if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0)
+    {
+        return false;
+    }
+    int version = (p[1] >> 3) & 0x03; // 0 = 2.5, 2 = 2, 3 = 1
+    int layer_bits = (p[1] >> 1) & 0x03;
+    int bitrate_index = p[2] >> 4;
+    int rate_index = (p[2] >> 2) & 0x03;
+    if (version == 1 || layer_bits == 0 || bitrate_index == 0 || bitrate_index == 15 ||
+        rate_index == 3)
+    {
+        return false;
+    }
+
+    header->mpeg1 = version == 3;
+    header->layer = 4 - layer_bits;
+    header->bitrate = 1000 * (header->mpeg1
+                                  ? MPEG1_BITRATES[header->layer - 1][bitrate_index]
+                                  : MPEG2_BITRATES[header->layer == 1 ? 0 : 1][bitrate_index]);
+    header->sample_rate = MPEG_SAMPLE_RATES[rate_index] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+    header->mono = (p[3] >> 6) == 3;
+
+    std::uint32_t padding = (p[2] >> 1) & 0x01;
+    if (header->layer == 1)
+    {
+        header->samples_per_frame = 384;
+        header->frame_size = (12 * header->bitrate / header->sample_rate + padding) * 4;
+    }
+    else
+    {
+        header->samples_per_frame = (header->layer == 3 && !header->mpeg1) ? 576 : 1152;
+        header->frame_size =
+            header->samples_per_frame / 8 * header->bitrate / header->sample_rate + padding;
+    }
+    return true;
+}
+
+double DurationProbe::probeMpegAudio(std::istream &stream, std::uint64_t offset,
+                                     std::uint64_t file_size)
+{
+    std::vector<std::uint8_t> buffer(MPEG_PROBE_BYTES);
+    std::size_t size = read_at(stream, offset, buffer.data(), buffer.size());
+    if (size < 4 || buffer[0] != 0xFF)
+    {
+        return 0.0; // the stream starts at offset or it is something else
+    }
+    // ADTS shares the sync word but has the layer bits set to 0
+    if ((buffer[1] & 0xF6) == 0xF0)
+    {
+        return probeAdts(stream, offset, file_size);
+    }
+
+    MpegFrameHeader header;
+    if (!parse_mpeg_frame_header(&buffer[0], &header))
+    {
+        return 0.0;
+    }
+    std::size_t position = 0;
+    for (int frame = 0; frame < SYNC_MIN_FRAMES; frame++)
+    {
+        MpegFrameHeader next;
+        if (position + 4 > size || !parse_mpeg_frame_header(&buffer[position], &next) ||
+            next.mpeg1 != header.mpeg1 || next.layer != header.layer ||
+            next.sample_rate != header.sample_rate)
+        {
+            return 0.0;
+        }
+        position += next.frame_size;
+    }
+
+    // VBR files carry the frame count in a Xing/Info or VBRI header in the first frame
+    std::uint64_t frames = 0;
+    std::size_t side_info = header.mpeg1 ? (header.mono ? 17 : 32) : (header.mono ? 9 : 17);
+    std::size_t xing = 4 + side_info;
+    std::size_t vbri = 4 + 32;
+    if (xing + 12 <= size && (std::memcmp(&buffer[xing], "Xing", 4) == 0 ||
+                              std::memcmp(&buffer[xing], "Info", 4) == 0))
+    {
+        if (be32(&buffer[xing + 4]) & 0x01)
+        {
+            frames = be32(&buffer[xing + 8]);
+        }
+    }
+    else if (vbri + 18 <= size && std::memcmp(&buffer[vbri], "VBRI", 4) == 0)
+    {
+        frames = be32(&buffer[vbri + 14]);
+    }
+    if (frames > 0)
+    {
+        return static_cast<double>(frames) * header.samples_per_frame / header.sample_rate;
+    }
+
+    // otherwise assume constant bitrate
+    std::uint64_t audio_end = file_size;
+    std::uint8_t tag[3];
+    if (file_size >= ID3V1_TAG_SIZE &&
+        read_at(stream, file_size - ID3V1_TAG_SIZE, tag, 3) == 3 &&
+        std::memcmp(tag, "TAG", 3) == 0)
+    {
+        audio_end -= ID3V1_TAG_SIZE;
+    }
+    if (audio_end <= offset)
+    {
+        return 0.0;
+    }
+    return static_cast<double>(audio_end - offset) * 8 / header.bitrate;
+}
+
+double DurationProbe::probeAdts(std::istream &stream, std::uint64_t offset,
+                                std::uint64_t file_size)
+{
+    // ADTS has no global header: average the first frames and extrapolate over the file
+    std::uint64_t position = offset;
+    std::uint64_t samples = 0;
+    std::uint32_t sample_rate = 0;
+    int frame = 0;
+    for (; frame < ADTS_ESTIMATE_FRAMES; frame++)
+    {
+        std::uint8_t header[7];
+        if (read_at(stream, position, header, sizeof(header)) != sizeof(header) ||
+            header[0] != 0xFF || (header[1] & 0xF6) != 0xF0)
+        {
+            break;
+        }
+        std::uint32_t rate_index = (header[2] >> 2) & 0x0F;
+        std::uint32_t frame_size = ((header[3] & 0x03) << 11) | (header[4] << 3) | (header[5] >> 5);
+        if (rate_index >= 13 || frame_size < sizeof(header) ||
+            (sample_rate != 0 && ADTS_SAMPLE_RATES[rate_index] != sample_rate))
+        {
+            break;
+        }
+        sample_rate = ADTS_SAMPLE_RATES[rate_index];
+        samples += 1024 * ((header[6] & 0x03) + 1);
+        position += frame_size;
+    }
+
+    if (frame < SYNC_MIN_FRAMES || position <= offset)
+    {
+        return 0.0;
+    }
+    double seconds_read = static_cast<double>(samples) / sample_rate;
+    return seconds_read * (file_size - offset) / (position - offset);
+}
@@ -0,0 +1,28 @@
+#ifndef LIB_AUDIO_DURATION_PROBE_H_
+#define LIB_AUDIO_DURATION_PROBE_H_
+
+#include <cstdint>
+#include <istream>
+#include <string>
+
+// Reads the duration of common audio containers straight from their headers, so no ffprobe
+// process is needed for them. Supported: WAV/RF64/BW64, MP3 (Xing/Info/VBRI or a CBR estimate),
+// FLAC, MP4/M4A, Ogg Vorbis/Opus and an ADTS AAC estimate.
+class DurationProbe
+{
+public:
+    DurationProbe() = delete;
+    // Returns the duration in seconds, 0 if the format is not recognised or the headers are broken.
+    static double FromFile(const std::string &path);
+
+private:
+    static double probeWav(const std::string &path);
+    static double probeFlac(std::istream &stream, std::uint64_t offset);
+    static double probeMp4(std::istream &stream, std::uint64_t file_size);
+    static double probeOgg(std::istream &stream, std::uint64_t file_size);
+    static double probeMpegAudio(std::istream &stream, std::uint64_t offset,
+                                 std::uint64_t file_size);
+    static double probeAdts(std::istream &stream, std::uint64_t offset, std::uint64_t file_size);
+};
+
+#endif // LIB_AUDIO_DURATION_PROBE_H_
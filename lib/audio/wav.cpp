@@ -2,29 +2,74 @@
 #include <cassert>
 #include <cmath>
 #include <cstring>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
 
+constexpr std::uint32_t RF64_SIZE_PLACEHOLDER = 0xFFFFFFFF;
+
+// Read-only streambuf over a caller-owned buffer, so raw WAVs are parsed without a copy.
+class MemoryStreamBuf : public std::streambuf
+{
+public:
+    MemoryStreamBuf(const char *data, std::uint64_t size)
+    {
+        char *begin = const_cast<char *>(data);
+        setg(begin, begin, begin + size);
+    }
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override
+    {
+        off_type base = 0;
+        if (dir == std::ios_base::cur)
+        {
+            base = gptr() - eback();
+        }
+        else if (dir == std::ios_base::end)
+        {
+            base = egptr() - eback();
+        }
+        return seekpos(base + off, std::ios_base::in);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode) override
+    {
+        if (pos < 0 || pos > egptr() - eback())
+        {
+            return pos_type(off_type(-1));
+        }
+        setg(eback(), eback() + static_cast<off_type>(pos), egptr());
+        return pos;
+    }
+};
+
 Wav Wav::FromFile(const std::string &wav_file_path)
 {
     Wav wav;
     wav.wav_file_path_ = wav_file_path;
-    std::ifstream stream(wav_file_path, std::ios::binary);
-    if (!stream.is_open())
+    std::unique_ptr<std::ifstream> stream(new std::ifstream(wav_file_path, std::ios::binary));
+    if (!stream->is_open())
     {
         throw std::runtime_error("Failed to open WAV file");
     }
-    wav.readWavFileBuffer(stream);
+    stream->seekg(0, std::ios::end);
+    std::uint64_t stream_size = static_cast<std::uint64_t>(stream->tellg());
+    stream->seekg(0, std::ios::beg);
+
+    wav.readWavFileBuffer(*stream, stream_size, false);
+    wav.stream_ = std::move(stream);
     return wav;
 }
 
-Wav Wav::FromRawWav(const char *raw_wav, std::uint32_t raw_wav_size)
+Wav Wav::FromRawWav(const char *raw_wav, std::uint64_t raw_wav_size)
 {
     Wav wav;
-    std::istringstream stream(std::string(raw_wav, raw_wav_size));
-    wav.readWavFileBuffer(stream);
+    MemoryStreamBuf buffer(raw_wav, raw_wav_size);
+    std::istream stream(&buffer);
+    wav.readWavFileBuffer(stream, raw_wav_size, true);
     return wav;
 }
 
@@ -46,11 +91,43 @@ Wav::~Wav()
 {
 }
 
+std::uint64_t Wav::ReadData(std::uint8_t *buffer, std::uint64_t max_bytes)
+{
+    std::uint64_t frame = std::max(frame_size(), 1u);
+    std::uint64_t bytes = std::min(max_bytes, data_size_ - data_read_);
+    bytes -= bytes % frame;
+    if (bytes == 0)
+    {
+        return 0;
+    }
+
+    if (data_)
+    {
+        std::memcpy(buffer, data_.get() + data_read_, bytes);
+    }
+    else
+    {
+        stream_->seekg(data_offset_ + data_read_, std::ios::beg);
+        stream_->read(reinterpret_cast<char *>(buffer), bytes);
+        bytes = static_cast<std::uint64_t>(stream_->gcount());
+        bytes -= bytes % frame;
+        if (bytes == 0)
+        {
+            // file shrank under us, treat it as the end of data
+            data_size_ = data_read_;
+            return 0;
+        }
+    }
+    data_read_ += bytes;
+    return bytes;
+}
+
 Wav Wav::fromPCM(const char *raw_pcm, std::uint32_t raw_pcm_size, AudioFormat audio_format,
                  std::uint32_t sample_rate, std::uint32_t sample_width, std::uint32_t channel_count)
 {
     Wav wav;
-    wav.header_.file_size = sizeof(WavHeader) + sizeof(FmtSubchunk) + 8 + raw_pcm_size;
+    wav.file_size_ = sizeof(WavHeader) + sizeof(FmtSubchunk) + 8 + raw_pcm_size;
+    wav.header_.file_size = static_cast<std::uint32_t>(wav.file_size_);
     wav.fmt_.audio_format = static_cast<std::uint16_t>(audio_format);
     wav.fmt_.num_channels = channel_count;
     wav.fmt_.sample_rate = sample_rate;
@@ -63,47 +140,96 @@ Wav Wav::fromPCM(const char *raw_pcm, std::uint32_t raw_pcm_size, AudioFormat au
     return wav;
 }
 
-void Wav::readWavFileBuffer(std::istream &stream)
+void Wav::readWavFileBuffer(std::istream &stream, std::uint64_t stream_size, bool load_data)
 {
     stream.read(reinterpret_cast<char *>(&header_), sizeof(WavHeader));
+    if (!stream || strncmp(header_.wave_header, "WAVE", 4) != 0)
+    {
+        throw std::runtime_error("Invalid WAV file");
+    }
 
-    const auto kSubchunkLimit = 10;
+    // RF64 and BW64 keep the real sizes in a ds64 chunk and put 0xFFFFFFFF in the 32-bit fields
+    bool is_rf64 = strncmp(header_.riff_header, "RF64", 4) == 0 ||
+                   strncmp(header_.riff_header, "BW64", 4) == 0;
+    if (!is_rf64 && strncmp(header_.riff_header, "RIFF", 4) != 0)
+    {
+        throw std::runtime_error("Invalid WAV file");
+    }
+    file_size_ = header_.file_size;
+    std::uint64_t ds64_data_size = 0;
 
     bool data_chunk_found = false;
     bool fmt_chunk_found = false;
-    for (int i = 0; i < kSubchunkLimit && stream.tellg() < header_.file_size - 8; i++)
+    char subchunk_id[4];
+    std::uint32_t subchunk_size;
+    while (stream.read(subchunk_id, 4) &&
+           stream.read(reinterpret_cast<char *>(&subchunk_size), 4))
     {
-        char subchunk_id[4];
-        stream.read(subchunk_id, 4);
-
-        std::uint32_t subchunk_size;
-        stream.read(reinterpret_cast<char *>(&subchunk_size), 4);
+        std::uint64_t chunk_size = subchunk_size;
+        std::uint64_t chunk_start = static_cast<std::uint64_t>(stream.tellg());
 
         if (strncmp(subchunk_id, "data", 4) == 0)
         {
-            data_size_ = subchunk_size;
-            data_.reset(new std::uint8_t[data_size_]);
-            stream.read(reinterpret_cast<char *>(data_.get()), data_size_);
+            if (is_rf64 && subchunk_size == RF64_SIZE_PLACEHOLDER)
+            {
+                chunk_size = ds64_data_size;
+            }
+            // recorders that never finalized the header leave a bogus size behind
+            chunk_size = std::min(chunk_size, stream_size - chunk_start);
+
+            data_offset_ = chunk_start;
+            data_size_ = chunk_size;
             data_chunk_found = true;
+            if (load_data)
+            {
+                data_.reset(new std::uint8_t[data_size_]);
+                stream.read(reinterpret_cast<char *>(data_.get()), data_size_);
+            }
         }
         else if (strncmp(subchunk_id, "fmt ", 4) == 0)
         {
-            stream.read(reinterpret_cast<char *>(&fmt_), sizeof(FmtSubchunk));
+            readFmtSubchunk(stream, chunk_size);
             fmt_chunk_found = true;
         }
-        else
+        else if (strncmp(subchunk_id, "ds64", 4) == 0)
         {
-            stream.seekg(subchunk_size, std::ios::cur);
+            std::uint64_t riff_size = 0;
+            stream.read(reinterpret_cast<char *>(&riff_size), 8);
+            stream.read(reinterpret_cast<char *>(&ds64_data_size), 8);
+            file_size_ = riff_size;
         }
 
         if (data_chunk_found && fmt_chunk_found)
         {
             return; // read wav successfully
         }
+
+        // chunks are word aligned
+        stream.clear();
+        stream.seekg(chunk_start + chunk_size + (chunk_size & 1), std::ios::beg);
     }
 
-    if (!data_chunk_found || !fmt_chunk_found)
+    throw std::runtime_error("Invalid WAV file");
+}
+
+void Wav::readFmtSubchunk(std::istream &stream, std::uint64_t subchunk_size)
+{
+    if (subchunk_size < sizeof(FmtSubchunk))
     {
-        throw std::runtime_error("Invalid WAV file");
+        throw std::runtime_error("Invalid WAV fmt chunk");
+    }
+    stream.read(reinterpret_cast<char *>(&fmt_), sizeof(FmtSubchunk));
+
+    if (fmt_.audio_format == static_cast<std::uint16_t>(AudioFormat::EXTENSIBLE) &&
+        subchunk_size >= sizeof(FmtSubchunk) + sizeof(FmtExtension))
+    {
+        FmtExtension extension;
+        stream.read(reinterpret_cast<char *>(&extension), sizeof(FmtExtension));
+        fmt_.audio_format = extension.sub_format[0] | (extension.sub_format[1] << 8);
+    }
+
+    if (fmt_.num_channels == 0 || fmt_.bits_per_sample == 0 || fmt_.bits_per_sample % 8 != 0)
+    {
+        throw std::runtime_error("Unsupported WAV sample format");
     }
 }
@@ -1,13 +1,14 @@
 #ifndef LIB_AUDIO_WAV_H_
 #define LIB_AUDIO_WAV_H_
 
+#include <istream>
 #include <memory>
 #include <string>
 #include "audio/byte_control.h"
 
 struct WavHeader
 {
-    char riff_header[4]; // "RIFF"
+    char riff_header[4]; // "RIFF", "RF64" or "BW64"
     std::uint32_t file_size;
     char wave_header[4]; // "WAVE"
 };
@@ -22,10 +23,20 @@ struct FmtSubchunk
     std::uint16_t bits_per_sample;
 };
 
+// Trailing part of a WAVE_FORMAT_EXTENSIBLE fmt chunk
+struct FmtExtension
+{
+    std::uint16_t extension_size;
+    std::uint16_t valid_bits_per_sample;
+    std::uint32_t channel_mask;
+    std::uint8_t sub_format[16]; // GUID, the first two bytes hold the actual format tag
+};
+
 enum class AudioFormat
 {
     PCM_INTEGER = 1,
     PCM_FLOAT = 3,
+    EXTENSIBLE = 0xFFFE,
 };
 
 class Wav
@@ -33,8 +44,9 @@ class Wav
 public:
     Wav(Wav &&) = default;
     Wav(const Wav &) = delete;
+    // Only the headers are read up front, the data chunk is streamed with ReadData().
     static Wav FromFile(const std::string &wav_file_path);
-    static Wav FromRawWav(const char *raw_wav, std::uint32_t raw_wav_size);
+    static Wav FromRawWav(const char *raw_wav, std::uint64_t raw_wav_size);
     static Wav FromSignedPCM(const char *raw_pcm, std::uint32_t raw_pcm_size,
                              std::uint32_t sample_rate, std::uint32_t sample_width,
                              std::uint32_t channel_count);
@@ -43,6 +55,10 @@ public:
                             std::uint32_t channel_count);
     ~Wav();
 
+    // Copies the next whole frames of the data chunk (at most max_bytes) into buffer.
+    // Returns the number of bytes copied, 0 at the end of the data chunk.
+    std::uint64_t ReadData(std::uint8_t *buffer, std::uint64_t max_bytes);
+
     inline std::uint16_t audio_format() const
     {
         return fmt_.audio_format;
@@ -59,14 +75,19 @@ public:
     {
         return fmt_.bits_per_sample;
     }
-    inline std::uint32_t data_size() const
+    inline std::uint32_t frame_size() const
+    {
+        return fmt_.num_channels * (fmt_.bits_per_sample / 8);
+    }
+    inline std::uint64_t data_size() const
     {
         return data_size_;
     }
-    inline std::uint32_t file_size() const
+    inline std::uint64_t file_size() const
     {
-        return header_.file_size;
+        return file_size_;
     }
+    // nullptr for WAVs opened with FromFile(), use ReadData() instead.
     inline const std::unique_ptr<std::uint8_t[]> &data() const
     {
         return data_;
@@ -77,14 +98,19 @@ private:
     static Wav fromPCM(const char *raw_pcm, std::uint32_t raw_pcm_size, AudioFormat audio_format,
                        std::uint32_t sample_rate, std::uint32_t sample_width,
                        std::uint32_t channel_count);
-    void readWavFileBuffer(std::istream &stream);
+    void readWavFileBuffer(std::istream &stream, std::uint64_t stream_size, bool load_data);
+    void readFmtSubchunk(std::istream &stream, std::uint64_t subchunk_size);
 
 private:
     WavHeader header_;
     FmtSubchunk fmt_;
     std::string wav_file_path_;
-    std::uint32_t data_size_;
+    std::uint64_t file_size_ = 0;
+    std::uint64_t data_offset_ = 0;
+    std::uint64_t data_size_ = 0;
+    std::uint64_t data_read_ = 0;
     std::unique_ptr<std::uint8_t[]> data_;
+    std::unique_ptr<std::istream> stream_;
 };
 
 #endif // LIB_AUDIO_WAV_H_
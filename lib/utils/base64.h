@@ -8,9 +8,15 @@ namespace base64
 static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
                                    "abcdefghijklmnopqrstuvwxyz"
                                    "0123456789+/";
-std::string encode(const char *bytes_to_encode, unsigned int in_len)
+
+inline std::size_t encoded_size(std::size_t in_len)
+{
+    return (in_len + 2) / 3 * 4;
+}
+
+// Writes the encoded_size(in_len) characters of the padded encoding to out
+inline void encode(const char *bytes_to_encode, std::size_t in_len, char *out)
 {
-    std::string ret;
     int i = 0;
     int j = 0;
     unsigned char char_array_3[3];
@@ -27,7 +33,7 @@ std::string encode(const char *bytes_to_encode, unsigned int in_len)
             char_array_4[3] = char_array_3[2] & 0x3f;
 
             for (i = 0; (i < 4); i++)
-                ret += base64_chars[char_array_4[i]];
+                *out++ = base64_chars[char_array_4[i]];
             i = 0;
         }
     }
@@ -42,12 +48,17 @@ std::string encode(const char *bytes_to_encode, unsigned int in_len)
         char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
 
         for (j = 0; (j < i + 1); j++)
-            ret += base64_chars[char_array_4[j]];
+            *out++ = base64_chars[char_array_4[j]];
 
         while ((i++ < 3))
-            ret += '=';
+            *out++ = '=';
     }
+}
 
+inline std::string encode(const char *bytes_to_encode, unsigned int in_len)
+{
+    std::string ret(encoded_size(in_len), '\0');
+    encode(bytes_to_encode, in_len, &ret[0]);
     return ret;
 }
 } // namespace base64
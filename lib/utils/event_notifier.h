@@ -0,0 +1,127 @@
+#ifndef LIB_UTILS_EVENT_NOTIFIER_H_
+#define LIB_UTILS_EVENT_NOTIFIER_H_
+
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef __linux__
+    #include <sys/eventfd.h>
+    #include <unistd.h>
+#elif !defined(_WIN32)
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace event_notifier
+{
+
+// A file descriptor that is readable while the notifier is signalled, for epoll/poll/select
+// based event loops. An eventfd on Linux, a pipe on other POSIX systems; Windows has none and
+// fd() returns -1.
+class EventNotifier
+{
+public:
+    EventNotifier();
+    EventNotifier(const EventNotifier &) = delete;
+    EventNotifier &operator=(const EventNotifier &) = delete;
+    ~EventNotifier();
+
+    // Makes fd() readable. Must not be called again before Clear().
+    void Signal();
+    // Makes fd() unreadable again
+    void Clear();
+
+    inline int fd() const
+    {
+        return read_fd_;
+    }
+
+private:
+    int read_fd_;
+    int write_fd_;
+};
+
+#ifdef __linux__
+
+inline EventNotifier::EventNotifier() : read_fd_(-1), write_fd_(-1)
+{
+    read_fd_ = write_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (read_fd_ < 0)
+    {
+        throw std::runtime_error("eventfd failed");
+    }
+}
+
+inline EventNotifier::~EventNotifier()
+{
+    close(read_fd_);
+}
+
+#elif !defined(_WIN32)
+
+inline EventNotifier::EventNotifier() : read_fd_(-1), write_fd_(-1)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        throw std::runtime_error("pipe failed");
+    }
+    for (int fd : fds)
+    {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    read_fd_ = fds[0];
+    write_fd_ = fds[1];
+}
+
+inline EventNotifier::~EventNotifier()
+{
+    close(read_fd_);
+    close(write_fd_);
+}
+
+#else
+
+inline EventNotifier::EventNotifier() : read_fd_(-1), write_fd_(-1)
+{
+}
+
+inline EventNotifier::~EventNotifier()
+{
+}
+
+#endif
+
+#ifndef _WIN32
+
+inline void EventNotifier::Signal()
+{
+    // eventfd wants exactly eight bytes, a pipe takes them as well
+    std::uint64_t one = 1;
+    ssize_t written = write(write_fd_, &one, sizeof(one));
+    (void)written; // a full counter or pipe is still readable
+}
+
+inline void EventNotifier::Clear()
+{
+    std::uint64_t value;
+    ssize_t got = read(read_fd_, &value, sizeof(value));
+    (void)got; // EAGAIN: nothing to clear
+}
+
+#else
+
+inline void EventNotifier::Signal()
+{
+}
+
+inline void EventNotifier::Clear()
+{
+}
+
+#endif
+
+} // namespace event_notifier
+
+#endif // LIB_UTILS_EVENT_NOTIFIER_H_
@@ -2,20 +2,16 @@
 #define LIB_UTILS_FFMPEG_H_
 
 #include <cstdlib>
-#include <array>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
 #include "audio/downsampler.h"
-
-#ifdef _MSC_VER
-    #define PROCESS_OPEN _popen
-    #define PROCESS_CLOSE _pclose
-#else
-    #define PROCESS_OPEN popen
-    #define PROCESS_CLOSE pclose
-#endif
+#include "utils/subprocess.h"
 
 namespace ffmpeg
 {
@@ -23,21 +19,72 @@ namespace ffmpeg
 constexpr const char *DEFAULT_FFMPEG_PATHS[] = {"ffmpeg", "ffmpeg.exe"};
 constexpr const char FFMPEG_PATH_ENV[] = "FFMPEG_PATH";
 
+// Receives decoded 16 kHz mono samples in order
+using PcmSink = std::function<void(const LowQualitySample *samples, std::size_t count)>;
+
 class FFmpegWrapper
 {
 public:
     FFmpegWrapper() = delete;
     static LowQualityTrack ConvertToLowQaulityPcm(
-        std::string input_file, std::uint32_t start_seconds, std::uint32_t duration_seconds);
+        std::string input_file, std::uint32_t start_seconds, std::uint32_t duration_seconds,
+        const subprocess::Options &options = subprocess::Options());
+    // Decodes [start_seconds, start_seconds + duration_seconds) and hands the samples to sink as
+    // they arrive, so arbitrarily long ranges are processed in constant memory.
+    static void StreamLowQualityPcm(const std::string &input_file, std::uint32_t start_seconds,
+                                    std::uint32_t duration_seconds, const PcmSink &sink,
+                                    const subprocess::Options &options = subprocess::Options());
 
 private:
+    static const std::string &requireFFmpegPath();
+    static std::vector<std::string> lowQualityPcmArgs(const std::string &input_file,
+                                                      std::uint32_t start_seconds,
+                                                      std::uint32_t duration_seconds);
+    static void appendPcmOutputArgs(std::vector<std::string> *args);
+    static LowQualityTrack runPcmCommand(const std::vector<std::string> &args,
+                                         std::size_t expected_samples,
+                                         const subprocess::Options &options);
     static std::string getFFmpegPath();
     static bool isWindows();
-    static std::string escapeShellArg(const std::string& arg);
 };
 
 LowQualityTrack FFmpegWrapper::ConvertToLowQaulityPcm(
-    std::string input_file, std::uint32_t start_seconds, std::uint32_t duration_seconds)
+    std::string input_file, std::uint32_t start_seconds, std::uint32_t duration_seconds,
+    const subprocess::Options &options)
+{
+    return runPcmCommand(lowQualityPcmArgs(input_file, start_seconds, duration_seconds),
+                         duration_seconds * LOW_QUALITY_SAMPLE_RATE, options);
+}
+
+void FFmpegWrapper::StreamLowQualityPcm(const std::string &input_file,
+                                        std::uint32_t start_seconds,
+                                        std::uint32_t duration_seconds, const PcmSink &sink,
+                                        const subprocess::Options &options)
+{
+    // a pipe read may end in the middle of a sample, carry that byte over to the next one
+    std::vector<LowQualitySample> samples;
+    std::uint8_t carry[sizeof(LowQualitySample)];
+    std::size_t carried = 0;
+    auto on_output = [&](const std::uint8_t *data, std::size_t size) {
+        samples.resize((carried + size) / sizeof(LowQualitySample));
+        std::uint8_t *out = reinterpret_cast<std::uint8_t *>(samples.data());
+        std::memcpy(out, carry, carried);
+        std::size_t used = samples.size() * sizeof(LowQualitySample) - carried;
+        std::memcpy(out + carried, data, used);
+        carried = size - used;
+        std::memcpy(carry, data + used, carried);
+        sink(samples.data(), samples.size());
+    };
+
+    int exit_code = subprocess::Subprocess::StreamOutput(
+        lowQualityPcmArgs(input_file, start_seconds, duration_seconds), on_output, options);
+    if (exit_code != 0)
+    {
+        throw std::runtime_error("PCM Conversion Failed: " + std::to_string(exit_code));
+    }
+}
+
+const std::string &FFmpegWrapper::requireFFmpegPath()
 {
     static std::string ffmpeg_path = FFmpegWrapper::getFFmpegPath();
     if (ffmpeg_path.empty())
@@ -46,40 +93,41 @@ LowQualityTrack FFmpegWrapper::ConvertToLowQaulityPcm(
         std::cerr << FFMPEG_PATH_ENV << " environment variable." << std::endl;
         throw std::runtime_error("FFmpeg not found");
     }
+    return ffmpeg_path;
+}
 
-    std::stringstream ss;
-    ss << ffmpeg_path;
-    ss << " -i " << escapeShellArg(input_file);
-    ss << " -f "
-       << "s" << LOW_QUALITY_SAMPLE_BIT_WIDTH << "le";
-    ss << " -acodec "
-       << "pcm_s" << LOW_QUALITY_SAMPLE_BIT_WIDTH << "le";
-    ss << " -ar " << LOW_QUALITY_SAMPLE_RATE;
-    ss << " -ac " << 1;
-    ss << " -ss " << start_seconds;
-    ss << " -t " << duration_seconds;
-    ss << " -"; // stdout
-    ss << " 2>/dev/null"; // suppress std
-
-    std::FILE *pipe = PROCESS_OPEN(ss.str().c_str(), "r");
-    if (!pipe)
-    {
-        throw std::runtime_error("popen() failed!");
-    }
+std::vector<std::string> FFmpegWrapper::lowQualityPcmArgs(const std::string &input_file,
+                                                          std::uint32_t start_seconds,
+                                                          std::uint32_t duration_seconds)
+{
+    std::vector<std::string> args = {requireFFmpegPath(), "-v", "error", "-nostdin"};
+    // -ss/-t before -i seek the demuxer instead of decoding and discarding the skipped audio
+    args.insert(args.end(), {"-ss", std::to_string(start_seconds)});
+    args.insert(args.end(), {"-t", std::to_string(duration_seconds)});
+    args.insert(args.end(), {"-i", input_file});
+    args.insert(args.end(), {"-map", "0:a:0", "-vn", "-sn", "-dn"});
+    args.insert(args.end(), {"-ar", std::to_string(LOW_QUALITY_SAMPLE_RATE)});
+    args.insert(args.end(), {"-ac", "1"});
+    appendPcmOutputArgs(&args);
+    return args;
+}
 
-    std::array<std::int16_t, 4096> buffer;
-    size_t bytes_read;
+void FFmpegWrapper::appendPcmOutputArgs(std::vector<std::string> *args)
+{
+    std::string sample_format = "s" + std::to_string(LOW_QUALITY_SAMPLE_BIT_WIDTH) + "le";
+    args->insert(args->end(), {"-f", sample_format});
+    args->insert(args->end(), {"-acodec", "pcm_" + sample_format});
+    args->push_back("-"); // stdout
+}
 
+LowQualityTrack FFmpegWrapper::runPcmCommand(const std::vector<std::string> &args,
+                                             std::size_t expected_samples,
+                                             const subprocess::Options &options)
+{
     LowQualityTrack pcm;
-    pcm.reserve(duration_seconds * LOW_QUALITY_SAMPLE_RATE);
+    pcm.reserve(expected_samples);
 
-    while ((bytes_read = fread(buffer.data(), 1, buffer.size(), pipe)) != 0)
-    {
-        pcm.insert(pcm.end(), buffer.begin(),
-                   buffer.begin() + (bytes_read / sizeof(LowQualitySample)));
-    }
-
-    int exit_code = PROCESS_CLOSE(pipe);
+    int exit_code = subprocess::Subprocess::ReadOutput(args, &pcm, options);
     if (exit_code != 0)
     {
         throw std::runtime_error("PCM Conversion Failed: " + std::to_string(exit_code));
@@ -122,48 +170,6 @@ bool FFmpegWrapper::isWindows()
     return false;
 }
 
-std::string FFmpegWrapper::escapeShellArg(const std::string& arg)
-{
-#ifdef _MSC_VER
-    // Windows: use double quotes and escape internal quotes
-    std::string result = "\"";
-    for (char c : arg)
-    {
-        if (c == '"')
-        {
-            result += "\\\"";
-        }
-        else if (c == '\\')
-        {
-            result += "\\\\";
-        }
-        else
-        {
-            result += c;
-        }
-    }
-    result += "\"";
-    return result;
-#else
-    // Unix/Linux: use single quotes and handle embedded single quotes
-    std::string result = "'";
-    for (char c : arg)
-    {
-        if (c == '\'')
-        {
-            // Close quote, add escaped quote, reopen quote
-            result += "'\\''";
-        }
-        else
-        {
-            result += c;
-        }
-    }
-    result += "'";
-    return result;
-#endif
-}
-
 } // namespace ffmpeg
 
 #endif // LIB_UTILS_FFMPEG_H_
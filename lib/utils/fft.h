@@ -3,14 +3,23 @@
 
 #include <cmath>
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <fftw3.h> // NOLINT [include_order]
 #include <memory>
+#include <mutex>
 #include <vector>
 
 namespace fft
 {
 
+// Only fftw_execute() is thread-safe, plan creation and destruction must be serialised
+inline std::mutex &planner_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
 template <int INPUT_SIZE>
 class FFT
 {
@@ -23,6 +32,7 @@ public:
         : input_data_buffer_(fftw_alloc_real(INPUT_SIZE), fftw_free),
           output_data_buffer_(fftw_alloc_complex(OUTPUT_SIZE), fftw_free)
     {
+        std::lock_guard<std::mutex> lock(planner_mutex());
         fftw_plan_ = fftw_plan_dft_r2c_1d(INPUT_SIZE, input_data_buffer_.get(),
                                           output_data_buffer_.get(), FFTW_ESTIMATE);
     }
@@ -62,10 +72,11 @@ public:
         return real_output;
     }
 
+    // No fftw_cleanup() here: it would invalidate the plans of every other live FFT
     virtual ~FFT()
     {
+        std::lock_guard<std::mutex> lock(planner_mutex());
         fftw_destroy_plan(fftw_plan_);
-        fftw_cleanup();
     }
 
 private:
@@ -0,0 +1,234 @@
+#ifndef LIB_UTILS_FINGERPRINT_CACHE_H_
+#define LIB_UTILS_FINGERPRINT_CACHE_H_
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+namespace fingerprint_cache
+{
+
+// Bump whenever a change to fingerprinting would give a different signature for the same file
+constexpr std::uint32_t FORMAT_VERSION = 1;
+constexpr char ENTRY_MAGIC[] = "VIBRSIG1";
+// Sampled from the start, the middle and the end of the file for its key
+constexpr std::size_t KEY_SAMPLE_BYTES = 64 * 1024;
+
+// Everything needed to restore a fingerprinting result without decoding the file again
+struct Entry
+{
+    std::uint32_t sample_rate = 0;
+    std::uint32_t num_samples = 0;
+    std::uint32_t offset_seconds = 0;
+    double square_sum = 0.0;
+    std::uint64_t level_samples = 0;
+    std::uint32_t level_blocks = 0;
+    std::uint32_t silent_blocks = 0;
+    std::vector<char> signature; // binary signature, as Signature::Encode() writes it
+};
+
+// Content-addressed store of fingerprinting results, one small file per entry under
+// <directory>/<first two hex digits of the key>/<key>. Entries are written to a temporary file
+// and renamed into place, so concurrent writers (threads or processes) never expose a partial
+// entry, and a damaged entry only costs a cache miss.
+class FingerprintCache
+{
+public:
+    explicit FingerprintCache(const std::string &directory) : directory_(directory)
+    {
+    }
+
+    // Creates directory and its missing parents
+    static bool CreateDirectories(const std::string &directory)
+    {
+        std::size_t pos = 0;
+        do
+        {
+            pos = directory.find_first_of("/\\", pos + 1);
+            std::string prefix = directory.substr(0, pos);
+            if (!makeDirectory(prefix) && !isDirectory(prefix))
+            {
+                return false;
+            }
+        } while (pos != std::string::npos);
+        return true;
+    }
+
+    // Key of the result of fingerprinting path, window being the offset in seconds or -1 for
+    // the best window. The file's size and its first, middle and last KEY_SAMPLE_BYTES are
+    // hashed, so the key costs three short reads however large the file is; retagging or
+    // re-encoding a file changes it. Empty if the file can't be read.
+    static std::string KeyOf(const std::string &path, std::int64_t window)
+    {
+        std::ifstream stream(path, std::ios::binary | std::ios::ate);
+        if (!stream)
+        {
+            return std::string();
+        }
+        std::uint64_t size = static_cast<std::uint64_t>(stream.tellg());
+
+        std::uint64_t header[3] = {FORMAT_VERSION, size, static_cast<std::uint64_t>(window)};
+        std::uint64_t hash_low = hash(header, sizeof(header), 0x9e3779b97f4a7c15ULL);
+        std::uint64_t hash_high = hash(header, sizeof(header), 0xc2b2ae3d27d4eb4fULL);
+
+        std::vector<char> sample(KEY_SAMPLE_BYTES);
+        std::uint64_t middle = size > KEY_SAMPLE_BYTES ? (size - KEY_SAMPLE_BYTES) / 2 : 0;
+        std::uint64_t last = size > KEY_SAMPLE_BYTES ? size - KEY_SAMPLE_BYTES : 0;
+        for (std::uint64_t offset : {static_cast<std::uint64_t>(0), middle, last})
+        {
+            stream.seekg(static_cast<std::streamoff>(offset));
+            stream.read(sample.data(), sample.size());
+            std::size_t read = static_cast<std::size_t>(stream.gcount());
+            if (read == 0 && size > 0)
+            {
+                return std::string();
+            }
+            stream.clear();
+            hash_low = hash(sample.data(), read, hash_low);
+            hash_high = hash(sample.data(), read, hash_high);
+        }
+
+        char key[33];
+        std::snprintf(key, sizeof(key), "%016llx%016llx",
+                      static_cast<unsigned long long>(hash_high),
+                      static_cast<unsigned long long>(hash_low));
+        return key;
+    }
+
+    bool Load(const std::string &key, Entry *entry) const
+    {
+        std::ifstream stream(entryPath(key), std::ios::binary);
+        if (!stream)
+        {
+            return false;
+        }
+        char magic[sizeof(ENTRY_MAGIC) - 1];
+        std::uint32_t signature_size = 0;
+        stream.read(magic, sizeof(magic));
+        readField(stream, &entry->sample_rate);
+        readField(stream, &entry->num_samples);
+        readField(stream, &entry->offset_seconds);
+        readField(stream, &entry->square_sum);
+        readField(stream, &entry->level_samples);
+        readField(stream, &entry->level_blocks);
+        readField(stream, &entry->silent_blocks);
+        readField(stream, &signature_size);
+        if (!stream || std::memcmp(magic, ENTRY_MAGIC, sizeof(magic)) != 0 ||
+            signature_size > MAX_SIGNATURE_SIZE)
+        {
+            return false;
+        }
+        entry->signature.resize(signature_size);
+        stream.read(entry->signature.data(), signature_size);
+        return static_cast<bool>(stream);
+    }
+
+    // Best effort, a failure only means the entry is computed again next time
+    void Store(const std::string &key, const Entry &entry) const
+    {
+        std::string path = entryPath(key);
+        std::string shard = path.substr(0, path.find_last_of("/\\"));
+        makeDirectory(shard);
+
+        // unique per writer, other threads and processes may store the same key
+        std::string temp_path = path + ".tmp" + std::to_string(std::random_device()());
+        {
+            std::ofstream stream(temp_path, std::ios::binary | std::ios::trunc);
+            std::uint32_t signature_size = static_cast<std::uint32_t>(entry.signature.size());
+            stream.write(ENTRY_MAGIC, sizeof(ENTRY_MAGIC) - 1);
+            writeField(stream, entry.sample_rate);
+            writeField(stream, entry.num_samples);
+            writeField(stream, entry.offset_seconds);
+            writeField(stream, entry.square_sum);
+            writeField(stream, entry.level_samples);
+            writeField(stream, entry.level_blocks);
+            writeField(stream, entry.silent_blocks);
+            writeField(stream, signature_size);
+            stream.write(entry.signature.data(), entry.signature.size());
+            stream.close();
+            if (!stream)
+            {
+                std::remove(temp_path.c_str());
+                return;
+            }
+        }
+        if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temp_path.c_str());
+        }
+    }
+
+private:
+    // Signatures of 12 s of audio take a few KB, anything far larger is damage
+    static constexpr std::uint32_t MAX_SIGNATURE_SIZE = 1 << 20;
+
+    std::string entryPath(const std::string &key) const
+    {
+        return directory_ + "/" + key.substr(0, 2) + "/" + key;
+    }
+
+    // 64-bit multiply-xorshift over 8-byte words, several GB/s; not cryptographic, it only
+    // has to tell files apart
+    static std::uint64_t hash(const void *data, std::size_t length, std::uint64_t seed)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        std::uint64_t value = seed ^ (length * 0xff51afd7ed558ccdULL);
+        while (length > 0)
+        {
+            std::uint64_t word = 0;
+            std::size_t word_size = length < sizeof(word) ? length : sizeof(word);
+            std::memcpy(&word, bytes, word_size);
+            value = (value ^ word) * 0x9ddfea08eb382d69ULL;
+            value ^= value >> 47;
+            bytes += word_size;
+            length -= word_size;
+        }
+        value *= 0xc4ceb9fe1a85ec53ULL;
+        return value ^ (value >> 33);
+    }
+
+    static bool makeDirectory(const std::string &path)
+    {
+#ifdef _WIN32
+        return _mkdir(path.c_str()) == 0;
+#else
+        return mkdir(path.c_str(), 0755) == 0;
+#endif
+    }
+
+    static bool isDirectory(const std::string &path)
+    {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR;
+    }
+
+    template <typename T>
+    static void readField(std::ifstream &stream, T *value)
+    {
+        stream.read(reinterpret_cast<char *>(value), sizeof(T));
+    }
+
+    template <typename T>
+    static void writeField(std::ofstream &stream, const T &value)
+    {
+        stream.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+private:
+    std::string directory_;
+};
+
+} // namespace fingerprint_cache
+
+#endif // LIB_UTILS_FINGERPRINT_CACHE_H_
@@ -0,0 +1,328 @@
+#ifndef LIB_UTILS_LIBAV_H_
+#define LIB_UTILS_LIBAV_H_
+
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include "audio/downsampler.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>   // NOLINT [include_order]
+#include <libavformat/avformat.h> // NOLINT [include_order]
+#include <libavutil/opt.h>        // NOLINT [include_order]
+#include <libswresample/swresample.h> // NOLINT [include_order]
+}
+
+// FFmpeg 5.1 replaced the channel_layout bitmask with AVChannelLayout
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)
+#define LIBAV_HAS_CH_LAYOUT 1
+#endif
+
+namespace libav
+{
+
+// Receives decoded 16 kHz mono samples in order
+using PcmSink = std::function<void(const LowQualitySample *samples, std::size_t count)>;
+
+// In-process decoder: the container is opened once, then any number of windows can be
+// decoded and resampled to 16 kHz mono without spawning ffmpeg/ffprobe.
+class LibavDecoder
+{
+public:
+    explicit LibavDecoder(const std::string &input_file);
+    LibavDecoder(const LibavDecoder &) = delete;
+    LibavDecoder &operator=(const LibavDecoder &) = delete;
+    ~LibavDecoder();
+
+    // Duration of the container in seconds, 0 if unknown.
+    double duration() const;
+    LowQualityTrack ReadWindow(std::uint32_t start_seconds, std::uint32_t duration_seconds);
+    // Decodes the range block by block into sink instead of collecting it in memory.
+    void Decode(std::uint32_t start_seconds, std::uint32_t duration_seconds, const PcmSink &sink);
+
+private:
+    void release();
+    void seek(std::uint32_t start_seconds);
+    void resetResampler();
+    // Returns the number of samples passed to sink
+    std::size_t emitFrame(const AVFrame *frame, std::int64_t start_sample, std::size_t max_samples,
+                          const PcmSink &sink);
+
+private:
+    AVFormatContext *format_context_;
+    AVCodecContext *codec_context_;
+    SwrContext *swr_context_;
+    AVPacket *packet_;
+    AVFrame *frame_;
+    int stream_index_;
+    std::int64_t next_sample_; // output sample index of the next resampled sample
+    LowQualityTrack scratch_;
+};
+
+inline LibavDecoder::LibavDecoder(const std::string &input_file)
+    : format_context_(nullptr), codec_context_(nullptr), swr_context_(nullptr),
+      packet_(nullptr), frame_(nullptr), stream_index_(-1), next_sample_(-1)
+{
+    try
+    {
+        if (avformat_open_input(&format_context_, input_file.c_str(), nullptr, nullptr) < 0)
+        {
+            throw std::runtime_error("libav: failed to open " + input_file);
+        }
+        if (avformat_find_stream_info(format_context_, nullptr) < 0)
+        {
+            throw std::runtime_error("libav: failed to read stream info");
+        }
+
+        stream_index_ =
+            av_find_best_stream(format_context_, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+        if (stream_index_ < 0)
+        {
+            throw std::runtime_error("libav: no audio stream");
+        }
+        // only the audio stream is demuxed
+        for (unsigned int i = 0; i < format_context_->nb_streams; i++)
+        {
+            if (static_cast<int>(i) != stream_index_)
+            {
+                format_context_->streams[i]->discard = AVDISCARD_ALL;
+            }
+        }
+
+        AVCodecParameters *params = format_context_->streams[stream_index_]->codecpar;
+        const AVCodec *codec = avcodec_find_decoder(params->codec_id);
+        if (codec == nullptr)
+        {
+            throw std::runtime_error("libav: no decoder for audio stream");
+        }
+        codec_context_ = avcodec_alloc_context3(codec);
+        if (codec_context_ == nullptr ||
+            avcodec_parameters_to_context(codec_context_, params) < 0 ||
+            avcodec_open2(codec_context_, codec, nullptr) < 0)
+        {
+            throw std::runtime_error("libav: failed to open decoder");
+        }
+
+        packet_ = av_packet_alloc();
+        frame_ = av_frame_alloc();
+        if (packet_ == nullptr || frame_ == nullptr)
+        {
+            throw std::runtime_error("libav: out of memory");
+        }
+        resetResampler();
+    }
+    catch (...)
+    {
+        release();
+        throw;
+    }
+}
+
+inline LibavDecoder::~LibavDecoder()
+{
+    release();
+}
+
+inline void LibavDecoder::release()
+{
+    av_frame_free(&frame_);
+    av_packet_free(&packet_);
+    swr_free(&swr_context_);
+    avcodec_free_context(&codec_context_);
+    avformat_close_input(&format_context_);
+}
+
+inline double LibavDecoder::duration() const
+{
+    if (format_context_->duration != AV_NOPTS_VALUE)
+    {
+        return format_context_->duration / static_cast<double>(AV_TIME_BASE);
+    }
+    const AVStream *stream = format_context_->streams[stream_index_];
+    if (stream->duration != AV_NOPTS_VALUE)
+    {
+        return stream->duration * av_q2d(stream->time_base);
+    }
+    return 0.0;
+}
+
+inline LowQualityTrack LibavDecoder::ReadWindow(std::uint32_t start_seconds,
+                                                std::uint32_t duration_seconds)
+{
+    LowQualityTrack pcm;
+    pcm.reserve(static_cast<std::size_t>(duration_seconds) * LOW_QUALITY_SAMPLE_RATE);
+    Decode(start_seconds, duration_seconds,
+           [&pcm](const LowQualitySample *samples, std::size_t count) {
+               pcm.insert(pcm.end(), samples, samples + count);
+           });
+    return pcm;
+}
+
+inline void LibavDecoder::Decode(std::uint32_t start_seconds, std::uint32_t duration_seconds,
+                                 const PcmSink &sink)
+{
+    const std::size_t max_samples =
+        static_cast<std::size_t>(duration_seconds) * LOW_QUALITY_SAMPLE_RATE;
+    const std::int64_t start_sample =
+        static_cast<std::int64_t>(start_seconds) * LOW_QUALITY_SAMPLE_RATE;
+
+    seek(start_seconds);
+
+    std::size_t emitted = 0;
+    bool draining = false;
+    while (emitted < max_samples)
+    {
+        int ret = avcodec_receive_frame(codec_context_, frame_);
+        if (ret == 0)
+        {
+            emitted += emitFrame(frame_, start_sample, max_samples - emitted, sink);
+            av_frame_unref(frame_);
+            continue;
+        }
+        if (ret == AVERROR_EOF)
+        {
+            break;
+        }
+        if (ret != AVERROR(EAGAIN))
+        {
+            throw std::runtime_error("libav: decoding failed");
+        }
+        if (draining)
+        {
+            break;
+        }
+
+        ret = av_read_frame(format_context_, packet_);
+        if (ret < 0)
+        {
+            // end of file, flush the decoder
+            avcodec_send_packet(codec_context_, nullptr);
+            draining = true;
+            continue;
+        }
+        if (packet_->stream_index == stream_index_)
+        {
+            // a corrupt packet is skipped rather than aborting the whole window
+            avcodec_send_packet(codec_context_, packet_);
+        }
+        av_packet_unref(packet_);
+    }
+}
+
+inline void LibavDecoder::seek(std::uint32_t start_seconds)
+{
+    AVStream *stream = format_context_->streams[stream_index_];
+    // AV_TIME_BASE_Q is a C compound literal, so spell the time base out
+    AVRational seconds_time_base = {1, 1};
+    std::int64_t timestamp = av_rescale_q(start_seconds, seconds_time_base, stream->time_base);
+    if (stream->start_time != AV_NOPTS_VALUE)
+    {
+        timestamp += stream->start_time;
+    }
+
+    if (av_seek_frame(format_context_, stream_index_, timestamp, AVSEEK_FLAG_BACKWARD) < 0)
+    {
+        throw std::runtime_error("libav: seek failed");
+    }
+    avcodec_flush_buffers(codec_context_);
+    resetResampler();
+    next_sample_ = -1;
+}
+
+inline void LibavDecoder::resetResampler()
+{
+    swr_free(&swr_context_);
+
+#ifdef LIBAV_HAS_CH_LAYOUT
+    AVChannelLayout in_layout;
+    if (codec_context_->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC)
+    {
+        av_channel_layout_default(&in_layout, codec_context_->ch_layout.nb_channels);
+    }
+    else
+    {
+        av_channel_layout_copy(&in_layout, &codec_context_->ch_layout);
+    }
+    AVChannelLayout out_layout;
+    av_channel_layout_default(&out_layout, 1);
+    int ret = swr_alloc_set_opts2(&swr_context_, &out_layout, AV_SAMPLE_FMT_S16,
+                                  LOW_QUALITY_SAMPLE_RATE, &in_layout, codec_context_->sample_fmt,
+                                  codec_context_->sample_rate, 0, nullptr);
+    av_channel_layout_uninit(&in_layout);
+    if (ret < 0)
+    {
+        swr_context_ = nullptr;
+    }
+#else
+    std::int64_t in_layout = codec_context_->channel_layout;
+    if (in_layout == 0)
+    {
+        in_layout = av_get_default_channel_layout(codec_context_->channels);
+    }
+    swr_context_ = swr_alloc_set_opts(nullptr, AV_CH_LAYOUT_MONO, AV_SAMPLE_FMT_S16,
+                                      LOW_QUALITY_SAMPLE_RATE, in_layout,
+                                      codec_context_->sample_fmt, codec_context_->sample_rate, 0,
+                                      nullptr);
+#endif
+
+    if (swr_context_ == nullptr || swr_init(swr_context_) < 0)
+    {
+        throw std::runtime_error("libav: failed to set up resampler");
+    }
+}
+
+inline std::size_t LibavDecoder::emitFrame(const AVFrame *frame, std::int64_t start_sample,
+                                           std::size_t max_samples, const PcmSink &sink)
+{
+    if (next_sample_ < 0)
+    {
+        // the seek lands on or before the requested position, locate this frame in time
+        const AVStream *stream = format_context_->streams[stream_index_];
+        std::int64_t pts = frame->best_effort_timestamp;
+        if (pts == AV_NOPTS_VALUE)
+        {
+            next_sample_ = start_sample;
+        }
+        else
+        {
+            if (stream->start_time != AV_NOPTS_VALUE)
+            {
+                pts -= stream->start_time;
+            }
+            AVRational sample_time_base = {1, static_cast<int>(LOW_QUALITY_SAMPLE_RATE)};
+            next_sample_ = av_rescale_q(pts, stream->time_base, sample_time_base);
+        }
+    }
+
+    int capacity = swr_get_out_samples(swr_context_, frame->nb_samples);
+    if (capacity <= 0)
+    {
+        return 0;
+    }
+    scratch_.resize(capacity);
+    std::uint8_t *out = reinterpret_cast<std::uint8_t *>(scratch_.data());
+    int converted = swr_convert(swr_context_, &out, capacity,
+                                const_cast<const std::uint8_t **>(frame->extended_data),
+                                frame->nb_samples);
+    if (converted <= 0)
+    {
+        return 0;
+    }
+
+    std::int64_t skip = std::max<std::int64_t>(0, start_sample - next_sample_);
+    next_sample_ += converted;
+    if (skip >= converted)
+    {
+        return 0;
+    }
+    std::size_t count = std::min<std::size_t>(converted - skip, max_samples);
+    sink(scratch_.data() + skip, count);
+    return count;
+}
+
+} // namespace libav
+
+#endif // LIB_UTILS_LIBAV_H_
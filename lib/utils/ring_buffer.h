@@ -1,6 +1,7 @@
 #ifndef LIB_UTILS_RING_BUFFER_H_
 #define LIB_UTILS_RING_BUFFER_H_
 
+#include <algorithm>
 #include <vector>
 
 template <typename T> class RingBuffer : private std::vector<T>
@@ -10,6 +11,8 @@ public:
     virtual ~RingBuffer();
 
     void Append(const T &value);
+    // Refills every slot with default_value and rewinds, keeping the storage
+    void Reset(const T &default_value = T());
     std::uint32_t size() const
     {
         return std::vector<T>::size();
@@ -66,4 +69,11 @@ template <typename T> void RingBuffer<T>::Append(const T &value)
     num_written_++;
 }
 
+template <typename T> void RingBuffer<T>::Reset(const T &default_value)
+{
+    std::fill(std::vector<T>::begin(), std::vector<T>::end(), default_value);
+    num_written_ = 0;
+    position_ = 0;
+}
+
 #endif // LIB_UTILS_RING_BUFFER_H_
@@ -0,0 +1,364 @@
+#ifndef LIB_UTILS_SUBPROCESS_H_
+#define LIB_UTILS_SUBPROCESS_H_
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <spawn.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+extern char **environ;
+#endif
+
+namespace subprocess
+{
+
+constexpr std::size_t READ_BLOCK_BYTES = 64 * 1024;
+constexpr int CANCEL_POLL_MS = 100;
+// How often a child that closed stdout is checked on while it has a deadline
+constexpr int EXIT_POLL_MS = 10;
+
+// Receives stdout in the order it was written, in chunks of arbitrary size
+using OutputSink = std::function<void(const std::uint8_t *data, std::size_t size)>;
+
+struct Options
+{
+    // Wall clock limit for the whole run, 0 = no limit
+    int timeout_ms = 0;
+    // The child is killed as soon as either of these becomes true: a process-wide flag and
+    // one for the single piece of work the run belongs to
+    const std::atomic<bool> *cancel = nullptr;
+    const std::atomic<bool> *cancel_job = nullptr;
+
+    inline bool cancellable() const
+    {
+        return cancel != nullptr || cancel_job != nullptr;
+    }
+    inline bool cancelled() const
+    {
+        return (cancel != nullptr && cancel->load()) ||
+               (cancel_job != nullptr && cancel_job->load());
+    }
+};
+
+class Subprocess
+{
+public:
+    Subprocess() = delete;
+
+    // Runs argv[0] (looked up in PATH) without a shell and appends everything it writes to stdout
+    // to *output, reading straight into the vector's storage. stdin and stderr are /dev/null.
+    // Returns the exit code, throws if the process can't be started, times out or is cancelled.
+    template <typename T>
+    static int ReadOutput(const std::vector<std::string> &argv, std::vector<T> *output,
+                          const Options &options = Options());
+    // Same as ReadOutput(), but hands stdout to sink block by block as it arrives.
+    static int StreamOutput(const std::vector<std::string> &argv, const OutputSink &sink,
+                            const Options &options = Options());
+
+private:
+    // Runs argv and moves its stdout through the caller's buffers: acquire(&room) returns where
+    // up to room bytes may be written, commit(n) is told how many actually were.
+    template <typename Acquire, typename Commit>
+    static int run(const std::vector<std::string> &argv, const Options &options, Acquire acquire,
+                   Commit commit);
+#ifdef _WIN32
+    static std::string quoteArg(const std::string &arg);
+#else
+    static pid_t spawn(const std::vector<std::string> &argv, int *stdout_fd);
+    static void killChild(pid_t pid);
+#endif
+};
+
+template <typename T>
+int Subprocess::ReadOutput(const std::vector<std::string> &argv, std::vector<T> *output,
+                           const Options &options)
+{
+    std::size_t bytes = output->size() * sizeof(T);
+    auto acquire = [output, &bytes](std::size_t *room) {
+        // grow in large blocks; the caller's reserve() is used first
+        if (output->size() * sizeof(T) - bytes < READ_BLOCK_BYTES / 2)
+        {
+            output->resize(
+                std::max(output->capacity(), (bytes + READ_BLOCK_BYTES) / sizeof(T) + 1));
+        }
+        *room = output->size() * sizeof(T) - bytes;
+        return reinterpret_cast<char *>(output->data()) + bytes;
+    };
+    auto commit = [&bytes](std::size_t n) { bytes += n; };
+
+    try
+    {
+        int exit_code = run(argv, options, acquire, commit);
+        output->resize(bytes / sizeof(T));
+        return exit_code;
+    }
+    catch (...)
+    {
+        output->resize(bytes / sizeof(T));
+        throw;
+    }
+}
+
+inline int Subprocess::StreamOutput(const std::vector<std::string> &argv, const OutputSink &sink,
+                                    const Options &options)
+{
+    std::vector<std::uint8_t> buffer(READ_BLOCK_BYTES);
+    auto acquire = [&buffer](std::size_t *room) {
+        *room = buffer.size();
+        return reinterpret_cast<char *>(buffer.data());
+    };
+    auto commit = [&buffer, &sink](std::size_t n) { sink(buffer.data(), n); };
+    return run(argv, options, acquire, commit);
+}
+
+#ifdef _WIN32
+
+// No posix_spawn on Windows: fall back to the shell without timeout or cancellation
+template <typename Acquire, typename Commit>
+int Subprocess::run(const std::vector<std::string> &argv, const Options &, Acquire acquire,
+                    Commit commit)
+{
+    std::string command;
+    for (const std::string &arg : argv)
+    {
+        command += quoteArg(arg) + " ";
+    }
+    command += "2>NUL";
+
+    std::FILE *pipe = _popen(command.c_str(), "rb");
+    if (!pipe)
+    {
+        throw std::runtime_error("Failed to start " + argv[0]);
+    }
+
+    try
+    {
+        for (;;)
+        {
+            std::size_t room = 0;
+            char *buffer = acquire(&room);
+            std::size_t n = fread(buffer, 1, room, pipe);
+            if (n == 0)
+            {
+                break;
+            }
+            commit(n);
+        }
+    }
+    catch (...)
+    {
+        _pclose(pipe);
+        throw;
+    }
+    return _pclose(pipe);
+}
+
+inline std::string Subprocess::quoteArg(const std::string &arg)
+{
+    std::string result = "\"";
+    for (char c : arg)
+    {
+        if (c == '"')
+        {
+            result += "\\\"";
+        }
+        else
+        {
+            result += c;
+        }
+    }
+    result += "\"";
+    return result;
+}
+
+#else
+
+template <typename Acquire, typename Commit>
+int Subprocess::run(const std::vector<std::string> &argv, const Options &options, Acquire acquire,
+                    Commit commit)
+{
+    int fd = -1;
+    pid_t pid = spawn(argv, &fd);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options.timeout_ms);
+    const char *failure = nullptr;
+
+    try
+    {
+        for (;;)
+        {
+            if (options.cancelled())
+            {
+                failure = " cancelled";
+                break;
+            }
+
+            int wait_ms = -1;
+            if (options.timeout_ms > 0)
+            {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now());
+                if (left.count() <= 0)
+                {
+                    failure = " timed out";
+                    break;
+                }
+                wait_ms = static_cast<int>(left.count());
+            }
+            if (options.cancellable())
+            {
+                wait_ms = wait_ms < 0 ? CANCEL_POLL_MS : std::min(wait_ms, CANCEL_POLL_MS);
+            }
+
+            pollfd pfd = {fd, POLLIN, 0};
+            int ready = poll(&pfd, 1, wait_ms);
+            if (ready < 0 && errno != EINTR)
+            {
+                failure = ": poll failed";
+                break;
+            }
+            if (ready <= 0)
+            {
+                continue;
+            }
+
+            std::size_t room = 0;
+            char *buffer = acquire(&room);
+            ssize_t n = read(fd, buffer, room);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                break; // EOF
+            }
+            commit(static_cast<std::size_t>(n));
+        }
+    }
+    catch (...)
+    {
+        // the sink gave up, don't leave the child blocked on a full pipe
+        close(fd);
+        killChild(pid);
+        throw;
+    }
+    close(fd);
+
+    if (failure != nullptr)
+    {
+        killChild(pid);
+        throw std::runtime_error(argv[0] + failure);
+    }
+
+    // The deadline and cancellation hold until the child has exited, not just closed stdout
+    bool bounded = options.timeout_ms > 0 || options.cancellable();
+    int status = 0;
+    for (;;)
+    {
+        pid_t waited = waitpid(pid, &status, bounded ? WNOHANG : 0);
+        if (waited < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (waited != 0)
+        {
+            break;
+        }
+        if (options.cancelled())
+        {
+            failure = " cancelled";
+        }
+        else if (options.timeout_ms > 0 && std::chrono::steady_clock::now() >= deadline)
+        {
+            failure = " timed out";
+        }
+        if (failure != nullptr)
+        {
+            killChild(pid);
+            throw std::runtime_error(argv[0] + failure);
+        }
+        poll(nullptr, 0, EXIT_POLL_MS);
+    }
+    if (WIFEXITED(status))
+    {
+        return WEXITSTATUS(status);
+    }
+    return -1; // killed by a signal
+}
+
+inline pid_t Subprocess::spawn(const std::vector<std::string> &argv, int *stdout_fd)
+{
+    // Both ends are kept out of children spawned concurrently by other threads: one holding
+    // the write end would keep the reader from seeing EOF until it exits. dup2 onto stdout
+    // clears the flag for this child.
+    int fds[2];
+#ifdef __linux__
+    if (argv.empty() || pipe2(fds, O_CLOEXEC) != 0)
+    {
+        throw std::runtime_error("Failed to create pipe");
+    }
+#else
+    // no pipe2: a child spawned between pipe() and fcntl() still inherits both ends
+    if (argv.empty() || pipe(fds) != 0)
+    {
+        throw std::runtime_error("Failed to create pipe");
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+
+    std::vector<char *> args;
+    for (const std::string &arg : argv)
+    {
+        args.push_back(const_cast<char *>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+
+    pid_t pid = 0;
+    int error = posix_spawnp(&pid, args[0], &actions, nullptr, args.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (error != 0)
+    {
+        close(fds[0]);
+        throw std::runtime_error("Failed to start " + argv[0]);
+    }
+
+    *stdout_fd = fds[0];
+    return pid;
+}
+
+inline void Subprocess::killChild(pid_t pid)
+{
+    kill(pid, SIGKILL);
+    while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR)
+    {
+    }
+}
+
+#endif // _WIN32
+
+} // namespace subprocess
+
+#endif // LIB_UTILS_SUBPROCESS_H_
@@ -0,0 +1,169 @@
+#ifndef LIB_UTILS_THREAD_POOL_H_
+#define LIB_UTILS_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace thread_pool
+{
+
+// Fixed set of worker threads with one task deque each. Submitted tasks are dealt round-robin;
+// a worker runs its own deque from the back and steals from the front of the others' once it
+// runs dry, so slow tasks (long files, slow decodes) don't leave the other workers idle.
+class WorkStealingPool
+{
+public:
+    // Receives the index of the worker running it, for per-worker state. Must not throw.
+    using Task = std::function<void(std::size_t worker)>;
+
+    explicit WorkStealingPool(std::size_t num_workers);
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+    // Runs the remaining tasks, then joins the workers
+    ~WorkStealingPool();
+
+    void Submit(Task task);
+    // Blocks until every task submitted so far has finished
+    void Wait();
+
+    inline std::size_t num_workers() const
+    {
+        return threads_.size();
+    }
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool takeTask(std::size_t worker, Task *task);
+    void workerLoop(std::size_t worker);
+
+private:
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex state_mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable all_done_;
+    std::atomic<std::size_t> queued_; // sitting in a deque
+    std::size_t unfinished_;          // queued or running, guarded by state_mutex_
+    std::size_t next_queue_;          // guarded by state_mutex_
+    bool stopping_;                   // guarded by state_mutex_
+};
+
+inline WorkStealingPool::WorkStealingPool(std::size_t num_workers)
+    : queues_(), threads_(), state_mutex_(), work_available_(), all_done_(), queued_(0),
+      unfinished_(0), next_queue_(0), stopping_(false)
+{
+    num_workers = num_workers == 0 ? 1 : num_workers;
+    for (std::size_t i = 0; i < num_workers; i++)
+    {
+        queues_.emplace_back(new WorkerQueue);
+    }
+    for (std::size_t i = 0; i < num_workers; i++)
+    {
+        threads_.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+inline WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        stopping_ = true;
+    }
+    work_available_.notify_all();
+    for (std::thread &thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+inline void WorkStealingPool::Submit(Task task)
+{
+    std::size_t queue;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        queue = next_queue_++ % queues_.size();
+        unfinished_++;
+        // counted under state_mutex_ so a worker can't miss it between its check and its wait
+        queued_++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[queue]->mutex);
+        queues_[queue]->tasks.push_back(std::move(task));
+    }
+    work_available_.notify_one();
+}
+
+inline void WorkStealingPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(state_mutex_);
+    all_done_.wait(lock, [this] { return unfinished_ == 0; });
+}
+
+inline bool WorkStealingPool::takeTask(std::size_t worker, Task *task)
+{
+    // newest own task first, it is the most likely to still be in cache
+    {
+        WorkerQueue &own = *queues_[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            *task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued_--;
+            return true;
+        }
+    }
+    for (std::size_t i = 1; i < queues_.size(); i++)
+    {
+        WorkerQueue &victim = *queues_[(worker + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            *task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued_--;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void WorkStealingPool::workerLoop(std::size_t worker)
+{
+    for (;;)
+    {
+        Task task;
+        if (takeTask(worker, &task))
+        {
+            task(worker);
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            if (--unfinished_ == 0)
+            {
+                all_done_.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(state_mutex_);
+        work_available_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+        if (stopping_ && queued_ == 0)
+        {
+            return;
+        }
+    }
+}
+
+} // namespace thread_pool
+
+#endif // LIB_UTILS_THREAD_POOL_H_
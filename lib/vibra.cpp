@@ -1,301 +1,1086 @@
 #include "../include/vibra.h"
+#include "algorithm/segment_selector.h"
 #include "algorithm/signature_generator.h"
 #include "audio/downsampler.h"
+#include "audio/duration_probe.h"
 #include "audio/wav.h"
+#include "utils/event_notifier.h"
 #include "utils/ffmpeg.h"
+#include "utils/fingerprint_cache.h"
+#include "utils/subprocess.h"
+#include "utils/thread_pool.h"
+#ifdef VIBRA_WITH_LIBAV
+#include "utils/libav.h"
+#endif
 #include <cstdio>
-#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 constexpr std::uint32_t MAX_DURATION_SECONDS = 12;
+constexpr std::uint32_t WAV_STREAM_BLOCK_SECONDS = 1;
+constexpr std::uint32_t INTRO_SKIP_SECONDS = 5;  // fade-ins, silence
+constexpr std::uint32_t OUTRO_SKIP_SECONDS = 10; // fade-outs, silence
+// Audio decoded to pick the fingerprint window from at most, so long tracks, mixes and
+// audiobooks cost as much as a song
+constexpr std::uint32_t MAX_SCAN_SECONDS = 4 * MAX_DURATION_SECONDS;
+constexpr int FFMPEG_TIMEOUT_MS = 120 * 1000;
+constexpr int FFMPEG_TIMEOUT_MS_PER_SECOND = 100; // extra allowance per decoded second
+constexpr int FFPROBE_TIMEOUT_MS = 30 * 1000;
+constexpr int FINGERPRINT_BAND_COUNT = 4; // FrequencyBand::_250_520 ... _3500_5500
+
+// Reusable per-thread state behind vibra_context_t
+struct VibraContext
+{
+    VibraContext()
+        : generator(), selector(MAX_DURATION_SECONDS), block(), encoded(),
+          signature(LOW_QUALITY_SAMPLE_RATE, 0), offset_seconds(0), has_signature(false),
+          cacheable(false), cancel(nullptr)
+    {
+    }
+
+    SignatureGenerator generator;
+    SegmentSelector selector;
+    LowQualityTrack block;     // downsampled WAV block
+    std::vector<char> encoded; // binary signature on its way to a data URI
+
+    // result of the last fingerprinting call
+    Signature signature;
+    std::uint32_t offset_seconds;
+    bool has_signature;
+    // false for a stand-in that mustn't outlive the call, e.g. the start of a file whose
+    // duration couldn't be read instead of its best window
+    bool cacheable;
+
+    // set while an async job runs on the context, stops its decoders and its FFT work
+    const std::atomic<bool> *cancel;
+};
+
+// The _generate_* functions leave their result in context->signature and context->offset_seconds
+void _generate_from_music_file(VibraContext *context, const std::string &path);
+
+void _generate_from_offset(VibraContext *context, const std::string &path,
+                           std::uint32_t offset_seconds);
 
-Fingerprint *_get_fingerprint_from_wav(const Wav &wav);
+// The above without the fingerprint cache
+void _generate_from_music_file_uncached(VibraContext *context, const std::string &path);
 
-Fingerprint *_get_fingerprint_from_low_quality_pcm(const LowQualityTrack &pcm, std::uint32_t offset_seconds = 0);
+void _generate_from_offset_uncached(VibraContext *context, const std::string &path,
+                                    std::uint32_t offset_seconds);
 
-// Escape shell argument for safe use with popen
-static std::string escape_shell_arg(const std::string& arg)
+void _generate_from_wav(VibraContext *context, Wav *wav);
+
+void _generate_from_low_quality_pcm(VibraContext *context, const LowQualityTrack &pcm,
+                                    std::uint32_t offset_seconds);
+
+Fingerprint *_get_fingerprint_from_context(const VibraContext *context);
+
+// Copies the last result of context to buffer, returns the size it needs, 0 if there is none
+std::size_t _copy_signature(VibraContext *context, vibra_signature_format_t format, char *buffer,
+                            std::size_t buffer_size);
+
+// Decodes [start_seconds, start_seconds + duration_seconds) of the input as 16 kHz mono into sink
+using RangeDecoder = std::function<void(std::uint32_t start_seconds,
+                                        std::uint32_t duration_seconds,
+                                        const ffmpeg::PcmSink &sink)>;
+
+void _generate_from_range_decoder(VibraContext *context, double duration,
+                                  const RangeDecoder &decode);
+
+// WAV containers are read natively, everything else goes through FFmpeg
+static bool is_wav_file(const std::string &path)
 {
-#ifdef _MSC_VER
-    // Windows: use double quotes and escape internal quotes
-    std::string result = "\"";
-    for (char c : arg)
+    std::string::size_type dot_pos = path.find_last_of('.');
+    if (dot_pos == std::string::npos)
     {
-        if (c == '"')
-        {
-            result += "\\\"";
-        }
-        else if (c == '\\')
-        {
-            result += "\\\\";
-        }
-        else
-        {
-            result += c;
-        }
+        return false;
     }
-    result += "\"";
-    return result;
-#else
-    // Unix/Linux: use single quotes and handle embedded single quotes
-    std::string result = "'";
-    for (char c : arg)
+    std::string ext = path.substr(dot_pos);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".wav" || ext == ".rf64" || ext == ".bw64";
+}
+
+// Shared by every ffmpeg/ffprobe run, set by vibra_cancel_decoding() and cleared by
+// vibra_resume_decoding()
+static std::atomic<bool> g_cancel_decoding(false);
+
+static subprocess::Options decoder_options(int timeout_ms,
+                                           const std::atomic<bool> *cancel_job = nullptr)
+{
+    subprocess::Options options;
+    options.timeout_ms = timeout_ms;
+    options.cancel = &g_cancel_decoding;
+    options.cancel_job = cancel_job;
+    return options;
+}
+
+static void check_cancelled(const VibraContext *context)
+{
+    if (context->cancel != nullptr && context->cancel->load())
     {
-        if (c == '\'')
-        {
-            // Close quote, add escaped quote, reopen quote
-            result += "'\\''";
-        }
-        else
-        {
-            result += c;
-        }
+        throw std::runtime_error("Fingerprinting cancelled");
     }
-    result += "'";
-    return result;
-#endif
 }
 
-// Get song duration using ffprobe
-static double get_song_duration(const std::string &file_path)
+// Get song duration from the container headers, using ffprobe only for unknown formats
+static double get_song_duration(const std::string &file_path,
+                                const std::atomic<bool> *cancel_job = nullptr)
 {
-    std::string ffprobe_cmd = "ffprobe -v error -show_entries format=duration -of default=noprint_wrappers=1:nokey=1 ";
+    double duration = DurationProbe::FromFile(file_path);
+    if (duration > 0.0)
+    {
+        return duration;
+    }
 
-    ffprobe_cmd += escape_shell_arg(file_path);
-    ffprobe_cmd += " 2>/dev/null";
+    std::vector<std::string> args = {"ffprobe", "-v", "error", "-show_entries",
+                                     "format=duration", "-of",
+                                     "default=noprint_wrappers=1:nokey=1", file_path};
 
-    FILE *pipe = popen(ffprobe_cmd.c_str(), "r");
-    if (!pipe)
+    std::vector<char> output;
+    try
+    {
+        subprocess::Subprocess::ReadOutput(args, &output,
+                                           decoder_options(FFPROBE_TIMEOUT_MS, cancel_job));
+        return std::stod(std::string(output.begin(), output.end()));
+    }
+    catch (...)
     {
         return 0.0;
     }
+}
+
+// Set by vibra_set_fingerprint_cache(), null while caching is off
+static std::mutex g_fingerprint_cache_mutex;
+static std::shared_ptr<const fingerprint_cache::FingerprintCache> g_fingerprint_cache;
+
+// FingerprintCache::KeyOf() window of the best window search
+constexpr std::int64_t CACHE_BEST_WINDOW = -1;
+
+static std::shared_ptr<const fingerprint_cache::FingerprintCache> current_fingerprint_cache()
+{
+    std::lock_guard<std::mutex> lock(g_fingerprint_cache_mutex);
+    return g_fingerprint_cache;
+}
+
+// Restores a cached result into context, false on a miss
+static bool load_cached(VibraContext *context, const fingerprint_cache::FingerprintCache &cache,
+                        const std::string &key)
+{
+    fingerprint_cache::Entry entry;
+    if (!cache.Load(key, &entry))
+    {
+        return false;
+    }
+    Signature &signature = context->signature;
+    signature.Reset(entry.sample_rate, entry.num_samples);
+    if (!signature.DecodePeaks(entry.signature.data(), entry.signature.size()))
+    {
+        return false;
+    }
+    Signature::Levels levels;
+    levels.square_sum = entry.square_sum;
+    levels.num_samples = entry.level_samples;
+    levels.num_blocks = entry.level_blocks;
+    levels.num_silent_blocks = entry.silent_blocks;
+    signature.set_levels(levels);
+    context->offset_seconds = entry.offset_seconds;
+    context->has_signature = true;
+    return true;
+}
+
+static void store_cached(const VibraContext *context,
+                         const fingerprint_cache::FingerprintCache &cache, const std::string &key)
+{
+    const Signature &signature = context->signature;
+    Signature::Levels levels = signature.levels();
+    fingerprint_cache::Entry entry;
+    entry.sample_rate = signature.sample_rate();
+    entry.num_samples = signature.num_samples();
+    entry.offset_seconds = context->offset_seconds;
+    entry.square_sum = levels.square_sum;
+    entry.level_samples = levels.num_samples;
+    entry.level_blocks = levels.num_blocks;
+    entry.silent_blocks = levels.num_silent_blocks;
+    entry.signature.resize(signature.EncodedSize());
+    signature.Encode(entry.signature.data());
+    cache.Store(key, entry);
+}
 
-    char buffer[128];
-    std::string result;
-    while (fgets(buffer, sizeof(buffer), pipe) != nullptr)
+// Runs generate, which leaves its result in context, unless the cache has it already
+static void generate_cached(VibraContext *context, const std::string &path, std::int64_t window,
+                            const std::function<void()> &generate)
+{
+    std::shared_ptr<const fingerprint_cache::FingerprintCache> cache = current_fingerprint_cache();
+    std::string key = cache ? fingerprint_cache::FingerprintCache::KeyOf(path, window) : "";
+    if (!key.empty() && load_cached(context, *cache, key))
     {
-        result += buffer;
+        return;
     }
-    pclose(pipe);
+    context->cacheable = true;
+    generate();
+    if (!key.empty() && context->has_signature && context->cacheable)
+    {
+        store_cached(context, *cache, key);
+    }
+}
+
+vibra_context_t *vibra_create_context()
+{
+    return new VibraContext;
+}
+
+void vibra_free_context(vibra_context_t *context)
+{
+    delete context;
+}
+
+Fingerprint *vibra_get_fingerprint_from_music_file(const char *music_file_path)
+{
+    VibraContext context;
+    return vibra_context_get_fingerprint_from_music_file(&context, music_file_path);
+}
+
+Fingerprint *vibra_get_fingerprint_from_wav_data(const char *raw_wav, size_t wav_data_size)
+{
+    VibraContext context;
+    return vibra_context_get_fingerprint_from_wav_data(&context, raw_wav, wav_data_size);
+}
+
+Fingerprint *vibra_get_fingerprint_from_signed_pcm(const char *raw_pcm, int pcm_data_size,
+                                                   int sample_rate, int sample_width,
+                                                   int channel_count)
+{
+    VibraContext context;
+    return vibra_context_get_fingerprint_from_signed_pcm(&context, raw_pcm, pcm_data_size,
+                                                         sample_rate, sample_width,
+                                                         channel_count);
+}
+
+Fingerprint *vibra_get_fingerprint_from_float_pcm(const char *raw_pcm, int pcm_data_size,
+                                                  int sample_rate, int sample_width,
+                                                  int channel_count)
+{
+    VibraContext context;
+    return vibra_context_get_fingerprint_from_float_pcm(&context, raw_pcm, pcm_data_size,
+                                                        sample_rate, sample_width, channel_count);
+}
 
+Fingerprint *vibra_get_fingerprint_from_offset(const char *music_file_path, unsigned int offset_seconds)
+{
+    VibraContext context;
+    return vibra_context_get_fingerprint_from_offset(&context, music_file_path, offset_seconds);
+}
+
+Fingerprint *vibra_context_get_fingerprint_from_music_file(vibra_context_t *context,
+                                                           const char *music_file_path)
+{
+    _generate_from_music_file(context, music_file_path);
+    return _get_fingerprint_from_context(context);
+}
+
+Fingerprint *vibra_context_get_fingerprint_from_wav_data(vibra_context_t *context,
+                                                         const char *raw_wav, size_t wav_data_size)
+{
+    Wav wav = Wav::FromRawWav(raw_wav, wav_data_size);
+    _generate_from_wav(context, &wav);
+    return _get_fingerprint_from_context(context);
+}
+
+Fingerprint *vibra_context_get_fingerprint_from_signed_pcm(vibra_context_t *context,
+                                                           const char *raw_pcm, int pcm_data_size,
+                                                           int sample_rate, int sample_width,
+                                                           int channel_count)
+{
+    Wav wav = Wav::FromSignedPCM(raw_pcm, pcm_data_size, sample_rate, sample_width, channel_count);
+    _generate_from_wav(context, &wav);
+    return _get_fingerprint_from_context(context);
+}
+
+Fingerprint *vibra_context_get_fingerprint_from_float_pcm(vibra_context_t *context,
+                                                          const char *raw_pcm, int pcm_data_size,
+                                                          int sample_rate, int sample_width,
+                                                          int channel_count)
+{
+    Wav wav = Wav::FromFloatPCM(raw_pcm, pcm_data_size, sample_rate, sample_width, channel_count);
+    _generate_from_wav(context, &wav);
+    return _get_fingerprint_from_context(context);
+}
+
+Fingerprint *vibra_context_get_fingerprint_from_offset(vibra_context_t *context,
+                                                       const char *music_file_path,
+                                                       unsigned int offset_seconds)
+{
+    _generate_from_offset(context, music_file_path, offset_seconds);
+    return _get_fingerprint_from_context(context);
+}
+
+size_t vibra_context_fingerprint_music_file(vibra_context_t *context, const char *music_file_path,
+                                            vibra_signature_format_t format, char *buffer,
+                                            size_t buffer_size)
+{
+    context->has_signature = false;
     try
     {
-        return std::stod(result);
+        _generate_from_music_file(context, music_file_path);
     }
-    catch (...)
+    catch (const std::exception &)
     {
-        return 0.0;
+        return 0;
     }
+    return _copy_signature(context, format, buffer, buffer_size);
 }
 
-// Calculate RMS (Root Mean Square) energy of audio segment
-static double calculate_rms_energy(const LowQualityTrack &pcm)
+size_t vibra_context_fingerprint_wav_data(vibra_context_t *context, const char *raw_wav,
+                                          size_t wav_data_size, vibra_signature_format_t format,
+                                          char *buffer, size_t buffer_size)
 {
-    if (pcm.empty())
+    context->has_signature = false;
+    try
     {
-        return 0.0;
+        Wav wav = Wav::FromRawWav(raw_wav, wav_data_size);
+        _generate_from_wav(context, &wav);
     }
+    catch (const std::exception &)
+    {
+        return 0;
+    }
+    return _copy_signature(context, format, buffer, buffer_size);
+}
 
-    double sum = 0.0;
-    for (const auto &sample : pcm)
+size_t vibra_context_fingerprint_signed_pcm(vibra_context_t *context, const char *raw_pcm,
+                                            int pcm_data_size, int sample_rate, int sample_width,
+                                            int channel_count, vibra_signature_format_t format,
+                                            char *buffer, size_t buffer_size)
+{
+    context->has_signature = false;
+    try
+    {
+        Wav wav =
+            Wav::FromSignedPCM(raw_pcm, pcm_data_size, sample_rate, sample_width, channel_count);
+        _generate_from_wav(context, &wav);
+    }
+    catch (const std::exception &)
     {
-        double normalized = static_cast<double>(sample) / 32768.0; // Normalize to -1.0 to 1.0
-        sum += normalized * normalized;
+        return 0;
     }
+    return _copy_signature(context, format, buffer, buffer_size);
+}
 
-    return std::sqrt(sum / pcm.size());
+size_t vibra_context_fingerprint_float_pcm(vibra_context_t *context, const char *raw_pcm,
+                                           int pcm_data_size, int sample_rate, int sample_width,
+                                           int channel_count, vibra_signature_format_t format,
+                                           char *buffer, size_t buffer_size)
+{
+    context->has_signature = false;
+    try
+    {
+        Wav wav =
+            Wav::FromFloatPCM(raw_pcm, pcm_data_size, sample_rate, sample_width, channel_count);
+        _generate_from_wav(context, &wav);
+    }
+    catch (const std::exception &)
+    {
+        return 0;
+    }
+    return _copy_signature(context, format, buffer, buffer_size);
 }
 
-// Calculate spectral complexity using simple variance
-static double calculate_spectral_variance(const LowQualityTrack &pcm)
+size_t vibra_context_fingerprint_offset(vibra_context_t *context, const char *music_file_path,
+                                        unsigned int offset_seconds,
+                                        vibra_signature_format_t format, char *buffer,
+                                        size_t buffer_size)
 {
-    if (pcm.size() < 2)
+    context->has_signature = false;
+    try
     {
-        return 0.0;
+        _generate_from_offset(context, music_file_path, offset_seconds);
     }
+    catch (const std::exception &)
+    {
+        return 0;
+    }
+    return _copy_signature(context, format, buffer, buffer_size);
+}
+
+size_t vibra_context_get_signature_size(vibra_context_t *context, vibra_signature_format_t format)
+{
+    return _copy_signature(context, format, nullptr, 0);
+}
 
-    // Calculate mean
-    double mean = 0.0;
-    for (const auto &sample : pcm)
+size_t vibra_context_copy_signature(vibra_context_t *context, vibra_signature_format_t format,
+                                    char *buffer, size_t buffer_size)
+{
+    return _copy_signature(context, format, buffer, buffer_size);
+}
+
+unsigned int vibra_context_get_sample_ms(vibra_context_t *context)
+{
+    if (!context->has_signature)
     {
-        mean += std::abs(sample);
+        return 0;
     }
-    mean /= pcm.size();
+    return context->signature.num_samples() * 1000 / context->signature.sample_rate();
+}
+
+unsigned int vibra_context_get_offset_ms(vibra_context_t *context)
+{
+    return context->has_signature ? context->offset_seconds * 1000 : 0;
+}
 
-    // Calculate variance
-    double variance = 0.0;
-    for (const auto &sample : pcm)
+const char *vibra_get_uri_from_fingerprint(Fingerprint *fingerprint)
+{
+    return fingerprint->uri.c_str();
+}
+
+unsigned int vibra_get_sample_ms_from_fingerprint(Fingerprint *fingerprint)
+{
+    return fingerprint->sample_ms;
+}
+
+unsigned int vibra_get_band_peaks_from_fingerprint(Fingerprint *fingerprint, int band)
+{
+    if (band < 0 || band >= FINGERPRINT_BAND_COUNT)
     {
-        double diff = std::abs(sample) - mean;
-        variance += diff * diff;
+        return 0;
     }
+    return fingerprint->band_peaks[band];
+}
+
+unsigned int vibra_get_peak_count_from_fingerprint(Fingerprint *fingerprint)
+{
+    unsigned int peaks = 0;
+    for (int band = 0; band < FINGERPRINT_BAND_COUNT; band++)
+    {
+        peaks += fingerprint->band_peaks[band];
+    }
+    return peaks;
+}
+
+double vibra_get_peak_density_from_fingerprint(Fingerprint *fingerprint)
+{
+    return fingerprint->peak_density;
+}
+
+double vibra_get_rms_from_fingerprint(Fingerprint *fingerprint)
+{
+    return fingerprint->rms;
+}
+
+double vibra_get_silence_ratio_from_fingerprint(Fingerprint *fingerprint)
+{
+    return fingerprint->silence_ratio;
+}
+
+const unsigned int *vibra_get_landmarks_from_fingerprint(Fingerprint *fingerprint, size_t *count)
+{
+    *count = fingerprint->landmarks.size();
+    return fingerprint->landmarks.data();
+}
+
+void vibra_free_fingerprint(Fingerprint *fingerprint)
+{
+    delete fingerprint;
+}
 
-    return variance / pcm.size();
+double vibra_get_duration(const char *music_file_path)
+{
+#ifdef VIBRA_WITH_LIBAV
+    // the header probe is cheaper than opening a demuxer
+    double header_duration = DurationProbe::FromFile(music_file_path);
+    if (header_duration > 0.0)
+    {
+        return header_duration;
+    }
+    try
+    {
+        libav::LibavDecoder decoder(music_file_path);
+        double duration = decoder.duration();
+        if (duration > 0.0)
+        {
+            return duration;
+        }
+    }
+    catch (const std::exception &)
+    {
+        // fall back to ffprobe
+    }
+#endif
+    return get_song_duration(music_file_path);
 }
 
-// Score a segment based on multiple factors
-static double score_segment(const LowQualityTrack &pcm)
+void vibra_cancel_decoding()
 {
-    double energy = calculate_rms_energy(pcm);
-    double variance = calculate_spectral_variance(pcm);
+    g_cancel_decoding = true;
+}
 
-    // Normalize variance to similar scale as energy
-    double normalized_variance = variance / 1000000.0;
+void vibra_resume_decoding()
+{
+    g_cancel_decoding = false;
+}
 
-    // Weighted score: 60% energy, 40% variance
-    return (energy * 0.6) + (normalized_variance * 0.4);
+int vibra_set_fingerprint_cache(const char *directory)
+{
+    std::shared_ptr<const fingerprint_cache::FingerprintCache> cache;
+    if (directory)
+    {
+        if (!fingerprint_cache::FingerprintCache::CreateDirectories(directory))
+        {
+            return 0;
+        }
+        cache = std::make_shared<const fingerprint_cache::FingerprintCache>(directory);
+    }
+    std::lock_guard<std::mutex> lock(g_fingerprint_cache_mutex);
+    g_fingerprint_cache = cache;
+    return 1;
 }
 
-// Find best segment by testing multiple positions
-static std::uint32_t calculate_start_offset(double duration, const std::string &file_path)
+size_t vibra_fingerprint_batch(const char *const *paths, size_t count,
+                               const vibra_batch_options_t *options,
+                               vibra_batch_callback_t callback, void *user_data)
 {
-    if (duration <= MAX_DURATION_SECONDS)
+    if (count == 0)
+    {
+        return 0;
+    }
+    std::size_t num_workers = options && options->threads > 0
+                                  ? options->threads
+                                  : std::thread::hardware_concurrency();
+    num_workers = std::max<std::size_t>(1, std::min(num_workers, count));
+
+    // one context per worker, so workers never share a generator or FFT plan
+    std::vector<std::unique_ptr<VibraContext>> contexts;
+    for (std::size_t i = 0; i < num_workers; i++)
     {
-        return 0; // Use entire song
+        contexts.emplace_back(new VibraContext);
+    }
+
+    std::mutex callback_mutex;
+    std::size_t succeeded = 0;
+    thread_pool::WorkStealingPool pool(num_workers);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        pool.Submit([&, i](std::size_t worker) {
+            Fingerprint *fingerprint = nullptr;
+            std::string error = "Decoding cancelled";
+            if (!g_cancel_decoding)
+            {
+                try
+                {
+                    fingerprint = vibra_context_get_fingerprint_from_music_file(
+                        contexts[worker].get(), paths[i]);
+                }
+                catch (const std::exception &e)
+                {
+                    error = e.what();
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(callback_mutex);
+            succeeded += fingerprint ? 1 : 0;
+            callback(i, fingerprint, fingerprint ? nullptr : error.c_str(), user_data);
+        });
     }
+    pool.Wait();
+    return succeeded;
+}
 
-    // Test segments at different positions
-    std::vector<std::uint32_t> test_positions;
+// A job of a vibra_queue_t
+struct AsyncJob
+{
+    enum State
+    {
+        QUEUED,
+        RUNNING,
+        CANCELLED, // before a worker got to it
+    };
 
-    // Skip first 5 seconds (fade-ins, silence)
-    // Skip last 10 seconds (fade-outs, silence)
-    std::uint32_t usable_duration = static_cast<std::uint32_t>(duration) - 10;
+    vibra_job_t id;
+    std::function<Fingerprint *(VibraContext *context)> fingerprint;
+    vibra_completion_callback_t callback;
+    void *user_data;
+    std::atomic<int> state;
+    std::atomic<bool> cancel;
+};
 
-    if (usable_duration > 5)
+struct VibraQueue
+{
+    explicit VibraQueue(std::size_t num_workers)
+        : contexts(), mutex(), completion_ready(), jobs(), completions(), next_job(1), notifier(),
+          pool(num_workers)
     {
-        // Test 3 positions: 5s, 30s, and 50% point
-        test_positions.push_back(5);
+        for (std::size_t i = 0; i < pool.num_workers(); i++)
+        {
+            contexts.emplace_back(new VibraContext);
+        }
+    }
 
-        if (usable_duration > 30)
+    ~VibraQueue()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto &pair : jobs)
+            {
+                pair.second->cancel = true;
+            }
+        }
+        // let the workers drain before the rest goes away
+        pool.Wait();
+        for (vibra_completion_t &completion : completions)
         {
-            test_positions.push_back(30);
+            vibra_free_fingerprint(completion.fingerprint);
         }
+    }
 
-        std::uint32_t middle = usable_duration / 2;
-        if (middle > 30)
+    vibra_job_t Submit(std::function<Fingerprint *(VibraContext *context)> fingerprint,
+                       const vibra_job_options_t *options)
+    {
+        std::shared_ptr<AsyncJob> job = std::make_shared<AsyncJob>();
+        job->fingerprint = std::move(fingerprint);
+        job->callback = options ? options->callback : nullptr;
+        job->user_data = options ? options->user_data : nullptr;
+        job->state = AsyncJob::QUEUED;
+        job->cancel = false;
         {
-            test_positions.push_back(middle);
+            std::lock_guard<std::mutex> lock(mutex);
+            job->id = next_job++;
+            jobs[job->id] = job;
         }
+        pool.Submit([this, job](std::size_t worker) { run(job, contexts[worker].get()); });
+        return job->id;
     }
-    else
+
+    bool Cancel(vibra_job_t id)
     {
-        test_positions.push_back(0);
+        std::shared_ptr<AsyncJob> job;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = jobs.find(id);
+            if (it == jobs.end())
+            {
+                return false;
+            }
+            job = it->second;
+        }
+        job->cancel = true;
+        int expected = AsyncJob::QUEUED;
+        if (job->state.compare_exchange_strong(expected, AsyncJob::CANCELLED))
+        {
+            // the worker that picks it up will skip it
+            complete(*job, VIBRA_JOB_CANCELLED, nullptr, "Job cancelled");
+        }
+        return true;
     }
 
-    // Analyze each position and pick the best
-    double best_score = -1.0;
-    std::uint32_t best_offset = 0;
+    std::size_t Take(vibra_completion_t *out, std::size_t max_completions, int timeout_ms)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto ready = [this] { return !completions.empty(); };
+        if (timeout_ms < 0)
+        {
+            completion_ready.wait(lock, ready);
+        }
+        else if (timeout_ms > 0)
+        {
+            completion_ready.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready);
+        }
+
+        std::size_t taken = 0;
+        for (; taken < max_completions && !completions.empty(); taken++)
+        {
+            out[taken] = completions.front();
+            completions.pop_front();
+        }
+        if (taken > 0 && completions.empty())
+        {
+            notifier.Clear();
+        }
+        return taken;
+    }
 
-    for (auto offset : test_positions)
+    void run(const std::shared_ptr<AsyncJob> &job, VibraContext *context)
     {
-        // Extract short sample (3 seconds) for analysis
+        int expected = AsyncJob::QUEUED;
+        if (!job->state.compare_exchange_strong(expected, AsyncJob::RUNNING))
+        {
+            return; // cancelled while queued, already completed
+        }
+
+        Fingerprint *fingerprint = nullptr;
+        std::string error;
+        context->cancel = &job->cancel;
         try
         {
-            LowQualityTrack sample = ffmpeg::FFmpegWrapper::ConvertToLowQaulityPcm(
-                file_path, offset, 3);
+            check_cancelled(context);
+            fingerprint = job->fingerprint(context);
+        }
+        catch (const std::exception &e)
+        {
+            error = e.what();
+        }
+        context->cancel = nullptr;
+
+        if (fingerprint)
+        {
+            complete(*job, VIBRA_JOB_SUCCEEDED, fingerprint, "");
+        }
+        else
+        {
+            complete(*job, job->cancel ? VIBRA_JOB_CANCELLED : VIBRA_JOB_FAILED, nullptr,
+                     job->cancel ? "Job cancelled" : error.c_str());
+        }
+    }
 
-            double score = score_segment(sample);
+    void complete(const AsyncJob &job, vibra_job_status_t status, Fingerprint *fingerprint,
+                  const char *error)
+    {
+        vibra_completion_t completion;
+        completion.job = job.id;
+        completion.status = status;
+        completion.fingerprint = fingerprint;
+        completion.user_data = job.user_data;
+        std::strncpy(completion.error, error, sizeof(completion.error) - 1);
+        completion.error[sizeof(completion.error) - 1] = '\0';
 
-            if (score > best_score)
-            {
-                best_score = score;
-                best_offset = offset;
-            }
+        if (job.callback)
+        {
+            job.callback(&completion);
         }
-        catch (...)
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.erase(job.id);
+        if (!job.callback)
         {
-            // If extraction fails, skip this position
-            continue;
+            if (completions.empty())
+            {
+                notifier.Signal();
+            }
+            completions.push_back(completion);
+            completion_ready.notify_all();
         }
     }
 
-    return best_offset;
+    std::vector<std::unique_ptr<VibraContext>> contexts; // one per worker
+    std::mutex mutex;
+    std::condition_variable completion_ready;
+    std::map<vibra_job_t, std::shared_ptr<AsyncJob>> jobs; // queued or running
+    std::deque<vibra_completion_t> completions;
+    vibra_job_t next_job;
+    event_notifier::EventNotifier notifier;
+    thread_pool::WorkStealingPool pool; // last, so its workers are joined first
+};
+
+vibra_queue_t *vibra_create_queue(unsigned int threads)
+{
+    std::size_t num_workers = threads > 0 ? threads : std::thread::hardware_concurrency();
+    return new VibraQueue(num_workers);
 }
 
-Fingerprint *vibra_get_fingerprint_from_music_file(const char *music_file_path)
+void vibra_free_queue(vibra_queue_t *queue)
+{
+    delete queue;
+}
+
+static bool use_offset(const vibra_job_options_t *options)
+{
+    return options && options->use_offset;
+}
+
+vibra_job_t vibra_submit_music_file(vibra_queue_t *queue, const char *music_file_path,
+                                    const vibra_job_options_t *options)
 {
     std::string path = music_file_path;
-    if (path.size() >= 4 && path.substr(path.size() - 4) == ".wav")
+    if (use_offset(options))
     {
-        Wav wav = Wav::FromFile(path);
-        return _get_fingerprint_from_wav(wav);
+        unsigned int offset_seconds = options->offset_seconds;
+        return queue->Submit(
+            [path, offset_seconds](VibraContext *context) {
+                return vibra_context_get_fingerprint_from_offset(context, path.c_str(),
+                                                                 offset_seconds);
+            },
+            options);
     }
+    return queue->Submit(
+        [path](VibraContext *context) {
+            return vibra_context_get_fingerprint_from_music_file(context, path.c_str());
+        },
+        options);
+}
 
-    // Get song duration and find optimal start offset using smart analysis
-    double duration = get_song_duration(path);
-    std::uint32_t start_offset = calculate_start_offset(duration, path);
+vibra_job_t vibra_submit_wav_data(vibra_queue_t *queue, const char *raw_wav,
+                                  size_t wav_data_size, const vibra_job_options_t *options)
+{
+    std::shared_ptr<std::vector<char>> data =
+        std::make_shared<std::vector<char>>(raw_wav, raw_wav + wav_data_size);
+    return queue->Submit(
+        [data](VibraContext *context) {
+            return vibra_context_get_fingerprint_from_wav_data(context, data->data(),
+                                                               data->size());
+        },
+        options);
+}
 
-    LowQualityTrack pcm =
-        ffmpeg::FFmpegWrapper::ConvertToLowQaulityPcm(path, start_offset, MAX_DURATION_SECONDS);
-    return _get_fingerprint_from_low_quality_pcm(pcm, start_offset);
+vibra_job_t vibra_submit_signed_pcm(vibra_queue_t *queue, const char *raw_pcm, int pcm_data_size,
+                                    int sample_rate, int sample_width, int channel_count,
+                                    const vibra_job_options_t *options)
+{
+    std::shared_ptr<std::vector<char>> data =
+        std::make_shared<std::vector<char>>(raw_pcm, raw_pcm + pcm_data_size);
+    return queue->Submit(
+        [=](VibraContext *context) {
+            return vibra_context_get_fingerprint_from_signed_pcm(
+                context, data->data(), pcm_data_size, sample_rate, sample_width, channel_count);
+        },
+        options);
 }
 
-Fingerprint *vibra_get_fingerprint_from_wav_data(const char *raw_wav, int wav_data_size)
+vibra_job_t vibra_submit_float_pcm(vibra_queue_t *queue, const char *raw_pcm, int pcm_data_size,
+                                   int sample_rate, int sample_width, int channel_count,
+                                   const vibra_job_options_t *options)
 {
-    Wav wav = Wav::FromRawWav(raw_wav, wav_data_size);
-    return _get_fingerprint_from_wav(wav);
+    std::shared_ptr<std::vector<char>> data =
+        std::make_shared<std::vector<char>>(raw_pcm, raw_pcm + pcm_data_size);
+    return queue->Submit(
+        [=](VibraContext *context) {
+            return vibra_context_get_fingerprint_from_float_pcm(
+                context, data->data(), pcm_data_size, sample_rate, sample_width, channel_count);
+        },
+        options);
 }
 
-Fingerprint *vibra_get_fingerprint_from_signed_pcm(const char *raw_pcm, int pcm_data_size,
-                                                   int sample_rate, int sample_width,
-                                                   int channel_count)
+int vibra_cancel_job(vibra_queue_t *queue, vibra_job_t job)
 {
-    Wav wav = Wav::FromSignedPCM(raw_pcm, pcm_data_size, sample_rate, sample_width, channel_count);
-    return _get_fingerprint_from_wav(wav);
+    return queue->Cancel(job) ? 1 : 0;
 }
 
-Fingerprint *vibra_get_fingerprint_from_float_pcm(const char *raw_pcm, int pcm_data_size,
-                                                  int sample_rate, int sample_width,
-                                                  int channel_count)
+size_t vibra_queue_poll(vibra_queue_t *queue, vibra_completion_t *completions,
+                        size_t max_completions)
 {
-    Wav wav = Wav::FromFloatPCM(raw_pcm, pcm_data_size, sample_rate, sample_width, channel_count);
-    return _get_fingerprint_from_wav(wav);
+    return queue->Take(completions, max_completions, 0);
 }
 
-const char *vibra_get_uri_from_fingerprint(Fingerprint *fingerprint)
+size_t vibra_queue_wait(vibra_queue_t *queue, vibra_completion_t *completions,
+                        size_t max_completions, int timeout_ms)
 {
-    return fingerprint->uri.c_str();
+    return queue->Take(completions, max_completions, timeout_ms);
 }
 
-unsigned int vibra_get_sample_ms_from_fingerprint(Fingerprint *fingerprint)
+int vibra_queue_get_fd(vibra_queue_t *queue)
 {
-    return fingerprint->sample_ms;
+    return queue->notifier.fd();
 }
 
-void vibra_free_fingerprint(Fingerprint *fingerprint)
+void _generate_from_music_file(VibraContext *context, const std::string &path)
 {
-    delete fingerprint;
+    generate_cached(context, path, CACHE_BEST_WINDOW,
+                    [context, &path] { _generate_from_music_file_uncached(context, path); });
 }
 
-double vibra_get_duration(const char *music_file_path)
+void _generate_from_offset(VibraContext *context, const std::string &path,
+                           std::uint32_t offset_seconds)
 {
-    return get_song_duration(music_file_path);
+    generate_cached(context, path, offset_seconds, [context, &path, offset_seconds] {
+        _generate_from_offset_uncached(context, path, offset_seconds);
+    });
 }
 
-Fingerprint *vibra_get_fingerprint_from_offset(const char *music_file_path, unsigned int offset_seconds)
+void _generate_from_music_file_uncached(VibraContext *context, const std::string &path)
 {
-    std::string path = music_file_path;
+    if (is_wav_file(path))
+    {
+        Wav wav = Wav::FromFile(path);
+        _generate_from_wav(context, &wav);
+        return;
+    }
 
-    LowQualityTrack pcm = ffmpeg::FFmpegWrapper::ConvertToLowQaulityPcm(path, offset_seconds, MAX_DURATION_SECONDS);
-    return _get_fingerprint_from_low_quality_pcm(pcm, offset_seconds);
+#ifdef VIBRA_WITH_LIBAV
+    try
+    {
+        // Open the container once for duration, segment analysis and the final window
+        libav::LibavDecoder decoder(path);
+        _generate_from_range_decoder(
+            context, decoder.duration(),
+            [&decoder](std::uint32_t start, std::uint32_t length, const ffmpeg::PcmSink &sink) {
+                decoder.Decode(start, length, sink);
+            });
+        return;
+    }
+    catch (const std::exception &)
+    {
+        // fall back to the FFmpeg command line tools below, unless the job was cancelled
+        check_cancelled(context);
+    }
+#endif
+
+    // Get song duration and find optimal start offset using smart analysis
+    _generate_from_range_decoder(
+        context, get_song_duration(path, context->cancel),
+        [&path, context](std::uint32_t start, std::uint32_t length, const ffmpeg::PcmSink &sink) {
+            ffmpeg::FFmpegWrapper::StreamLowQualityPcm(
+                path, start, length, sink,
+                decoder_options(FFMPEG_TIMEOUT_MS + length * FFMPEG_TIMEOUT_MS_PER_SECOND,
+                                context->cancel));
+        });
 }
 
-Fingerprint *_get_fingerprint_from_wav(const Wav &wav)
+void _generate_from_offset_uncached(VibraContext *context, const std::string &path,
+                                    std::uint32_t offset_seconds)
 {
-    LowQualityTrack pcm = Downsampler::GetLowQualityPCM(wav);
-    return _get_fingerprint_from_low_quality_pcm(pcm, 0);
+#ifdef VIBRA_WITH_LIBAV
+    try
+    {
+        libav::LibavDecoder decoder(path);
+        LowQualityTrack pcm = decoder.ReadWindow(offset_seconds, MAX_DURATION_SECONDS);
+        _generate_from_low_quality_pcm(context, pcm, offset_seconds);
+        return;
+    }
+    catch (const std::exception &)
+    {
+        // fall back to the FFmpeg command line tools below, unless the job was cancelled
+        check_cancelled(context);
+    }
+#endif
+
+    LowQualityTrack pcm = ffmpeg::FFmpegWrapper::ConvertToLowQaulityPcm(
+        path, offset_seconds, MAX_DURATION_SECONDS,
+        decoder_options(FFMPEG_TIMEOUT_MS, context->cancel));
+    _generate_from_low_quality_pcm(context, pcm, offset_seconds);
 }
 
-Fingerprint *_get_fingerprint_from_low_quality_pcm(const LowQualityTrack &pcm, std::uint32_t offset_seconds)
+void _generate_from_wav(VibraContext *context, Wav *wav)
 {
-    SignatureGenerator generator;
+    context->has_signature = false;
+    SignatureGenerator &generator = context->generator;
+    generator.Reset();
+    generator.set_max_time_seconds(MAX_DURATION_SECONDS);
+
+    // Feed the generator block by block so only the audio it actually needs is decoded
+    LowQualityTrack &block = context->block;
+    while (Downsampler::ReadLowQualityPCM(wav, &block, WAV_STREAM_BLOCK_SECONDS))
+    {
+        check_cancelled(context);
+        generator.FeedInput(block);
+        if (generator.ProcessPendingInput())
+        {
+            break;
+        }
+    }
+
+    context->signature = generator.GetNextSignature();
+    context->offset_seconds = 0;
+    context->has_signature = true;
+}
+
+void _generate_from_range_decoder(VibraContext *context, double duration,
+                                  const RangeDecoder &decode)
+{
+    // Decode the part between the intro and the outro once, at most MAX_SCAN_SECONDS of it
+    // around the middle, and keep the window with the highest peak density; songs too short
+    // for that are scanned whole, unknown durations use the start
+    std::uint32_t start = 0;
+    std::uint32_t length = MAX_DURATION_SECONDS;
+    // a probe that failed or timed out may well succeed next time
+    context->cacheable = duration > 0.0;
+    if (duration > MAX_DURATION_SECONDS)
+    {
+        std::uint32_t whole_seconds = static_cast<std::uint32_t>(duration);
+        length = whole_seconds;
+        if (whole_seconds >= INTRO_SKIP_SECONDS + MAX_DURATION_SECONDS + OUTRO_SKIP_SECONDS)
+        {
+            start = INTRO_SKIP_SECONDS;
+            length = whole_seconds - INTRO_SKIP_SECONDS - OUTRO_SKIP_SECONDS;
+        }
+        if (length > MAX_SCAN_SECONDS)
+        {
+            start += (length - MAX_SCAN_SECONDS) / 2;
+            length = MAX_SCAN_SECONDS;
+        }
+    }
+
+    SegmentSelector &selector = context->selector;
+    selector.Reset();
+    decode(start, length,
+           [context, &selector](const LowQualitySample *samples, std::size_t count) {
+               // throwing here also kills an ffmpeg process feeding the selector
+               check_cancelled(context);
+               selector.FeedInput(samples, count);
+           });
+    _generate_from_low_quality_pcm(context, selector.best_window(),
+                                   start + selector.best_offset_seconds());
+}
+
+void _generate_from_low_quality_pcm(VibraContext *context, const LowQualityTrack &pcm,
+                                    std::uint32_t offset_seconds)
+{
+    context->has_signature = false;
+    check_cancelled(context);
+    SignatureGenerator &generator = context->generator;
+    generator.Reset();
     generator.FeedInput(pcm);
     generator.set_max_time_seconds(MAX_DURATION_SECONDS);
 
-    Signature signature = generator.GetNextSignature();
+    context->signature = generator.GetNextSignature();
+    context->offset_seconds = offset_seconds;
+    context->has_signature = true;
+}
 
+Fingerprint *_get_fingerprint_from_context(const VibraContext *context)
+{
+    const Signature &signature = context->signature;
     Fingerprint *fingerprint = new Fingerprint;
     fingerprint->uri = signature.EncodeBase64();
     fingerprint->sample_ms = signature.num_samples() * 1000 / signature.sample_rate();
-    fingerprint->offset_ms = offset_seconds * 1000;
+    fingerprint->offset_ms = context->offset_seconds * 1000;
+
+    // quality figures, all gathered while the signature was generated
+    std::uint32_t peaks = 0;
+    for (int band = 0; band < FINGERPRINT_BAND_COUNT; band++)
+    {
+        fingerprint->band_peaks[band] = signature.PeaksInBand(static_cast<FrequencyBand>(band));
+        peaks += fingerprint->band_peaks[band];
+    }
+    fingerprint->peak_density =
+        signature.num_samples() == 0
+            ? 0.0
+            : peaks * static_cast<double>(signature.sample_rate()) / signature.num_samples();
+    fingerprint->rms = signature.rms();
+    fingerprint->silence_ratio = signature.silence_ratio();
+    std::vector<std::uint32_t> landmarks = signature.Landmarks();
+    fingerprint->landmarks.assign(landmarks.begin(), landmarks.end());
     return fingerprint;
 }
+
+std::size_t _copy_signature(VibraContext *context, vibra_signature_format_t format, char *buffer,
+                            std::size_t buffer_size)
+{
+    if (!context->has_signature)
+    {
+        return 0;
+    }
+    const Signature &signature = context->signature;
+    std::size_t encoded_size = signature.EncodedSize();
+    if (format == VIBRA_SIGNATURE_RAW)
+    {
+        if (buffer && buffer_size >= encoded_size)
+        {
+            signature.Encode(buffer);
+        }
+        return encoded_size;
+    }
+
+    std::size_t uri_size = Signature::DataUriSize(encoded_size) + 1; // with the terminating null
+    if (buffer && buffer_size >= uri_size)
+    {
+        context->encoded.resize(encoded_size);
+        signature.Encode(context->encoded.data());
+        Signature::WriteDataUri(context->encoded.data(), encoded_size, buffer);
+        buffer[uri_size - 1] = '\0';
+    }
+    return uri_size;
+}
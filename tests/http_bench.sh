@@ -0,0 +1,76 @@
+#!/bin/bash
+#
+# Compares request latency with and without connection reuse against a local HTTPS server that
+# stands in for the recognition endpoint.
+#
+#   cmake -S . -B build -DBUILD_BENCHMARKS=ON && cmake --build build
+#   tests/http_bench.sh build/cli/http_client_bench [requests] [threads]
+
+set -e
+
+BENCH=${1:?usage: $0 <http_client_bench binary> [requests] [threads]}
+REQUESTS=${2:-200}
+THREADS=${3:-4}
+PORT=${HTTP_BENCH_PORT:-8443}
+
+WORK_DIR=$(mktemp -d)
+SERVER_PID=
+
+function cleanup() {
+    if [ -n "$SERVER_PID" ]; then
+        kill "$SERVER_PID" 2> /dev/null || true
+    fi
+    rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj "/CN=localhost" \
+    -addext "subjectAltName=DNS:localhost" \
+    -keyout "$WORK_DIR/key.pem" -out "$WORK_DIR/cert.pem" > /dev/null 2>&1
+
+cat > "$WORK_DIR/server.py" << 'EOF'
+import http.server
+import socketserver
+import ssl
+import sys
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"  # keep-alive
+    disable_nagle_algorithm = True
+
+    def do_POST(self):
+        self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        body = b'{"matches":[],"tagid":"00000000-0000-0000-0000-000000000000"}'
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, *args):
+        pass
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    request_queue_size = 128
+
+port, cert, key = int(sys.argv[1]), sys.argv[2], sys.argv[3]
+context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+context.load_cert_chain(cert, key)
+server = Server(("127.0.0.1", port), Handler)
+server.socket = context.wrap_socket(server.socket, server_side=True)
+server.serve_forever()
+EOF
+
+python3 "$WORK_DIR/server.py" "$PORT" "$WORK_DIR/cert.pem" "$WORK_DIR/key.pem" &
+SERVER_PID=$!
+
+# wait for the server to accept connections
+for _ in $(seq 50); do
+    if curl -s --cacert "$WORK_DIR/cert.pem" -d x "https://localhost:$PORT/" > /dev/null; then
+        break
+    fi
+    sleep 0.1
+done
+
+"$BENCH" "https://localhost:$PORT/discovery/v5/tag" "$WORK_DIR/cert.pem" "$REQUESTS" "$THREADS"
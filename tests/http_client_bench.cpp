@@ -0,0 +1,118 @@
+// Request latency of one easy handle per request (how the CLI used to talk to Shazam) against
+// HttpClient's pooled per-thread handles and the single-threaded HttpEventLoop. Run through
+// http_bench.sh, which starts a local HTTPS stand-in for the recognition endpoint.
+#include <curl/curl.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "communication/http_client.h"
+#include "communication/http_event_loop.h"
+
+static std::size_t discard(void *, size_t size, size_t nmemb, void *)
+{
+    return size * nmemb;
+}
+
+static bool performFresh(const HttpRequest &request)
+{
+    CURL *curl = curl_easy_init();
+    if (!curl)
+    {
+        return false;
+    }
+    curl_easy_setopt(curl, CURLOPT_URL, request.url.c_str());
+    curl_easy_setopt(curl, CURLOPT_CAINFO, request.ca_info.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request.post_fields.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+    CURLcode res = curl_easy_perform(curl);
+    curl_easy_cleanup(curl);
+    return res == CURLE_OK;
+}
+
+static bool performPooled(const HttpRequest &request)
+{
+    return HttpClient::Shared().Perform(request).ok();
+}
+
+static bool performOnLoop(const HttpRequest &request)
+{
+    return HttpEventLoop::Shared().Perform(request).ok();
+}
+
+static void run(const char *name, bool (*perform)(const HttpRequest &), const HttpRequest &request,
+                int requests, int threads)
+{
+    std::vector<std::vector<double>> latencies(threads);
+    std::vector<int> failures(threads, 0);
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t] {
+            for (int i = t; i < requests; i += threads)
+            {
+                auto begin = std::chrono::steady_clock::now();
+                if (!perform(request))
+                {
+                    failures[t]++;
+                }
+                std::chrono::duration<double, std::milli> took =
+                    std::chrono::steady_clock::now() - begin;
+                latencies[t].push_back(took.count());
+            }
+        });
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    std::chrono::duration<double> total = std::chrono::steady_clock::now() - start;
+
+    std::vector<double> all;
+    int failed = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+        failed += failures[t];
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&all](double p) {
+        return all[std::min(all.size() - 1, static_cast<std::size_t>(p * all.size()))];
+    };
+    std::printf("%-7s %6d requests  %8.1f req/s  p50 %7.2f ms  p95 %7.2f ms  p99 %7.2f ms  "
+                "failed %d\n",
+                name, requests, requests / total.count(), percentile(0.50), percentile(0.95),
+                percentile(0.99), failed);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::fprintf(stderr, "usage: %s <url> <ca file> [requests] [threads]\n", argv[0]);
+        return 1;
+    }
+
+    HttpRequest request;
+    request.url = argv[1];
+    request.ca_info = argv[2];
+    request.post_fields = std::string(4096, 'A'); // about the size of a signature request
+    request.http_1_1 = true;
+    int requests = argc > 3 ? std::atoi(argv[3]) : 200;
+    int threads = argc > 4 ? std::atoi(argv[4]) : 4;
+    if (requests < 1 || threads < 1)
+    {
+        std::fprintf(stderr, "requests and threads must be positive\n");
+        return 1;
+    }
+
+    run("fresh", performFresh, request, requests, threads);
+    run("pooled", performPooled, request, requests, threads);
+    run("loop", performOnLoop, request, requests, threads);
+    return 0;
+}
@@ -6,6 +6,7 @@ TEST_TARGET=sample.mp3
 TEST_TARGET_TITLE="Misty"
 VIBRA_CLI=vibra
 SHAZAM_REQUEST_DELAY=${1:-3}
+DURATION_TOLERANCE=0.1
 FAILED=0
 
 function pass() {
@@ -37,6 +38,17 @@ function check_title() {
     fi
 }
 
+function check_duration() {
+    local expected=$1
+    local actual=$2
+    if [ -z "$actual" ] || ! awk -v a="$actual" -v e="$expected" -v t="$DURATION_TOLERANCE" \
+        'BEGIN { d = a - e; exit !(d <= t && d >= -t) }'; then
+        fail "Wrong duration (Expected: $expected, Got: $actual)"
+    else
+        pass "passed!"
+    fi
+}
+
 function test_audio_file() {
     local extension=$1
     local file=$2
@@ -51,6 +63,67 @@ function test_audio_file() {
     check_title "$expected_title" "$title"
 }
 
+function test_wav_variants() {
+    info "Testing WAV variants..."
+    echo
+
+    local file=$1
+    local expected_title=$2
+    local temp_file="/tmp/test_variant.wav"
+
+    # ffmpeg writes WAVE_FORMAT_EXTENSIBLE for >16 bit or >2 channel audio
+    for options in "-c:a pcm_s24le" "-c:a pcm_f32le -ac 6" "-c:a pcm_s16le -rf64 always"; do
+        info "   $options..."
+        # shellcheck disable=SC2086
+        ffmpeg -y -i "$file" $options "$temp_file" > /dev/null 2>&1
+
+        local title
+        title=$(recognize_audio "$temp_file")
+        check_title "$expected_title" "$title"
+    done
+}
+
+function test_duration() {
+    info "Testing duration probe..."
+    echo
+
+    local file=$1
+    local vibra_path
+    vibra_path=$(command -v "$VIBRA_CLI")
+
+    for variant in "wav:" "mp3:" "flac:" "m4a:-c:a aac" "ogg:-c:a libvorbis"; do
+        local extension=${variant%%:*}
+        local options=${variant#*:}
+        local temp_file="/tmp/test_duration.$extension"
+        info "   $extension..."
+        # shellcheck disable=SC2086
+        ffmpeg -y -i "$file" $options "$temp_file" > /dev/null 2>&1
+
+        local expected actual
+        expected=$(ffprobe -v error -show_entries format=duration \
+            -of default=noprint_wrappers=1:nokey=1 "$temp_file")
+        # with no ffprobe on the PATH only the header probe (or libav, if linked) can answer
+        actual=$(PATH="" "$vibra_path" --duration --file "$temp_file" 2>/dev/null || true)
+        check_duration "$expected" "$actual"
+    done
+
+    # the header probe doesn't read AIFF, whose sample data mustn't pass for MPEG frames: the
+    # duration comes from libav or there is none
+    info "   aiff..."
+    local temp_file="/tmp/test_duration.aiff"
+    ffmpeg -y -i "$file" "$temp_file" > /dev/null 2>&1
+
+    local expected actual
+    expected=$(ffprobe -v error -show_entries format=duration \
+        -of default=noprint_wrappers=1:nokey=1 "$temp_file")
+    actual=$(PATH="" "$vibra_path" --duration --file "$temp_file" 2>/dev/null || true)
+    if [ -z "$actual" ]; then
+        pass "passed!"
+    else
+        check_duration "$expected" "$actual"
+    fi
+}
+
 function test_raw_pcm() {
     info "Testing raw PCM data..."
     echo
@@ -86,9 +159,11 @@ function run_tests() {
     echo "Running vibra tests..."
     echo
 
+    test_duration "$TEST_TARGET"
     test_audio_file "wav" "$TEST_TARGET" "$TEST_TARGET_TITLE"
     test_audio_file "mp3" "$TEST_TARGET" "$TEST_TARGET_TITLE"
     test_audio_file "flac" "$TEST_TARGET" "$TEST_TARGET_TITLE"
+    test_wav_variants "$TEST_TARGET" "$TEST_TARGET_TITLE"
     test_raw_pcm "$TEST_TARGET" "$TEST_TARGET_TITLE"
     
     echo